@@ -31,51 +31,283 @@ bool chkhdrline ( const char* str )
 }
 
 
+// State of the stream handling, shared by handlebyte() and handlebytes().
+static bool      firstmetabyte ;                       // True if first metabyte (counter)
+static int       LFcount ;                             // Detection of end of header
+static __attribute__((aligned(4))) uint8_t buf[32] ;   // Buffer for chunk
+static int       bufcnt = 0 ;                          // Data in chunk
+static bool      firstchunk = true ;                   // First chunk as input
+
+
 //******************************************************************************************
-//                           H A N D L E B Y T E _ C H                                     *
+//                           S H O W F I R S T C H U N K                                   *
 //******************************************************************************************
-// Handle the next byte of data from server.                                               *
-// Chunked transfer encoding aware. Chunk extensions are not supported.                    *
+// Show the first 32 bytes of MP3/Ogg data of a new stream for debugging.                  *
 //******************************************************************************************
-void handlebyte_ch ( uint8_t b, bool force )
+void showfirstchunk ( const uint8_t* p, int len )
 {
-  static int  chunksize = 0 ;                         // Chunkcount read from stream
+  int i ;                                              // Loop control
 
-  if ( chunked && !force && 
-       ( datamode & ( DATA |                          // Test op DATA handling
-                      METADATA |
-                      PLAYLISTDATA ) ) )
+  if ( firstchunk )
   {
-    if ( chunkcount == 0 )                            // Expecting a new chunkcount?
+    firstchunk = false ;
+    dbgprint ( "First chunk:" ) ;                      // Header for printout of first chunk
+    for ( i = 0 ; i + 8 <= len ; i += 8 )              // Print max 4 lines
     {
-       if ( b == '\r' )                               // Skip CR
-       {
-         return ;      
-       }
-       else if ( b == '\n' )                          // LF ?
-       {
-         chunkcount = chunksize ;                     // Yes, set new count
-         chunksize = 0 ;                              // For next decode
-         return ;
-       }
-       // We have received a hexadecimal character.  Decode it and add to the result.
-       b = toupper ( b ) - '0' ;                      // Be sure we have uppercase
-       if ( b > 9 )
-       {
-         b = b - 7 ;                                  // Translate A..F to 10..15
-       }
-       chunksize = ( chunksize << 4 ) + b ;
+      dbgprint ( "%02X %02X %02X %02X %02X %02X %02X %02X",
+                 p[i],   p[i + 1], p[i + 2], p[i + 3],
+                 p[i + 4], p[i + 5], p[i + 6], p[i + 7] ) ;
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                              P L A Y D A T A                                            *
+//******************************************************************************************
+// Send a run of MP3/Ogg data to the VS1053.  At most 32 bytes, see handlebytes().         *
+// SPI.writeBytes() reads the data as 32 bit words, so an unaligned run is copied to the   *
+// aligned chunkbuffer first.                                                              *
+//******************************************************************************************
+void playdata ( uint8_t* p, uint32_t len )
+{
+  showfirstchunk ( p, len ) ;                          // Show if first chunk
+  if ( pipemute )                                      // Benchmark running?
+  {
+    // Yes, do not play
+  }
+  else if ( ( (uintptr_t)p & 3 ) == 0 )                // Aligned?
+  {
+    vs1053player.playChunk ( p, len ) ;                // Yes, send directly from ringbuffer
+  }
+  else
+  {
+    memcpy ( buf, p, len ) ;                           // No, use the aligned buffer
+    vs1053player.playChunk ( buf, len ) ;
+  }
+  totalcount += len ;                                  // Count number of bytes, ignore overflow
+}
+
+
+//******************************************************************************************
+//                                P L A Y R U N                                            *
+//******************************************************************************************
+// Send a run of audio data to the VS1053.  Returns the number of bytes used.  Data before *
+// the first MPEG frame header is skipped, see mpegsync.cpp.  After a loss of sync in the  *
+// stream the data is played while the analyzer searches, the decoder resyncs by itself.   *
+//******************************************************************************************
+uint32_t playrun ( uint8_t* p, uint32_t len )
+{
+  if ( ( mpegsync.state == MS_HUNT ) && mpegsync.frames ) // Lost sync in the stream?
+  {
+    len = mpeghunt ( &mpegsync, p, len ) ;             // Yes, search next frame header
+    playdata ( p, len ) ;                              // but play all, header included
+    return len ;
+  }
+  if ( mpegsync.state == MS_HUNT )                     // Searching for first MPEG frame?
+  {
+    len = mpeghunt ( &mpegsync, p, len ) ;             // Yes, skip up to frame header
+    if ( mpegsync.state == MS_SYNC )                   // Frame header found?
+    {
+      playdata ( mpegsync.hdr, 4 ) ;                   // Yes, decoder starts with this header
+    }
+    return len ;
+  }
+  mpegtrack ( &mpegsync, p, len ) ;                    // Follow the frame headers
+  playdata ( p, len ) ;                                // Send the run to the VS1053
+  return len ;
+}
+
+
+//******************************************************************************************
+//                           H A N D L E M E T A E N D                                     *
+//******************************************************************************************
+// A complete metadata block has been received.  Show it if changed and switch to DATA.    *
+//******************************************************************************************
+void handlemetaend()
+{
+  if ( icymeta.len > 1500 )                            // Unlikely metadata length?
+  {
+    dbgprint ( "Metadata block too long! Skipping all Metadata from now on." ) ;
+    metaint = 0 ;                                      // Probably no metadata
+    streamfunc = pipeselect() ;                        // Pipeline without metadata
+  }
+  else if ( icymeta.len )                              // Any info present?
+  {
+    // The block contains artist and song name.  For example:
+    // "StreamTitle='Don McLean - American Pie';StreamUrl='';"
+    // Sometimes it is just other info like:
+    // "StreamTitle='60s 03 05 Magic60s';StreamUrl='';"
+    icymetaend ( &icymeta ) ;                          // Show artist and title if changed
+  }
+  icymeta.len = 0 ;                                    // Ready for next block
+  datacount = metaint ;                                // Reset data count
+  bufcnt = 0 ;                                         // Reset buffer count
+  datamode = DATA ;                                    // Expecting data
+}
+
+
+//******************************************************************************************
+//                             S T R E A M I N I T                                         *
+//******************************************************************************************
+// Initialize for header receive of a new stream.                                          *
+//******************************************************************************************
+void streaminit()
+{
+  hdrinit ( &streamhdr ) ;                             // Nothing seen in header yet
+  metaint = 0 ;                                        // No metaint found
+  bitrate = 0 ;                                        // Bitrate still unknown
+  dbgprint ( "Switch to HEADER" ) ;
+  datamode = HEADER ;                                  // Handle header
+  totalcount = 0 ;                                     // Reset totalcount
+  metaline = "" ;                                      // No metadata yet
+  icymetainit ( &icymeta ) ;                           // No title yet
+  streamfunc = handlebytes_ch ;                        // Generic handling until format known
+  firstchunk = true ;                                  // First chunk expected
+}
+
+
+//******************************************************************************************
+//                           S T R E A M H D R E N D                                       *
+//******************************************************************************************
+// The header of the stream has been parsed.  Take over the results and switch to DATA.    *
+// For a gapless transition the decoder is still playing, newsong is false then.           *
+//******************************************************************************************
+void streamhdrend ( bool newsong )
+{
+  bitrate = streamhdr.icybr ;                          // Bitrate from header, until measured
+  metaint = streamhdr.metaint ;                        // Metadata interval from header
+  if ( streamhdr.icyname[0] )                          // Station name seen?
+  {
+    displayinfo ( streamhdr.icyname, 60, 68,
+                  YELLOW ) ;                           // Show station name at position 60
+  }
+  if ( !sniffstart() )                                 // Content acceptable?
+  {
+    displayinfo ( "Unsupported stream", 60, 68, YELLOW ) ;
+    datamode = STOPREQD ;                              // No, stop player
+    return ;
+  }
+  chunked = streamhdr.chunked ;                        // Remember chunked transfer mode
+  if ( chunked )                                       // Station provides chunked transfer?
+  {
+    chunkinit ( &chunkdec ) ;                          // Expect chunksize in DATA
+  }
+  dbgprint ( "Switch to DATA, bitrate is %d"           // Show bitrate
+             ", metaint is %d",                        // and metaint
+             bitrate, metaint ) ;
+  datamode = DATA ;                                    // Expecting data now
+  datacount = metaint ;                                // Number of bytes before first metadata
+  bufcnt = 0 ;                                         // Reset buffer count
+  if ( newsong )                                       // Decoder idle?
+  {
+    vs1053player.startSong() ;                         // Yes, start a new song
+  }
+}
+
+
+//******************************************************************************************
+//                           H A N D L E B Y T E S                                         *
+//******************************************************************************************
+// Handle a span of data from the server (not chunked).  Returns the number of bytes used. *
+// Called again by the caller for the rest of the span.                                    *
+// In DATA mode the run up to the next metadata boundary is sent to the VS1053 in one go.  *
+// The first bytes are used to detect the format, see sniff.cpp.                           *
+// In METADATA mode the rest of the metadata block is collected in one go.  In HEADER mode *
+// the span is given to the header parser.  Other modes are handled per byte.              *
+// Produces the same output to the VS1053 as handlebyte() for every byte.                  *
+//******************************************************************************************
+uint32_t handlebytes ( uint8_t* p, uint32_t len )
+{
+  uint32_t n ;                                         // Length of run
+
+  if ( datamode == DATA )                              // MP3/Ogg data?
+  {
+    n = len ;
+    if ( ( metaint != 0 ) && ( n > (uint32_t)datacount ) )
+    {
+      n = datacount ;                                  // Stop at metadata boundary
+    }
+    if ( sniffing )                                    // Format of stream known?
+    {
+      n = sniffdata ( p, n ) ;                         // No, collect first bytes
     }
     else
     {
-      handlebyte ( b, force ) ;                       // Normal data byte
-      chunkcount-- ;                                  // Update count to next chunksize block
+      n = playrun ( p, n ) ;                           // Yes, send the run to the VS1053
+    }
+    if ( metaint != 0 )                                // No METADATA on Ogg streams or mp3 files
+    {
+      datacount -= n ;
+      if ( datacount == 0 )                            // End of datablock?
+      {
+        datamode = METADATA ;
+        firstmetabyte = true ;                         // Expecting first metabyte (counter)
+      }
     }
+    return n ;
   }
-  else
+  if ( ( datamode == METADATA ) && !firstmetabyte )    // Contents of metadata block?
+  {
+    n = len ;
+    if ( n > (uint32_t)metacount )
+    {
+      n = metacount ;                                  // Stop at end of block
+    }
+    icymetaadd ( &icymeta, p, n ) ;                    // Add the run to the block
+    metacount -= n ;
+    if ( metacount == 0 )
+    {
+      handlemetaend() ;                                // End of metadata block
+    }
+    return n ;
+  }
+  if ( datamode == INIT )                              // Initialize for header receive
+  {
+    streaminit() ;                                     // Yes, datamode becomes HEADER
+  }
+  if ( datamode == HEADER )                            // Header data?
+  {
+    n = hdrparse ( &streamhdr, p, len ) ;              // Yes, parse as much as possible
+    if ( streamhdr.done )                              // End of header?
+    {
+      streamhdrend ( true ) ;                          // Yes, switch to DATA
+    }
+    return n ;
+  }
+  handlebyte ( *p ) ;                                  // Other modes, handle one byte
+  return 1 ;
+}
+
+
+//******************************************************************************************
+//                          H A N D L E B Y T E S _ C H                                    *
+//******************************************************************************************
+// Handle a span of data from server.  Returns the number of bytes used.                   *
+// Chunked transfer encoding aware.  The payload is passed to handlebytes() as sub-spans   *
+// of the input, without copying.                                                          *
+//******************************************************************************************
+uint32_t handlebytes_ch ( uint8_t* p, uint32_t len )
+{
+  const uint8_t* pl ;                                  // Payload in span
+  uint32_t       plen ;                                // Length of payload
+  uint32_t       used ;                                // Bytes used from input span
+  uint32_t       n ;                                   // Bytes used by handlebytes
+
+  if ( chunked && ( datamode & ( DATA |                // Test op DATA handling
+                                 METADATA |
+                                 PLAYLISTDATA ) ) )
   {
-    handlebyte ( b, force ) ;                         // Normal handling of this byte
+    used = chunkdecode ( &chunkdec, p, len, &pl, &plen ) ;
+    while ( plen )                                     // Handle all of the payload
+    {
+      n = handlebytes ( (uint8_t*)pl, plen ) ;
+      pl += n ;
+      plen -= n ;
+    }
+    return used ;
   }
+  return handlebytes ( p, len ) ;                      // Normal handling of this span
 }
 
 
@@ -89,47 +321,16 @@ void handlebyte_ch ( uint8_t b, bool force )
 //******************************************************************************************
 void handlebyte ( uint8_t b, bool force )
 {
-  static uint16_t  playlistcnt ;                       // Counter to find right entry in playlist
-  static bool      firstmetabyte ;                     // True if first metabyte (counter)
-  static int       LFcount ;                           // Detection of end of header
-  static __attribute__((aligned(4))) uint8_t buf[32] ; // Buffer for chunk
-  static int       bufcnt = 0 ;                        // Data in chunk
-  static bool      firstchunk = true ;                 // First chunk as input
-  String           lcml ;                              // Lower case metaline
-  String           ct ;                                // Contents type
-  static bool      ctseen = false ;                    // First line of header seen or not
-  int              inx ;                               // Pointer in metaline
-  int              i ;                                 // Loop control
-
-  if ( datamode == INIT )                              // Initialize for header receive
-  {
-    ctseen = false ;                                   // Contents type not seen yet
-    metaint = 0 ;                                      // No metaint found
-    LFcount = 0 ;                                      // For detection end of header
-    bitrate = 0 ;                                      // Bitrate still unknown
-    dbgprint ( "Switch to HEADER" ) ;
-    datamode = HEADER ;                                // Handle header
-    totalcount = 0 ;                                   // Reset totalcount
-    metaline = "" ;                                    // No metadata yet
-    firstchunk = true ;                                // First chunk expected
-  }
   if ( datamode == DATA )                              // Handle next byte of MP3/Ogg data
   {
     buf[bufcnt++] = b ;                                // Save byte in chunkbuffer
     if ( bufcnt == sizeof(buf) || force )              // Buffer full?
     {
-      if ( firstchunk )
+      showfirstchunk ( buf, bufcnt ) ;                 // Show if first chunk
+      if ( !pipemute )                                 // Benchmark running?
       {
-        firstchunk = false ;
-        dbgprint ( "First chunk:" ) ;                  // Header for printout of first chunk
-        for ( i = 0 ; i < 32 ; i += 8 )                // Print 4 lines
-        {
-          dbgprint ( "%02X %02X %02X %02X %02X %02X %02X %02X",
-                     buf[i],   buf[i + 1], buf[i + 2], buf[i + 3],
-                     buf[i + 4], buf[i + 5], buf[i + 6], buf[i + 7] ) ;
-        }
+        vs1053player.playChunk ( buf, bufcnt ) ;       // No, send to player
       }
-      vs1053player.playChunk ( buf, bufcnt ) ;         // Yes, send to player
       bufcnt = 0 ;                                     // Reset count
     }
     totalcount++ ;                                     // Count number of bytes, ignore overflow
@@ -137,87 +338,17 @@ void handlebyte ( uint8_t b, bool force )
     {
       if ( --datacount == 0 )                          // End of datablock?
       {
-        if ( bufcnt )                                  // Yes, still data in buffer?
+        if ( bufcnt && !pipemute )                     // Yes, still data in buffer?
         {
           vs1053player.playChunk ( buf, bufcnt ) ;     // Yes, send to player
-          bufcnt = 0 ;                                 // Reset count
         }
+        bufcnt = 0 ;                                   // Reset count
         datamode = METADATA ;
         firstmetabyte = true ;                         // Expecting first metabyte (counter)
       }
     }
     return ;
   }
-  if ( datamode == HEADER )                            // Handle next byte of MP3 header
-  {
-    if ( ( b > 0x7F ) ||                               // Ignore unprintable characters
-         ( b == '\r' ) ||                              // Ignore CR
-         ( b == '\0' ) )                               // Ignore NULL
-    {
-      // Yes, ignore
-    }
-    else if ( b == '\n' )                              // Linefeed ?
-    {
-      LFcount++ ;                                      // Count linefeeds
-      if ( chkhdrline ( metaline.c_str() ) )           // Reasonable input?
-      {
-        lcml = metaline ;                              // Use lower case for compare
-        lcml.toLowerCase() ;
-        dbgprint ( metaline.c_str() ) ;                // Yes, Show it
-        if ( lcml.indexOf ( "content-type" ) >= 0 )    // Line with "Content-Type: xxxx/yyy"
-        {
-          ctseen = true ;                              // Yes, remember seeing this
-          ct = metaline.substring ( 14 ) ;             // Set contentstype. Not used yet
-          dbgprint ( "%s seen.", ct.c_str() ) ;
-        }
-        if ( lcml.startsWith ( "icy-br:" ) )
-        {
-          bitrate = metaline.substring(7).toInt() ;    // Found bitrate tag, read the bitrate
-          if ( bitrate == 0 )                          // For Ogg br is like "Quality 2"
-          {
-            bitrate = 87 ;                             // Dummy bitrate
-          }
-        }
-        else if ( lcml.startsWith ( "icy-metaint:" ) )
-        {
-          metaint = metaline.substring(12).toInt() ;   // Found metaint tag, read the value
-        }
-        else if ( lcml.startsWith ( "icy-name:" ) )
-        {
-          icyname = metaline.substring(9) ;            // Get station name
-          icyname.trim() ;                             // Remove leading and trailing spaces
-          displayinfo ( icyname.c_str(), 60, 68,
-                        YELLOW ) ;                     // Show station name at position 60
-        }
-        else if ( lcml.startsWith ( "transfer-encoding:" ) )
-        {
-          // Station provides chunked transfer
-          if ( lcml.endsWith ( "chunked" ) )
-          {
-            chunked = true ;                           // Remember chunked transfer mode
-            chunkcount = 0 ;                           // Expect chunkcount in DATA
-          }
-        }
-      }
-      metaline = "" ;                                  // Reset this line
-      if ( ( LFcount == 2 ) && ctseen )                // Some data seen and a double LF?
-      {
-        dbgprint ( "Switch to DATA, bitrate is %d"     // Show bitrate
-                   ", metaint is %d",                  // and metaint
-                   bitrate, metaint ) ;
-        datamode = DATA ;                              // Expecting data now
-        datacount = metaint ;                          // Number of bytes before first metadata
-        bufcnt = 0 ;                                   // Reset buffer count
-        vs1053player.startSong() ;                     // Start a new song
-      }
-    }
-    else
-    {
-      metaline += (char)b ;                            // Normal character, put new char in metaline
-      LFcount = 0 ;                                    // Reset double CRLF detection
-    }
-    return ;
-  }
   if ( datamode == METADATA )                          // Handle next byte of metadata
   {
     if ( firstmetabyte )                               // First byte of metadata?
@@ -229,32 +360,15 @@ void handlebyte ( uint8_t b, bool force )
         dbgprint ( "Metadata block %d bytes",
                    metacount - 1 ) ;                   // Most of the time there are zero bytes of metadata
       }
-      metaline = "" ;                                  // Set to empty
+      icymeta.len = 0 ;                                // Set to empty
     }
     else
     {
-      metaline += (char)b ;                            // Normal character, put new char in metaline
+      icymetaadd ( &icymeta, &b, 1 ) ;                 // Normal character, add to block
     }
     if ( --metacount == 0 )
     {
-      if ( metaline.length() )                         // Any info present?
-      {
-        // metaline contains artist and song name.  For example:
-        // "StreamTitle='Don McLean - American Pie';StreamUrl='';"
-        // Sometimes it is just other info like:
-        // "StreamTitle='60s 03 05 Magic60s';StreamUrl='';"
-        // Isolate the StreamTitle, remove leading and trailing quotes if present.
-        showstreamtitle ( metaline.c_str() ) ;         // Show artist and title if present in metadata
-      }
-      if ( metaline.length() > 1500 )                  // Unlikely metaline length?
-      {
-        dbgprint ( "Metadata block too long! Skipping all Metadata from now on." ) ;
-        metaint = 0 ;                                  // Probably no metadata
-        metaline = "" ;                                // Do not waste memory on this
-      }
-      datacount = metaint ;                            // Reset data count
-      bufcnt = 0 ;                                     // Reset buffer count
-      datamode = DATA ;                                // Expecting data
+      handlemetaend() ;                                // End of metadata block
     }
   }
   if ( datamode == PLAYLISTINIT )                      // Initialize for receive .m3u file
@@ -263,7 +377,7 @@ void handlebyte ( uint8_t b, bool force )
     metaline = "" ;                                    // Prepare for new line
     LFcount = 0 ;                                      // For detection end of header
     datamode = PLAYLISTHEADER ;                        // Handle playlist data
-    playlistcnt = 1 ;                                  // Reset for compare
+    playlistinit() ;                                   // Start with empty cache
     totalcount = 0 ;                                   // Reset totalcount
     dbgprint ( "Read from playlist" ) ;
   }
@@ -306,45 +420,11 @@ void handlebyte ( uint8_t b, bool force )
     {
       dbgprint ( "Playlistdata: %s",                   // Show playlistheader
                  metaline.c_str() ) ;
-      if ( metaline.length() < 5 )                     // Skip short lines
+      if ( metaline.length() >= 5 )                    // Skip short lines
       {
-        return ;
-      }
-      if ( metaline.indexOf ( "#EXTINF:" ) >= 0 )      // Info?
-      {
-        if ( playlist_num == playlistcnt )             // Info for this entry?
-        {
-          inx = metaline.indexOf ( "," ) ;             // Comma in this line?
-          if ( inx > 0 )
-          {
-            // Show artist and title if present in metadata
-            showstreamtitle ( metaline.substring ( inx + 1 ).c_str(), true ) ;
-          }
-        }
+        playlistline ( metaline.c_str() ) ;            // Add to playlist cache
       }
-      if ( metaline.startsWith ( "#" ) )               // Commentline?
-      {
-        metaline = "" ;
-        return ;                                       // Ignore commentlines
-      }
-      // Now we have an URL for a .mp3 file or stream.  Is it the rigth one?
-      dbgprint ( "Entry %d in playlist found: %s", playlistcnt, metaline.c_str() ) ;
-      if ( playlist_num == playlistcnt  )
-      {
-        inx = metaline.indexOf ( "http://" ) ;         // Search for "http://"
-        if ( inx >= 0 )                                // Does URL contain "http://"?
-        {
-          host = metaline.substring ( inx + 7 ) ;      // Yes, remove it and set host
-        }
-        else
-        {
-          host = metaline ;                            // Yes, set new host
-        }
-        connecttohost() ;                              // Connect to it
-      }
-      metaline = "" ;
-      host = playlist ;                                // Back to the .m3u host
-      playlistcnt++ ;                                  // Next entry in playlist
+      metaline = "" ;                                  // Ready for next line
     }
     else
     {
@@ -0,0 +1,149 @@
+//******************************************************************************************
+// Decoder for chunked transfer encoding.                                                  *
+//******************************************************************************************
+// Incremental decoder for "Transfer-Encoding: chunked".  It is fed with spans of input    *
+// and returns the payload as sub-spans of that input, so the payload is never copied.     *
+// Chunk sizes, extensions (";name=value") and trailers may be split over any number of    *
+// spans.  The state is kept in a chunkdec_t, so more than one stream can be decoded.      *
+// A bare LF is accepted instead of CRLF.  A chunksize with more than 8 hex digits or with *
+// white space between the digits is not trusted, the decoder goes to CH_ERROR and drops   *
+// the rest of the body.                                                                   *
+//******************************************************************************************
+#define CHUNKDIGITS    8                      // Max hex digits in a chunksize
+
+enum chunkstate_t { CH_SIZE, CH_EXT, CH_DATA, CH_DATAEND,     // States of chunk decoder
+                    CH_TRAILER, CH_DONE, CH_ERROR
+                  } ;
+
+struct chunkdec_t
+{
+  chunkstate_t state ;                        // State of the decoder
+  uint32_t     remain ;                       // Chunksize being decoded or bytes left in chunk
+  uint16_t     linelen ;                      // Length of current trailer line
+  uint8_t      digits ;                       // Hex digits in chunksize so far
+  bool         sizeend ;                      // White space after the digits seen
+} ;
+
+chunkdec_t   chunkdec ;                       // Decoder for the mp3 stream
+
+//******************************************************************************************
+//                                C H U N K I N I T                                        *
+//******************************************************************************************
+// Prepare the decoder for a new stream.  A chunksize line is expected first.              *
+//******************************************************************************************
+void chunkinit ( chunkdec_t* cd )
+{
+  cd->state = CH_SIZE ;
+  cd->remain = 0 ;
+  cd->linelen = 0 ;
+  cd->digits = 0 ;
+  cd->sizeend = false ;
+}
+
+
+//******************************************************************************************
+//                               C H U N K D E C O D E                                     *
+//******************************************************************************************
+// Decode the next part of the input span.  Framing bytes are skipped until payload is     *
+// found.  The payload run (never crossing a chunk boundary) is returned in *payload and   *
+// *plen.  *plen is zero if the span contained framing only.  The function returns the     *
+// number of input bytes used, including the payload run.  Call it again for the rest.     *
+//******************************************************************************************
+uint32_t chunkdecode ( chunkdec_t* cd, const uint8_t* in, uint32_t len,
+                       const uint8_t** payload, uint32_t* plen )
+{
+  uint32_t i = 0 ;                            // Index in input
+  uint8_t  b ;                                // Input byte
+
+  *plen = 0 ;                                 // No payload yet
+  while ( i < len )
+  {
+    if ( cd->state == CH_DATA )               // Payload?
+    {
+      *payload = in + i ;                     // Yes, return it as a sub-span
+      *plen = len - i ;
+      if ( *plen > cd->remain )
+      {
+        *plen = cd->remain ;                  // Stop at the end of the chunk
+      }
+      cd->remain -= *plen ;
+      if ( cd->remain == 0 )
+      {
+        cd->state = CH_DATAEND ;              // Expect CRLF after the chunk
+      }
+      return i + *plen ;
+    }
+    b = in[i++] ;                             // Framing byte
+    switch ( cd->state )
+    {
+      case CH_SIZE :                          // Hexadecimal chunksize
+        if ( isxdigit ( b ) )
+        {
+          if ( cd->sizeend || ( ++cd->digits > CHUNKDIGITS ) ) // "1 2" or too long?
+          {
+            cd->state = CH_ERROR ;            // Yes, size cannot be trusted
+            break ;
+          }
+          b = toupper ( b ) - '0' ;           // Decode the digit
+          if ( b > 9 )
+          {
+            b = b - 7 ;                       // Translate A..F to 10..15
+          }
+          cd->remain = ( cd->remain << 4 ) + b ;
+          break ;
+        }
+        if ( ( b == ' ' ) || ( b == '\t' ) || ( b == '\r' ) )
+        {
+          cd->sizeend = ( cd->digits != 0 ) ; // Skip white space and CR, no digits after it
+          break ;
+        }
+        if ( b != '\n' )                      // Start of extension?
+        {
+          cd->state = CH_EXT ;                // Yes, skip until end of line
+          break ;
+        }
+        // End of line, handled like the end of an extension
+      // Fall through
+      case CH_EXT :                           // Chunk extension
+        if ( b == '\n' )                      // End of chunksize line?
+        {
+          if ( cd->remain )                   // Yes, real chunk?
+          {
+            cd->state = CH_DATA ;             // Yes, payload follows
+          }
+          else
+          {
+            cd->state = CH_TRAILER ;          // Last chunk, trailers follow
+            cd->linelen = 0 ;
+          }
+        }
+        break ;
+      case CH_DATAEND :                       // CRLF after payload
+        if ( b == '\n' )
+        {
+          cd->state = CH_SIZE ;               // Next chunksize expected
+          cd->remain = 0 ;
+          cd->digits = 0 ;
+          cd->sizeend = false ;
+        }
+        break ;
+      case CH_TRAILER :                       // Trailer lines, end with empty line
+        if ( b == '\n' )
+        {
+          if ( cd->linelen == 0 )             // Empty line?
+          {
+            cd->state = CH_DONE ;             // Yes, end of body
+          }
+          cd->linelen = 0 ;
+        }
+        else if ( b != '\r' )
+        {
+          cd->linelen++ ;                     // Count characters in trailer line
+        }
+        break ;
+      default :                               // CH_DONE or CH_ERROR, ignore the rest
+        break ;
+    }
+  }
+  return i ;
+}
@@ -90,6 +90,37 @@ char* analyzeCmd ( const char* str )
 //   mqtttopic  = mytopic                   // Set MQTT topic to subscribe to *)           *
 //   mqttpubtopic = mypubtopic              // Set MQTT topic to publish to *)             *
 //   status                                 // Show current URL to play                    *
+//   buffersize = 400000                    // Size of ringbuffer in bytes *)              *
+//   prebuffer  = 1000                      // Initial prebuffer target in msec            *
+//   prebufstat                             // Show prebuffer target/first audio per preset*
+//   mpegstat                               // Show measured bitrate and sample rate       *
+//   ringstat                               // Show ringbuffer statistics                  *
+//   ringstat   = reset                     // Clear ringbuffer statistics                 *
+//   pipebench                              // Benchmark stream pipelines (player stopped) *
+//   sdistat                                // Show CPU time for feeding the VS1053        *
+//   sdistat    = reset                     // Clear SDI statistics                        *
+//   sdibatch   = 0                         // 1 = one SPI transaction per burst (default) *
+//   clockf     = 0x6000                    // SCI_CLOCKF of VS1053 *)                     *
+//   spiclock   = 4000000                   // SPI clock for VS1053 in Hz *)               *
+//   vscalibrate                            // Find and save fastest clocks (stopped)      *
+//   vsbench                                // Measure SDI/SCI throughput (player stopped) *
+//   fastzap    = 0                         // 1 = fast station switch (default)           *
+//   zapstat                                // Show station switch latency                 *
+//   zapstat    = reset                     // Clear station switch statistics             *
+//   decstat                                // Show decoder status and stream health       *
+//   decstat    = reset                     // Clear stream health statistics              *
+//   halstat                                // Show statistics of VS1053 HAL (simulation)  *
+//   halstat    = reset                     // Clear HAL statistics                        *
+//   scistat                                // Show SCI transactions per second            *
+//   scistat    = reset                     // Clear SCI statistics                        *
+//   scicache   = 0                         // 1 = cache/queue SCI writes (default)        *
+//   connstat                               // Show times of last stream connection        *
+//   connstat   = reset                     // Clear connection statistics                 *
+//   netrx      = 0                         // 1 = stream read by receive task (default)   *
+//   rxstat                                 // Show receive throughput and CPU share       *
+//   rxstat     = reset                     // Clear receive statistics                    *
+//   feedstat                               // Show DREQ to feed latency of feeder task    *
+//   feedstat   = reset                     // Clear feeder statistics                     *
 //   testfile   = <file on SPIFFS>          // Test SPIFFS reads for debugging purpose     *
 //   test                                   // For test purposes                           *
 //   debug      = 0 or 1                    // Switch debugging on or off                  *
@@ -236,22 +267,29 @@ char* analyzeCmd ( const char* par, const char* val )
     }
     else
     {
-      sprintf ( reply, "%s - %s", icyname.c_str(),
-                icystreamtitle.c_str() ) ;            // Streamtitle from metadata
+      sprintf ( reply, "%s - %s", streamhdr.icyname,
+                icystreamtitle ) ;                    // Streamtitle from metadata
     }
   }
   else if ( argument.startsWith ( "reset" ) )         // Reset request
   {
     resetreq = true ;                                 // Reset all
   }
+  else if ( argument == "pipebench" )                 // Benchmark command?
+  {
+    pipebenchreq = true ;                             // Yes, do it in main loop
+    strcpy ( reply, "Benchmark started, see debug output" ) ;
+  }
   else if ( argument == "testfile" )                  // Testfile command?
   {
     testfilename = value ;                            // Yes, set file to test accordingly
   }
   else if ( argument == "test" )                      // Test command
   {
-    sprintf ( reply, "Free memory is %d, ringbuf %d, stream %d",
-              system_get_free_heap_size(), rcount, mp3client->available() ) ;
+    sprintf ( reply, "Free memory is %u, ringbuf %u of %u (requested %u, %s), stream %d",
+              system_get_free_heap_size(), ringavail(), ringbfsiz,
+              ini_block.buffersize, ringpsram ? "PSRAM" : "internal RAM",
+              mp3client ? mp3client->available() : 0 ) ;
   }
   // Commands for bass/treble control
   else if ( argument.startsWith ( "tone" ) )          // Tone command
@@ -304,6 +342,143 @@ char* analyzeCmd ( const char* par, const char* val )
       ini_block.mqtttopic = value.c_str() ;           // Yes, set broker topic accordingly
     }
   }
+  else if ( argument == "buffersize" )                // Size of ringbuffer?
+  {
+    ini_block.buffersize = ivalue ;                   // Yes, will be used at restart
+    sprintf ( reply, "Buffer size set to %d. Save and restart to have effect",
+              ivalue ) ;
+  }
+  else if ( argument == "prebuffer" )                 // Initial prebuffer target?
+  {
+    ini_block.prebuffer = ivalue ;                    // Yes, set for presets not played yet
+    sprintf ( reply, "Prebuffer target set to %d msec", ivalue ) ;
+  }
+  else if ( argument == "prebufstat" )                // Prebuffer statistics?
+  {
+    prebufinfo ( reply, sizeof(reply) ) ;             // Yes, show per preset
+  }
+  else if ( argument == "mpegstat" )                  // MPEG frame statistics?
+  {
+    mpeginfo ( reply, sizeof(reply) ) ;               // Yes, show results of analyzer
+  }
+  else if ( argument == "sdistat" )                   // SDI statistics?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      vs1053player.sdiReset() ;                       // Yes, start again
+    }
+    vs1053player.sdiInfo ( reply, sizeof(reply) ) ;   // Show the statistics
+  }
+  else if ( argument == "clockf" )                    // Clock setting of VS1053?
+  {
+    vs1053player.clockf = strtol ( value.c_str(), NULL, 0 ) ; // Yes, used at restart
+    sprintf ( reply, "SCI_CLOCKF set to %04X. Save and restart to have effect",
+              vs1053player.clockf ) ;
+  }
+  else if ( argument == "spiclock" )                  // SPI clock for VS1053?
+  {
+    vs1053player.spiclock = ivalue ;                  // Yes, used at restart
+    sprintf ( reply, "SPI clock set to %d Hz. Save and restart to have effect",
+              ivalue ) ;
+  }
+  else if ( argument == "vscalibrate" )               // Clock calibration?
+  {
+    vscalreq = true ;                                 // Yes, do it in main loop
+    strcpy ( reply, "Calibration started, see debug output" ) ;
+  }
+  else if ( argument == "vsbench" )                   // VS1053 benchmark?
+  {
+    vsbenchreq = true ;                               // Yes, do it in main loop
+    strcpy ( reply, "Benchmark started, see debug output" ) ;
+  }
+  else if ( argument == "fastzap" )                   // Fast station switch?
+  {
+    fastzap = ( ivalue != 0 ) ;                       // Yes, set mode
+    zapreset() ;                                      // Measure again
+    sprintf ( reply, "Fast station switch %s", ivalue ? "on" : "off" ) ;
+  }
+  else if ( argument == "zapstat" )                   // Switch statistics?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      zapreset() ;                                    // Yes, start again
+    }
+    zapinfo ( reply, sizeof(reply) ) ;                // Show the statistics
+  }
+  else if ( argument == "decstat" )                   // Decoder status?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      healthreset() ;                                 // Yes, start again
+    }
+    healthinfo ( reply, sizeof(reply) ) ;             // Show status and statistics
+  }
+  else if ( argument == "halstat" )                   // HAL statistics?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      vs1053player.halReset() ;                       // Yes, start again
+    }
+    vs1053player.halInfo ( reply, sizeof(reply) ) ;   // Show the statistics
+  }
+  else if ( argument == "scistat" )                   // SCI statistics?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      vs1053player.sciReset() ;                       // Yes, start again
+    }
+    vs1053player.sciInfo ( reply, sizeof(reply) ) ;   // Show the statistics
+  }
+  else if ( argument == "scicache" )                  // Cache SCI writes?
+  {
+    vs1053player.scicache = ( ivalue != 0 ) ;         // Yes, set mode
+    vs1053player.sciReset() ;                         // Measure again
+    sprintf ( reply, "SCI cache %s", ivalue ? "on" : "off" ) ;
+  }
+  else if ( argument == "connstat" )                  // Connection statistics?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      connreset() ;                                   // Yes, start again
+    }
+    conninfo ( reply, sizeof(reply) ) ;               // Show the statistics
+  }
+  else if ( argument == "netrx" )                     // Receive task on/off?
+  {
+    netrx = ( ivalue != 0 ) ;                         // Yes, set mode
+    rxreset() ;                                       // Measure again
+    sprintf ( reply, "Stream read by %s", ivalue ? "receive task" : "loop()" ) ;
+  }
+  else if ( argument == "rxstat" )                    // Receive statistics?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      rxreset() ;                                     // Yes, start again
+    }
+    rxinfo ( reply, sizeof(reply) ) ;                 // Show the statistics
+  }
+  else if ( argument == "feedstat" )                  // Feeder statistics?
+  {
+    if ( value == "reset" )                           // Reset requested?
+    {
+      feedreset() ;                                   // Yes, start again
+    }
+    feedinfo ( reply, sizeof(reply) ) ;               // Show the statistics
+  }
+  else if ( argument == "sdibatch" )                  // Batch SDI transfers?
+  {
+    vs1053player.sdibatch = ( ivalue != 0 ) ;         // Yes, set mode
+    vs1053player.sdiReset() ;                         // Measure again
+    sprintf ( reply, "SDI batching %s", ivalue ? "on" : "off" ) ;
+  }
+  else if ( argument == "ringstat" )                  // Ringbuffer statistics?
+  {
+    if ( value == "reset" )                           // Yes, clear request?
+    {
+      ringstatreset() ;                               // Yes, start again
+    }
+    ringstatinfo ( reply, sizeof(reply) ) ;           // Show the statistics
+  }
   else if ( argument == "debug" )                     // debug on/off request?
   {
     DEBUG = ivalue ;                                  // Yes, set flag accordingly
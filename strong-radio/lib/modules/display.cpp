@@ -1,4 +1,43 @@
 
+//******************************************************************************************
+//                                  T F T L O C K                                          *
+//******************************************************************************************
+// The TFT shares the SPI bus with the VS1053.  The feeder keeps SDI open for a whole      *
+// burst while it holds feedlock, sdiRelease() only closes SDI for the task that opened    *
+// it.  So the display takes feedlock first, unless it is drawn by the task that holds it  *
+// already (the feeder showing a title from metadata, or loop() while stopping).  Returns  *
+// true if feedlock was taken here, pass it to tftunlock().                                *
+//******************************************************************************************
+#if defined ( USETFT )
+bool tftlock()
+{
+  bool take ;                                   // feedlock not held by this task
+
+  take = ( xSemaphoreGetMutexHolder ( feedlock ) != xTaskGetCurrentTaskHandle() ) ;
+  if ( take )
+  {
+    xSemaphoreTake ( feedlock, portMAX_DELAY ) ; // No burst of the feeder now
+  }
+  vs1053player.sdiRelease() ;                   // End a burst of this task
+  return take ;
+}
+
+
+//******************************************************************************************
+//                                 T F T U N L O C K                                       *
+//******************************************************************************************
+// Free the SPI bus after drawing.                                                         *
+//******************************************************************************************
+void tftunlock ( bool taken )
+{
+  if ( taken )
+  {
+    xSemaphoreGive ( feedlock ) ;
+  }
+}
+#endif
+
+
 //******************************************************************************************
 //                              D I S P L A Y V O L U M E                                  *
 //******************************************************************************************
@@ -9,13 +48,16 @@ void displayvolume()
 #if defined ( USETFT )
   static uint8_t oldvol = 0 ;                        // Previous volume
   uint8_t        pos ;                               // Positon of volume indicator
+  bool           taken ;                             // feedlock taken for the TFT
 
   if ( vs1053player.getVolume() != oldvol )
   {
     pos = map ( vs1053player.getVolume(), 0, 100, 0, 160 ) ;
   }
+  taken = tftlock() ;                                // TFT shares the SPI bus
   tft.fillRect ( 0, 126, pos, 2, RED ) ;             // Paint red part
   tft.fillRect ( pos, 126, 160 - pos, 2, GREEN ) ;   // Paint green part
+  tftunlock ( taken ) ;
 #endif
 }
 
@@ -29,13 +71,16 @@ void displayvolume()
 void displayinfo ( const char* str, uint16_t pos, uint16_t height, uint16_t color )
 {
   char buf [ strlen ( str ) + 1 ] ;             // Need some buffer space
+  bool taken ;                                  // feedlock taken for the TFT
   
   strcpy ( buf, str ) ;                         // Make a local copy of the string
   utf8ascii ( buf ) ;                           // Convert possible UTF8
+  taken = tftlock() ;                           // TFT shares the SPI bus
   tft.fillRect ( 0, pos, 160, height, BLACK ) ; // Clear the space for new info
   tft.setTextColor ( color ) ;                  // Set the requested color
   tft.setCursor ( 0, pos ) ;                    // Prepare to show the info
   tft.println ( buf ) ;                         // Show the string
+  tftunlock ( taken ) ;
 }
 #else
 #define displayinfo(a,b,c,d)                    // Empty declaration
@@ -45,46 +90,19 @@ void displayinfo ( const char* str, uint16_t pos, uint16_t height, uint16_t colo
 //******************************************************************************************
 //                        S H O W S T R E A M T I T L E                                    *
 //******************************************************************************************
-// Show artist and songtitle if present in metadata.                                       *
-// Show always if full=true.                                                               *
+// Show artist and songtitle.  The title is from metadata, a playlist or a filename.       *
 //******************************************************************************************
-void showstreamtitle ( const char *ml, bool full )
+void showstreamtitle ( const char *ml )
 {
   char*             p1 ;
   char*             p2 ;
-  char              streamtitle[150] ;           // Streamtitle from metadata
+  char              streamtitle[150] ;           // Streamtitle for display
 
-  if ( strstr ( ml, "StreamTitle=" ) )
-  {
-    dbgprint ( "Streamtitle found, %d bytes", strlen ( ml ) ) ;
-    dbgprint ( ml ) ;
-    p1 = (char*)ml + 12 ;                       // Begin of artist and title
-    if ( ( p2 = strstr ( ml, ";" ) ) )          // Search for end of title
-    {
-      if ( *p1 == '\'' )                        // Surrounded by quotes?
-      {
-        p1++ ;
-        p2-- ;
-      }
-      *p2 = '\0' ;                              // Strip the rest of the line
-    }
-    // Save last part of string as streamtitle.  Protect against buffer overflow
-    strncpy ( streamtitle, p1, sizeof ( streamtitle ) ) ;
-    streamtitle[sizeof ( streamtitle ) - 1] = '\0' ;
-  }
-  else if ( full )
-  {
-    // Info probably from playlist
-    strncpy ( streamtitle, ml, sizeof ( streamtitle ) ) ;
-    streamtitle[sizeof ( streamtitle ) - 1] = '\0' ;
-  }
-  else
-  {
-    icystreamtitle = "" ;                       // Unknown type
-    return ;                                    // Do not show
-  }
+  // Copy the title for display.  Protect against buffer overflow
+  strncpy ( streamtitle, ml, sizeof ( streamtitle ) ) ;
+  streamtitle[sizeof ( streamtitle ) - 1] = '\0' ;
   // Save for status request from browser ;
-  icystreamtitle = streamtitle ;
+  strcpy ( icystreamtitle, streamtitle ) ;
   if ( ( p1 = strstr ( streamtitle, " - " ) ) ) // look for artist/title separator
   {
     *p1++ = '\n' ;                              // Found: replace 3 characters by newline
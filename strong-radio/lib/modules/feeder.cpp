@@ -0,0 +1,187 @@
+//******************************************************************************************
+// Feeder task for the VS1053.                                                             *
+//******************************************************************************************
+// While a stream is playing (DATA or METADATA), the VS1053 is fed by a separate task      *
+// with a higher priority than loop().  A rising edge on DREQ (the FIFO has room for at    *
+// least 32 bytes) wakes the task by an interrupt.  So the decoder is fed even if loop()   *
+// is busy with the web interface, SPIFFS or the display.  The task also wakes every       *
+// FEEDTIMEOUT msec, in case an edge was missed or playback was held by the prebuffer.     *
+// The simulated VS1053 (VS1053_SIM) has no DREQ line, then the task only runs on timeout. *
+// In other modes (header, playlist) loop() handles the data from the ringbuffer itself.   *
+// The ringbuffer is filled by loop() and emptied here, see ringbuffer.cpp.                *
+// The state of the stream is shared with loop().  loop() takes feedlock whenever it       *
+// changes that state while playing, like stopping or switching to the next entry.         *
+// The latency from the DREQ edge to the first byte sent is measured, see "feedstat".      *
+// Register writes queued by the VS1053 driver (volume, tone) are written after a burst.   *
+//******************************************************************************************
+#define FEEDPRIO       3                       // Priority of task, above loop()
+#define FEEDSTACK      8192                    // Stack size, includes display and plugin
+#define FEEDTIMEOUT    10                      // Wake up at least every 10 msec
+#define FEEDCORE       1                       // Same core as loop()
+
+TaskHandle_t          feedhandle = NULL ;      // Handle of the feeder task
+SemaphoreHandle_t     feedlock = NULL ;        // Protects the stream state
+volatile uint32_t     dreqstamp = 0 ;          // Time of last DREQ edge, 0 if handled
+uint32_t              feedwakes ;              // Wake ups by DREQ edge
+uint32_t              feedtimeouts ;           // Wake ups by timeout
+uint32_t              feedmaxlat ;             // Worst latency DREQ to feed in usec
+uint64_t              feedsumlat ;             // Sum of latencies
+uint32_t              feedcntlat ;             // Number of latencies measured
+
+//******************************************************************************************
+//                                  D R E Q I S R                                          *
+//******************************************************************************************
+// Interrupt on rising edge of DREQ.  Wakes up the feeder task.                            *
+//******************************************************************************************
+void IRAM_ATTR dreqisr()
+{
+  BaseType_t woken = pdFALSE ;                 // Higher priority task woken?
+
+  if ( dreqstamp == 0 )                        // Keep first edge until handled
+  {
+    dreqstamp = micros() | 1 ;                 // Never 0
+  }
+  vTaskNotifyGiveFromISR ( feedhandle, &woken ) ;
+  if ( woken )
+  {
+    portYIELD_FROM_ISR() ;                     // Switch to feeder at once
+  }
+}
+
+
+//******************************************************************************************
+//                                F E E D V S 1 0 5 3                                      *
+//******************************************************************************************
+// Send data from the ringbuffer to the VS1053 as long as DREQ allows.  DREQ guarantees    *
+// room for at least 32 bytes.                                                             *
+//******************************************************************************************
+void feedvs1053()
+{
+  uint8_t*  p ;                                // Span in ringbuffer
+  uint32_t  n ;                                // Length of span
+
+  xSemaphoreTake ( feedlock, portMAX_DELAY ) ;
+  vs1053player.sdiBegin() ;                    // One SPI transaction for all chunks
+  while ( prebufready() && vs1053player.data_request() &&
+          ( n = ringrspan ( &p ) ) )
+  {
+    if ( n > 32 )                              // Not more than 32 bytes per DREQ
+    {
+      n = 32 ;
+    }
+    n = prefetchlimit ( n ) ;                  // Not beyond end of entry
+    n = streamfunc ( p, n ) ;                  // Handle (part of) the span as a block
+    ringrcommit ( n ) ;                        // Release them in the ringbuffer
+    prefetchused ( n ) ;                       // Next entry if this one is done
+  }
+  vs1053player.sdiEnd() ;                      // Free the SPI bus
+  vs1053player.sciFlush() ;                    // Queued register writes between bursts
+  xSemaphoreGive ( feedlock ) ;
+}
+
+
+//******************************************************************************************
+//                                 F E E D L A T E N C Y                                   *
+//******************************************************************************************
+// Account the time from the last DREQ edge until now.                                     *
+//******************************************************************************************
+void feedlatency()
+{
+  uint32_t stamp = dreqstamp ;                 // Time of edge
+  uint32_t lat ;                               // Latency in usec
+
+  if ( stamp == 0 )                            // Edge seen?
+  {
+    return ;
+  }
+  dreqstamp = 0 ;                              // Yes, ready for next
+  if ( !ringavail() || !prebufready() )        // Data to send?
+  {
+    return ;                                   // No, latency is not ours
+  }
+  lat = micros() - stamp ;
+  if ( lat > feedmaxlat )
+  {
+    feedmaxlat = lat ;                         // New worst case
+  }
+  feedsumlat += lat ;
+  feedcntlat++ ;
+}
+
+
+//******************************************************************************************
+//                                  F E E D T A S K                                        *
+//******************************************************************************************
+// The feeder task.  Waits for DREQ and feeds the VS1053 while a stream is playing.        *
+//******************************************************************************************
+void feedtask ( void* parameter )
+{
+  while ( true )
+  {
+    if ( ulTaskNotifyTake ( pdTRUE, pdMS_TO_TICKS ( FEEDTIMEOUT ) ) )
+    {
+      feedwakes++ ;                            // Woken by DREQ
+    }
+    else
+    {
+      feedtimeouts++ ;                         // Woken by timeout
+    }
+    if ( datamode & ( DATA | METADATA ) )      // Playing?
+    {
+      xSemaphoreTake ( feedlock, portMAX_DELAY ) ;
+      feedlatency() ;                          // Yes, measure
+      xSemaphoreGive ( feedlock ) ;
+      feedvs1053() ;                           // and feed the decoder
+    }
+    else
+    {
+      dreqstamp = 0 ;                          // Not our job now
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                 F E E D S T A R T                                       *
+//******************************************************************************************
+// Create the feeder task and attach the DREQ interrupt.  Called once from setup().        *
+//******************************************************************************************
+void feedstart()
+{
+  feedlock = xSemaphoreCreateMutex() ;
+  xTaskCreatePinnedToCore ( feedtask, "feeder", FEEDSTACK, NULL,
+                            FEEDPRIO, &feedhandle, FEEDCORE ) ;
+#if !defined ( VS1053_SIM )
+  attachInterrupt ( VS1053_DREQ, dreqisr, RISING ) ;
+#endif
+  dbgprint ( "Feeder task started" ) ;
+}
+
+
+//******************************************************************************************
+//                                 F E E D R E S E T                                       *
+//******************************************************************************************
+// Clear the statistics of the feeder.                                                     *
+//******************************************************************************************
+void feedreset()
+{
+  feedwakes = 0 ;
+  feedtimeouts = 0 ;
+  feedmaxlat = 0 ;
+  feedsumlat = 0 ;
+  feedcntlat = 0 ;
+}
+
+
+//******************************************************************************************
+//                                  F E E D I N F O                                        *
+//******************************************************************************************
+// Format the statistics of the feeder for the "feedstat" command.                         *
+//******************************************************************************************
+void feedinfo ( char* reply, size_t len )
+{
+  snprintf ( reply, len, "Feeder: %u DREQ wakeups, %u timeouts, latency DREQ to feed "
+             "max %u usec, average %u usec",
+             feedwakes, feedtimeouts, feedmaxlat,
+             feedcntlat ? (uint32_t)( feedsumlat / feedcntlat ) : 0 ) ;
+}
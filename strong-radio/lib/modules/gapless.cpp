@@ -0,0 +1,222 @@
+//******************************************************************************************
+// Gapless transitions between playlist entries.                                           *
+//******************************************************************************************
+// As soon as the server of the current entry has sent all of its data, the next entry of  *
+// the cached playlist is connected and its header is parsed.  The body of the next entry  *
+// is then read into the ringbuffer right behind the rest of the current entry.  When the  *
+// last byte of the current entry has been handled, the stream state is switched to the    *
+// next entry without stopping the VS1053, without emptying the ringbuffer and without     *
+// prebuffering.  The decoder is only restarted if the format changes, see sniffdata().    *
+// The segments of a HLS stream are played the same way, see hls.cpp.                      *
+//******************************************************************************************
+enum pfstate_t { PF_IDLE, PF_CONNECT, PF_HEADER,
+                 PF_BODY, PF_FAIL } ;          // States of the prefetch
+
+pfstate_t    pfstate = PF_IDLE ;               // State of the prefetch
+WiFiClient*  nextclient = NULL ;               // Connection to the next entry
+hostconn_t   nextconn ;                        // Connect in progress to the next entry
+uint32_t     pfhdrms ;                         // Start of wait for header
+httphdr_t    nexthdr ;                         // Header of the next entry
+int          pfnum ;                           // Playlist index of the next entry, 0 for HLS
+String       pftitle ;                         // Title of the next entry
+uint32_t     gapleft ;                         // Bytes of current entry left in ringbuffer
+
+//******************************************************************************************
+//                              P R E F E T C H S T O P                                    *
+//******************************************************************************************
+// Cancel a prefetch, if any.                                                              *
+//******************************************************************************************
+void prefetchstop()
+{
+  if ( nextclient )
+  {
+    nextclient->stop() ;
+    delete ( nextclient ) ;
+    nextclient = NULL ;
+  }
+  connabort ( &nextconn ) ;
+  pfstate = PF_IDLE ;
+}
+
+
+//******************************************************************************************
+//                              P R E F E T C H F A I L                                    *
+//******************************************************************************************
+// The next entry could not be started.  For a playlist the watchdog will handle it, for   *
+// HLS the next segment is tried.                                                          *
+//******************************************************************************************
+void prefetchfail()
+{
+  prefetchstop() ;
+  if ( !hlsactive )
+  {
+    pfstate = PF_FAIL ;                        // No more tries for this entry
+  }
+}
+
+
+//******************************************************************************************
+//                            G A P L E S S S W I T C H                                    *
+//******************************************************************************************
+// All bytes of the current entry have been handled.  Continue with the next entry.        *
+//******************************************************************************************
+void gaplessswitch()
+{
+  streamfmt_t prev = streamfmt ;               // Format of the current entry
+
+  dbgprint ( "Gapless switch to next entry" ) ;
+  memcpy ( &streamhdr, &nexthdr, sizeof(streamhdr) ) ;
+  if ( pfnum )                                 // Playlist entry?
+  {
+    playlist_num = pfnum ;                     // Yes, this is the current entry now
+  }
+  pfstate = PF_IDLE ;                          // Ready for the next prefetch
+  icymetainit ( &icymeta ) ;                   // No title yet
+  metaline = "" ;
+  streamfunc = handlebytes_ch ;                // Generic handling until format known
+  streamhdrend ( false ) ;                     // Take over header, keep decoder running
+  if ( pftitle.length() )
+  {
+    showstreamtitle ( pftitle.c_str() ) ;      // Show artist and title
+  }
+  sniffprev = prev ;                           // Restart decoder on format change
+}
+
+
+//******************************************************************************************
+//                             P R E F E T C H P O L L                                     *
+//******************************************************************************************
+// Called from loop().  Start the next entry of the playlist if the current one has been   *
+// received completely.  The header of the next entry is parsed here, the body is read by  *
+// loop() into the ringbuffer.                                                             *
+//******************************************************************************************
+void prefetchpoll()
+{
+  uint8_t b ;                                  // Byte of header
+  String  url ;                                // URL of next entry or segment
+
+  switch ( pfstate )
+  {
+    case PF_IDLE :
+      if ( !( datamode & ( DATA | METADATA ) ) ||  // Playing an entry or segment
+           localfile || sniffing ||
+           !rxended() )                        // and all data received?
+      {
+        return ;
+      }
+      if ( hlsactive )                         // HLS stream?
+      {
+        if ( !hlsnext ( &url ) )               // Yes, next segment known?
+        {
+          return ;                             // No, wait for playlist reload
+        }
+        pfnum = 0 ;                            // Not a playlist entry
+        pftitle = "" ;
+      }
+      else
+      {
+        if ( !plvalid || !playlist_num ||      // Entry of a cached playlist?
+             ( host != playlist ) )
+        {
+          return ;
+        }
+        pfnum = playlist_num + 1 ;
+        if ( !playlistentry ( pfnum, &url, &pftitle ) )
+        {
+          pfstate = PF_FAIL ;                  // End of playlist, normal stop
+          return ;
+        }
+      }
+      dbgprint ( "Prefetch %s", url.c_str() ) ;
+      hdrinit ( &nexthdr ) ;
+      pfstate = PF_CONNECT ;
+      if ( !connstart ( &nextconn, url.c_str(), hlsactive ? "" : CONNICY ) )
+      {
+        prefetchfail() ;
+      }
+      break ;
+    case PF_CONNECT :
+      switch ( connpoll ( &nextconn ) )
+      {
+        case CONN_DONE :
+          nextclient = conntake ( &nextconn ) ; // Connected, parse header now
+          pfhdrms = millis() ;
+          pfstate = PF_HEADER ;
+          break ;
+        case CONN_FAIL :
+          prefetchfail() ;
+          return ;
+        default :
+          return ;                             // Still connecting
+      }
+    // Fall through
+    case PF_HEADER :
+      while ( !nexthdr.done && nextclient->available() )
+      {
+        b = nextclient->read() ;
+        hdrparse ( &nexthdr, &b, 1 ) ;         // Header is short, byte by byte
+      }
+      if ( !nexthdr.done )
+      {
+        if ( !nextclient->connected() ||       // Header incomplete, server gone?
+             ( ( millis() - pfhdrms ) > CONNHEADERMS ) )
+        {
+          dbgprint ( "Prefetch failed, no header" ) ;
+          prefetchfail() ;
+        }
+        return ;
+      }
+      xSemaphoreTake ( feedlock, portMAX_DELAY ) ; // Feeder must not run now
+      gapleft = ringavail() ;                  // Rest of current entry
+      rxpause() ;                              // Receive task must not read now
+      mp3client->stop() ;
+      delete ( mp3client ) ;
+      mp3client = nextclient ;                 // Next entry is received now
+      nextclient = NULL ;
+      rxeof = false ;                          // Set again by the next read
+      rxresume() ;
+      pfstate = PF_BODY ;
+      if ( gapleft == 0 )                      // Current entry already played?
+      {
+        gaplessswitch() ;                      // Yes, switch at once
+      }
+      xSemaphoreGive ( feedlock ) ;
+      break ;
+    default :
+      break ;
+  }
+}
+
+
+//******************************************************************************************
+//                            P R E F E T C H L I M I T                                    *
+//******************************************************************************************
+// Limit a span from the ringbuffer to the rest of the current entry.                      *
+//******************************************************************************************
+uint32_t prefetchlimit ( uint32_t n )
+{
+  if ( ( pfstate == PF_BODY ) && ( n > gapleft ) )
+  {
+    return gapleft ;
+  }
+  return n ;
+}
+
+
+//******************************************************************************************
+//                              P R E F E T C H U S E D                                    *
+//******************************************************************************************
+// Account n bytes handled from the ringbuffer.  Switch if the current entry is finished.  *
+//******************************************************************************************
+void prefetchused ( uint32_t n )
+{
+  if ( pfstate != PF_BODY )
+  {
+    return ;
+  }
+  gapleft -= n ;
+  if ( gapleft == 0 )                          // Current entry done?
+  {
+    gaplessswitch() ;                          // Yes, continue with the next
+  }
+}
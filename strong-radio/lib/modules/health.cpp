@@ -0,0 +1,189 @@
+//******************************************************************************************
+// Stream health, based on the status of the decoder.                                      *
+//******************************************************************************************
+// Every HEALTHMS msec the decoder status is read (decode time, HDAT0/1, sample rate and   *
+// byte rate, see VS1053::decodeStatus()).  A stream is unhealthy if:                      *
+// - the VS1053 accepted no data for HEALTHSTALL msec (network or decoder stall), or no    *
+//   data was received for HEALTHSTALL msec while the prebuffer holds playback;            *
+// - the decode time did not advance for HEALTHDECODE msec while data was accepted (data   *
+//   is not audio).  The decode time has a resolution of 1 second;                         *
+// - HEALTHERRORS polls in a row show no valid format while data is accepted.              *
+// The VS1053 has no error counters, so polls without a valid format are counted as        *
+// errors.  The first failure reconnects to the same station, another failure within       *
+// HEALTHRETRY msec (or any failure in a playlist) selects the next preset or entry.       *
+// timer10sec() still checks the input as a fallback.                                      *
+// The status is read with feedlock held, so the SCI reads do not mix with the SDI bursts  *
+// and the queued register writes of the feeder task.                                      *
+//******************************************************************************************
+#define HEALTHMS       250                     // Poll interval in msec
+#define HEALTHSTALL    1000                    // No progress of SDI data
+#define HEALTHDECODE   2500                    // No progress of decode time
+#define HEALTHERRORS   4                       // Polls in a row without format
+#define HEALTHRETRY    30000                   // Second failure means next station
+
+vs1053status_t health ;                        // Last status of the decoder
+bool         healthvalid = false ;             // Reference values are set
+uint32_t     healthpolled ;                    // Time of last poll
+uint32_t     healthsdi ;                       // SDI bytes at last progress
+uint32_t     healthsdims ;                     // Time of last SDI progress
+uint32_t     healthrx ;                        // Bytes received at last progress
+uint32_t     healthrxms ;                      // Time of last input progress
+uint16_t     healthdectime ;                   // Decode time at last progress
+uint32_t     healthdecms ;                     // Time of last decode progress
+uint8_t      healthbad ;                       // Polls in a row without format
+uint32_t     healthfail = 0 ;                  // Time of last failure
+uint32_t     healthpolls ;                     // Statistics: polls while playing
+uint32_t     healtherrs ;                      // Polls without valid format
+uint32_t     healthstalls ;                    // Data stalls
+uint32_t     healthdecstalls ;                 // Decode time stalls
+uint32_t     healthbursts ;                    // Error bursts
+
+//******************************************************************************************
+//                               H E A L T H A C T I O N                                   *
+//******************************************************************************************
+// The stream is unhealthy.  Reconnect or try the next station.                            *
+//******************************************************************************************
+void healthaction ( const char* why )
+{
+  uint32_t now = millis() ;
+
+  healthvalid = false ;                        // Start again after the action
+  datamode = STOPREQD ;                        // Stop player
+  if ( playlist_num ||                         // Playlist or failed again?
+       ( healthfail && ( ( now - healthfail ) < HEALTHRETRY ) ) )
+  {
+    ini_block.newpreset++ ;                    // Yes, try next channel
+    dbgprint ( "Stream health: %s, trying other station/file...", why ) ;
+  }
+  else
+  {
+    hostreq = true ;                           // No, connect again
+    dbgprint ( "Stream health: %s, reconnecting...", why ) ;
+  }
+  healthfail = now ;
+}
+
+
+//******************************************************************************************
+//                                 H E A L T H P O L L                                     *
+//******************************************************************************************
+// Called from loop().  Read the status of the decoder and check the progress.             *
+//******************************************************************************************
+void healthpoll()
+{
+  uint32_t now = millis() ;
+  uint32_t rx = totalcount + ringavail() ;     // Bytes received so far
+
+  if ( ( now - healthpolled ) < HEALTHMS )     // Time for a poll?
+  {
+    return ;
+  }
+  healthpolled = now ;
+  if ( !( datamode & ( DATA | METADATA ) ) ||  // Only while playing a stream
+       localfile || sniffing )
+  {
+    healthvalid = false ;
+    return ;
+  }
+  if ( !healthvalid )                          // Start of playing?
+  {
+    healthvalid = true ;                       // Yes, set references
+    healthbad = 0 ;
+    healthsdi = vs1053player.sdiTotal() ;
+    healthrx = rx ;
+    healthdectime = 0xFFFF ;                   // Decode time is set by next poll
+    healthsdims = now ;
+    healthrxms = now ;
+    healthdecms = now ;
+    return ;
+  }
+  if ( rx != healthrx )                        // Data received?
+  {
+    healthrx = rx ;
+    healthrxms = now ;
+  }
+  if ( prebuffering )                          // Playback held?
+  {
+    healthsdims = now ;                        // Yes, decoder is not fed
+    healthdecms = now ;
+    healthbad = 0 ;
+    if ( !hlsactive &&                         // HLS waits for segments itself
+         ( ( now - healthrxms ) > HEALTHSTALL ) ) // Only input can be checked
+    {
+      healthstalls++ ;
+      healthaction ( "no input" ) ;
+    }
+    return ;
+  }
+  xSemaphoreTake ( feedlock, portMAX_DELAY ) ; // Feeder owns the VS1053 while playing
+  vs1053player.decodeStatus ( &health ) ;
+  xSemaphoreGive ( feedlock ) ;
+  healthpolls++ ;
+  if ( health.sditotal == healthsdi )          // Data accepted by decoder?
+  {
+    if ( ( now - healthsdims ) > HEALTHSTALL ) // No, for a long time?
+    {
+      healthstalls++ ;
+      healthaction ( "data stalled" ) ;
+    }
+    return ;
+  }
+  healthsdi = health.sditotal ;                // Data flows
+  healthsdims = now ;
+  if ( health.decodetime != healthdectime )    // Decoding progress?
+  {
+    healthdectime = health.decodetime ;
+    healthdecms = now ;
+  }
+  if ( health.hdat1 == 0 )                     // Valid format?
+  {
+    healtherrs++ ;                             // No, count as error
+    healthbad++ ;
+  }
+  else
+  {
+    healthbad = 0 ;
+  }
+  if ( healthbad >= HEALTHERRORS )
+  {
+    healthbursts++ ;
+    healthaction ( "no valid format" ) ;
+  }
+  else if ( ( now - healthdecms ) > HEALTHDECODE )
+  {
+    healthdecstalls++ ;
+    healthaction ( "decoding stalled" ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                 H E A L T H R E S E T                                   *
+//******************************************************************************************
+// Clear the statistics of the health check.                                               *
+//******************************************************************************************
+void healthreset()
+{
+  healthpolls = 0 ;
+  healtherrs = 0 ;
+  healthstalls = 0 ;
+  healthdecstalls = 0 ;
+  healthbursts = 0 ;
+}
+
+
+//******************************************************************************************
+//                                  H E A L T H I N F O                                    *
+//******************************************************************************************
+// Format the last decoder status and the statistics for the "decstat" command.            *
+//******************************************************************************************
+void healthinfo ( char* reply, size_t len )
+{
+  snprintf ( reply, len, "Decoder: %d kb/s, %d Hz %s, decoded %d sec, HDAT1 %04X, "
+             "HDAT0 %04X, errors %d of %d polls, %d stalls, %d decode stalls, "
+             "%d error bursts",
+             health.byterate * 8 / 1000, health.audata & 0xFFFE,
+             ( health.audata & 1 ) ? "stereo" : "mono", health.decodetime,
+             health.hdat1, health.hdat0, healtherrs, healthpolls, healthstalls,
+             healthdecstalls, healthbursts ) ;
+}
@@ -0,0 +1,589 @@
+//******************************************************************************************
+// HLS (HTTP Live Streaming) client.                                                       *
+//******************************************************************************************
+// A host ending in ".m3u8" is a HLS playlist.  A master playlist lists variants of the    *
+// stream with their bandwidth, a media playlist lists the segments.  The playlists are    *
+// read in the background by hlspoll(), line by line, without blocking loop().             *
+// The segments are played one after the other with the gapless prefetch, see gapless.cpp: *
+// the next segment is connected as soon as the current one has been received, its data    *
+// follows the current segment in the ringbuffer.  Segments can be raw ADTS/MP3 or         *
+// MPEG-TS, see tsdemux.cpp.                                                               *
+// A live media playlist is reloaded every target duration (half of it if nothing new was  *
+// found).  The throughput of the segment downloads is measured, the variant with the      *
+// highest bandwidth below 3/4 of the throughput is used.  The first variant is the one    *
+// with the lowest bandwidth.                                                              *
+// Only a few segment URLs are kept.  At the start of a live stream the oldest are         *
+// dropped, so playback starts near the live edge.  Segments that do not fit in the queue  *
+// otherwise are picked up at the next reload.                                             *
+// Playlists and segments are requested without "Icy-MetaData:1", a HLS server sends no    *
+// metadata blocks.  A playlist may come with chunked transfer encoding.                   *
+// Encrypted streams and https are not supported.                                          *
+//******************************************************************************************
+#define HLSURLSIZ      160                     // Max length of an URL
+#define HLSMAXSEG      4                       // Max segments in queue
+#define HLSMAXVAR      4                       // Max variants from master playlist
+#define HLSTIMEOUT     10000                   // Max time to read a playlist in msec
+#define HLSMETERMS     2000                    // Measure throughput over 2 seconds
+
+enum hlsstate_t { HLS_IDLE, HLS_CONNECT, HLS_HEADER,
+                  HLS_BODY } ;                 // States of the playlist reader
+
+bool         hlsactive = false ;               // Playing a HLS stream
+hlsstate_t   hlsstate = HLS_IDLE ;             // State of the playlist reader
+WiFiClient*  hlsclient = NULL ;                // Connection for the playlist
+hostconn_t   hlsconn ;                         // Connect in progress for the playlist
+httphdr_t    hlshdr ;                          // Header of the playlist
+chunkdec_t   hlschunk ;                        // Chunk decoder for the playlist
+char         hlsbase[HLSURLSIZ] ;              // URL of the playlist being read
+char         hlsmedia[HLSURLSIZ] ;             // URL of the media playlist
+char         hlsline[256] ;                    // Line of the playlist
+uint16_t     hlslinelen ;                      // Length of hlsline
+uint32_t     hlsstartms ;                      // Start time of reading the playlist
+uint32_t     hlsloadms ;                       // Time for reload, 0 if none
+char         hlsvarurl[HLSMAXVAR][HLSURLSIZ] ; // URLs of the variants
+uint32_t     hlsvarbw[HLSMAXVAR] ;             // Bandwidth of the variants
+int          hlsnvar ;                         // Number of variants
+int          hlsvar ;                          // Variant in use
+int32_t      hlspendbw ;                       // Bandwidth for next URI, -1 if none
+char         hlsseg[HLSMAXSEG][HLSURLSIZ] ;    // Queue of segment URLs
+int          hlsseghead ;                      // Index of oldest segment in queue
+int          hlssegcnt ;                       // Number of segments in queue
+uint32_t     hlsseq ;                          // Media sequence of next new segment
+uint32_t     hlsparseseq ;                     // Media sequence of next URI in playlist
+bool         hlsfirst ;                        // First load of the media playlist
+int          hlsadded ;                        // New segments in this load
+uint16_t     hlstarget ;                       // Target duration in seconds
+bool         hlsendlist ;                      // No more segments will be added
+bool         hlsvod ;                          // Playlist is not live
+bool         hlsskipped ;                      // Segments did not fit in queue
+uint32_t     hlsbps ;                          // Measured throughput in bits/sec
+uint32_t     hlsmeterms ;                      // Time of last throughput sample
+uint32_t     hlsmeterrx ;                      // Bytes received at last sample
+uint32_t     hlsbusyms ;                       // Time spent receiving
+uint32_t     hlsrxbytes ;                      // Bytes received in that time
+
+//******************************************************************************************
+//                                H L S R E S O L V E                                      *
+//******************************************************************************************
+// Resolve URL ref relative to base.  Both without "http://".  Returns false if the URL    *
+// cannot be used.                                                                         *
+//******************************************************************************************
+bool hlsresolve ( const char* base, const char* ref, char* out, size_t siz )
+{
+  const char* q ;                              // End of path in base
+  const char* s ;                              // Last slash in path
+  size_t      len ;                            // Length of base part
+
+  if ( strncmp ( ref, "https://", 8 ) == 0 )
+  {
+    dbgprint ( "HLS: https not supported" ) ;
+    return false ;
+  }
+  if ( strncmp ( ref, "http://", 7 ) == 0 )    // Absolute URL?
+  {
+    len = 0 ;                                  // Yes, nothing from base
+    ref += 7 ;
+  }
+  else
+  {
+    q = strchr ( base, '?' ) ;                 // Strip query from base
+    len = q ? q - base : strlen ( base ) ;
+    if ( *ref == '/' )                         // Relative to host?
+    {
+      s = strchr ( base, '/' ) ;               // Yes, keep host part
+    }
+    else
+    {
+      s = NULL ;                               // Relative to directory
+      for ( q = base ; q < base + len ; q++ )
+      {
+        if ( *q == '/' )
+        {
+          s = q ;
+        }
+      }
+      if ( s )
+      {
+        s++ ;                                  // Keep the slash
+      }
+    }
+    if ( s && ( (size_t)( s - base ) < len ) )
+    {
+      len = s - base ;
+    }
+  }
+  if ( ( len + strlen ( ref ) + 2 ) > siz )
+  {
+    dbgprint ( "HLS: URL too long" ) ;
+    return false ;
+  }
+  memcpy ( out, base, len ) ;
+  out[len] = '\0' ;
+  if ( len && ( out[len - 1] != '/' ) && ( *ref != '/' ) )
+  {
+    strcat ( out, "/" ) ;                      // Base was only a host
+  }
+  strcat ( out, ref ) ;
+  return true ;
+}
+
+
+//******************************************************************************************
+//                                 H L S S T O P                                           *
+//******************************************************************************************
+// Stop the HLS client.                                                                    *
+//******************************************************************************************
+void hlsstop()
+{
+  if ( hlsclient )
+  {
+    hlsclient->stop() ;
+    delete ( hlsclient ) ;
+    hlsclient = NULL ;
+  }
+  connabort ( &hlsconn ) ;
+  hlsstate = HLS_IDLE ;
+  hlsactive = false ;
+}
+
+
+//******************************************************************************************
+//                                 H L S F E T C H                                         *
+//******************************************************************************************
+// Start reading a playlist.                                                               *
+//******************************************************************************************
+bool hlsfetch ( const char* url )
+{
+  if ( hlsbase != url )
+  {
+    strncpy ( hlsbase, url, sizeof(hlsbase) ) ;
+    hlsbase[sizeof(hlsbase) - 1] = '\0' ;
+  }
+  if ( hlsclient )                             // Client of previous playlist?
+  {
+    hlsclient->stop() ;                        // Yes, a new one is connected
+    delete ( hlsclient ) ;
+    hlsclient = NULL ;
+  }
+  hdrinit ( &hlshdr ) ;
+  chunkinit ( &hlschunk ) ;
+  hlslinelen = 0 ;
+  hlspendbw = -1 ;
+  hlsparseseq = 0 ;
+  hlsadded = 0 ;
+  hlsskipped = false ;
+  hlsstartms = millis() ;
+  if ( !connstart ( &hlsconn, hlsbase, "" ) )  // No metadata in HLS
+  {
+    hlsstate = HLS_IDLE ;
+    return false ;
+  }
+  hlsstate = HLS_CONNECT ;                     // hlspoll() waits for the connection
+  return true ;
+}
+
+
+//******************************************************************************************
+//                               H L S L O A D F A I L                                     *
+//******************************************************************************************
+// A playlist could not be read.  Stop if the media playlist was never loaded, otherwise   *
+// try again later.                                                                        *
+//******************************************************************************************
+void hlsloadfail()
+{
+  if ( hlsfirst )                              // Never loaded the media playlist?
+  {
+    hlsstop() ;                                // Yes, watchdog will stop the player
+    return ;
+  }
+  hlsstate = HLS_IDLE ;                        // No, reload again later
+  hlsloadms = millis() + 500 * hlstarget ;
+}
+
+
+//******************************************************************************************
+//                                H L S S T A R T                                          *
+//******************************************************************************************
+// Start playing a HLS stream.  The first segment is started by hlspoll().                 *
+//******************************************************************************************
+bool hlsstart ( const char* url )
+{
+  hlsstop() ;
+  dbgprint ( "HLS stream %s", url ) ;
+  displayinfo ( "   ** HLS stream **", 0, 20, WHITE ) ;
+  hlsnvar = 0 ;
+  hlsvar = 0 ;
+  hlsmedia[0] = '\0' ;
+  hlsseghead = 0 ;
+  hlssegcnt = 0 ;
+  hlsfirst = true ;
+  hlstarget = 10 ;                             // Default if not in playlist
+  hlsendlist = false ;
+  hlsvod = false ;
+  hlsloadms = 0 ;
+  hlsbps = 0 ;                                 // Throughput not known yet
+  hlsbusyms = 0 ;
+  hlsrxbytes = 0 ;
+  hlsmeterms = millis() ;
+  hlsmeterrx = 0 ;
+  hlsactive = hlsfetch ( url ) ;
+  return hlsactive ;
+}
+
+
+//******************************************************************************************
+//                                H L S C H O O S E                                        *
+//******************************************************************************************
+// Select the variant for the measured throughput.                                         *
+//******************************************************************************************
+int hlschoose()
+{
+  int i ;                                      // Loop control
+  int best = -1 ;                              // Best variant that fits
+  int low = 0 ;                                // Variant with lowest bandwidth
+
+  for ( i = 0 ; i < hlsnvar ; i++ )
+  {
+    if ( hlsvarbw[i] < hlsvarbw[low] )
+    {
+      low = i ;
+    }
+    if ( hlsbps && ( hlsvarbw[i] <= ( hlsbps / 4 * 3 ) ) &&
+         ( ( best < 0 ) || ( hlsvarbw[i] > hlsvarbw[best] ) ) )
+    {
+      best = i ;
+    }
+  }
+  return ( best < 0 ) ? low : best ;
+}
+
+
+//******************************************************************************************
+//                                H L S A D D S E G                                        *
+//******************************************************************************************
+// Add a segment URL to the queue.  The oldest is dropped if the queue is full.            *
+//******************************************************************************************
+void hlsaddseg ( const char* ref )
+{
+  int inx ;                                    // Index in queue
+
+  if ( hlssegcnt == HLSMAXSEG )                // Queue full?
+  {
+    hlsseghead = ( hlsseghead + 1 ) % HLSMAXSEG ; // Yes, drop oldest
+    hlssegcnt-- ;
+  }
+  inx = ( hlsseghead + hlssegcnt ) % HLSMAXSEG ;
+  if ( hlsresolve ( hlsbase, ref, hlsseg[inx], HLSURLSIZ ) )
+  {
+    hlssegcnt++ ;
+  }
+}
+
+
+//******************************************************************************************
+//                                 H L S N E X T                                           *
+//******************************************************************************************
+// Get the URL of the next segment.  Returns false if there is none yet.                   *
+//******************************************************************************************
+bool hlsnext ( String* url )
+{
+  if ( hlssegcnt == 0 )
+  {
+    return false ;
+  }
+  *url = hlsseg[hlsseghead] ;
+  hlsseghead = ( hlsseghead + 1 ) % HLSMAXSEG ;
+  hlssegcnt-- ;
+  return true ;
+}
+
+
+//******************************************************************************************
+//                             H L S P A R S E L I N E                                     *
+//******************************************************************************************
+// Handle a line of a master or media playlist.                                            *
+//******************************************************************************************
+void hlsparseline ( const char* line )
+{
+  const char* p ;                              // Pointer in line
+
+  if ( *line == '\0' )
+  {
+    return ;                                   // Empty line
+  }
+  if ( *line == '#' )                          // Tag or comment?
+  {
+    if ( strncmp ( line, "#EXT-X-STREAM-INF:", 18 ) == 0 )
+    {
+      p = strstr ( line, "BANDWIDTH=" ) ;      // Variant, URI on next line
+      hlspendbw = p ? atol ( p + 10 ) : 0 ;
+    }
+    else if ( strncmp ( line, "#EXT-X-TARGETDURATION:", 22 ) == 0 )
+    {
+      hlstarget = atoi ( line + 22 ) ;
+    }
+    else if ( strncmp ( line, "#EXT-X-MEDIA-SEQUENCE:", 22 ) == 0 )
+    {
+      hlsparseseq = strtoul ( line + 22, NULL, 10 ) ;
+    }
+    else if ( strncmp ( line, "#EXT-X-PLAYLIST-TYPE:VOD", 24 ) == 0 )
+    {
+      hlsvod = true ;                          // Play from the start
+    }
+    else if ( strncmp ( line, "#EXT-X-ENDLIST", 14 ) == 0 )
+    {
+      hlsendlist = true ;                      // Not live, no reload
+    }
+    else if ( ( strncmp ( line, "#EXT-X-KEY:", 11 ) == 0 ) &&
+              ( strstr ( line, "METHOD=NONE" ) == NULL ) )
+    {
+      dbgprint ( "HLS: encrypted stream not supported" ) ;
+      hlsstop() ;
+    }
+    return ;
+  }
+  if ( hlspendbw >= 0 )                        // URI of a variant?
+  {
+    if ( ( hlsnvar < HLSMAXVAR ) &&
+         hlsresolve ( hlsbase, line, hlsvarurl[hlsnvar], HLSURLSIZ ) )
+    {
+      hlsvarbw[hlsnvar++] = hlspendbw ;
+    }
+    hlspendbw = -1 ;
+    return ;
+  }
+  if ( hlsfirst || ( hlsparseseq >= hlsseq ) ) // URI of a new segment?
+  {
+    if ( ( hlssegcnt < HLSMAXSEG ) ||          // Yes, room in queue
+         ( hlsfirst && !hlsvod ) )             // or start near live edge?
+    {
+      hlsaddseg ( line ) ;                     // Yes, queue it
+      hlsseq = hlsparseseq + 1 ;
+      hlsadded++ ;
+    }
+    else
+    {
+      hlsskipped = true ;                      // No, get it on next reload
+    }
+  }
+  hlsparseseq++ ;
+}
+
+
+//******************************************************************************************
+//                               H L S L O A D E N D                                       *
+//******************************************************************************************
+// A playlist has been read completely.                                                    *
+//******************************************************************************************
+void hlsloadend()
+{
+  hlsclient->stop() ;
+  hlsstate = HLS_IDLE ;
+  if ( hlsnvar && ( hlsmedia[0] == '\0' ) )    // Master playlist read?
+  {
+    hlsvar = hlschoose() ;                     // Yes, start with a variant
+    strcpy ( hlsmedia, hlsvarurl[hlsvar] ) ;
+    dbgprint ( "HLS: %d variants, using %d bits/sec", hlsnvar, hlsvarbw[hlsvar] ) ;
+    if ( !hlsfetch ( hlsmedia ) )
+    {
+      hlsstop() ;
+    }
+    return ;
+  }
+  if ( hlsmedia[0] == '\0' )                   // Media playlist without master?
+  {
+    strcpy ( hlsmedia, hlsbase ) ;             // Yes, reload this one
+  }
+  dbgprint ( "HLS: %d new segments, target duration %d sec",
+             hlsadded, hlstarget ) ;
+  hlsfirst = false ;
+  if ( hlsendlist && !hlsskipped )             // Complete list queued?
+  {
+    hlsloadms = 0 ;                            // Yes, no reload
+    return ;
+  }
+  hlsloadms = millis() + ( hlsadded ? 1000 : 500 ) * hlstarget ;
+  if ( hlsloadms == 0 )
+  {
+    hlsloadms = 1 ;                            // 0 means no reload
+  }
+}
+
+
+//******************************************************************************************
+//                                 H L S M E T E R                                         *
+//******************************************************************************************
+// Measure the throughput of the segment downloads.  Only the time that loop() was not     *
+// held back by a full ringbuffer is counted.                                              *
+//******************************************************************************************
+void hlsmeter()
+{
+  uint32_t now = millis() ;
+  uint32_t rx = totalcount + ringavail() ;     // Bytes received so far
+
+  if ( mp3client && mp3client->connected() && // Downloading
+       ( ( ringavail() + 1024 ) < ringbfsiz ) && // and not held back?
+       ( rx >= hlsmeterrx ) )
+  {
+    hlsbusyms += now - hlsmeterms ;            // Yes, count this interval
+    hlsrxbytes += rx - hlsmeterrx ;
+  }
+  hlsmeterms = now ;
+  hlsmeterrx = rx ;
+  if ( hlsbusyms >= HLSMETERMS )               // Enough for a sample?
+  {
+    rx = (uint64_t)hlsrxbytes * 8000 / hlsbusyms ;
+    hlsbps = hlsbps ? ( hlsbps * 3 + rx ) / 4 : rx ;
+    hlsbusyms = 0 ;
+    hlsrxbytes = 0 ;
+  }
+}
+
+
+//******************************************************************************************
+//                                 H L S P L A Y                                           *
+//******************************************************************************************
+// Connect to the first segment.  The next segments are handled by the gapless prefetch.   *
+//******************************************************************************************
+void hlsplay ( String url )
+{
+  dbgprint ( "HLS: first segment %s", url.c_str() ) ;
+  datamode = INIT ;                            // Read header first
+  chunked = false ;
+  prebufstart() ;                              // Hold playback until buffer is filled
+  streamconnect ( url.c_str() ) ;              // Watchdog handles a failure
+}
+
+
+//******************************************************************************************
+//                                  H L S P O L L                                          *
+//******************************************************************************************
+// Called from loop().  Reads the playlists and starts the first segment.                  *
+//******************************************************************************************
+void hlspoll()
+{
+  String         url ;                         // URL of first segment
+  uint8_t        b ;                           // Byte from playlist
+  const uint8_t* pl ;                          // Payload of chunked playlist
+  uint32_t       plen ;                        // Length of payload
+  int            v ;                           // Variant
+
+  if ( !hlsactive )
+  {
+    return ;
+  }
+  hlsmeter() ;
+  if ( ( hlsstate != HLS_IDLE ) &&
+       ( ( millis() - hlsstartms ) > HLSTIMEOUT ) )
+  {
+    dbgprint ( "HLS: timeout on playlist %s", hlsbase ) ;
+    hlsstop() ;                                // Watchdog will stop the player
+    return ;
+  }
+  switch ( hlsstate )
+  {
+    case HLS_IDLE :
+      if ( hlsloadms && ( (int32_t)( millis() - hlsloadms ) >= 0 ) )
+      {
+        hlsloadms = 0 ;
+        v = hlschoose() ;                      // Time to reload, maybe other variant
+        if ( hlsnvar && ( v != hlsvar ) )
+        {
+          dbgprint ( "HLS: throughput %d bits/sec, switch to %d bits/sec",
+                     hlsbps, hlsvarbw[v] ) ;
+          hlsvar = v ;
+          strcpy ( hlsmedia, hlsvarurl[v] ) ;
+        }
+        if ( !hlsfetch ( hlsmedia ) )
+        {
+          hlsloadms = millis() + 500 * hlstarget ; // Try again later
+        }
+      }
+      break ;
+    case HLS_CONNECT :
+      switch ( connpoll ( &hlsconn ) )
+      {
+        case CONN_DONE :
+          hlsclient = conntake ( &hlsconn ) ;  // Connected, read header now
+          hlsstate = HLS_HEADER ;
+          break ;
+        case CONN_FAIL :
+          hlsloadfail() ;
+          break ;
+        default :
+          break ;
+      }
+      if ( hlsstate != HLS_HEADER )            // Still connecting?
+      {
+        break ;
+      }
+    // Fall through
+    case HLS_HEADER :
+      while ( !hlshdr.done && hlsclient->available() )
+      {
+        b = hlsclient->read() ;
+        hdrparse ( &hlshdr, &b, 1 ) ;
+      }
+      if ( !hlshdr.done )
+      {
+        break ;
+      }
+      if ( ( hlshdr.status >= 300 ) && ( hlshdr.status < 400 ) &&
+           hlshdr.location[0] )                // Redirected?
+      {
+        if ( !hlsresolve ( hlsbase, hlshdr.location, hlsline, sizeof(hlsline) ) ||
+             !hlsfetch ( hlsline ) )           // Yes, follow if possible
+        {
+          hlsloadfail() ;
+        }
+        break ;
+      }
+      if ( hlshdr.status >= 400 )
+      {
+        dbgprint ( "HLS: status %d for %s", hlshdr.status, hlsbase ) ;
+        hlsstop() ;
+        return ;
+      }
+      hlsstate = HLS_BODY ;
+    // Fall through
+    case HLS_BODY :
+      while ( hlsactive && hlsclient->available() )
+      {
+        b = hlsclient->read() ;
+        if ( hlshdr.chunked )                  // Chunked transfer?
+        {
+          chunkdecode ( &hlschunk, &b, 1, &pl, &plen ) ;
+          if ( plen == 0 )                     // Yes, skip the framing
+          {
+            continue ;
+          }
+        }
+        if ( b == '\n' )                       // End of line?
+        {
+          hlsline[hlslinelen] = '\0' ;
+          hlsparseline ( hlsline ) ;
+          hlslinelen = 0 ;
+        }
+        else if ( ( b != '\r' ) && ( hlslinelen < ( sizeof(hlsline) - 1 ) ) )
+        {
+          hlsline[hlslinelen++] = b ;
+        }
+      }
+      if ( hlsactive && !hlsclient->connected() ) // Complete?
+      {
+        hlsline[hlslinelen] = '\0' ;           // Yes, last line without linefeed
+        hlsparseline ( hlsline ) ;
+        hlslinelen = 0 ;
+        if ( hlsactive )
+        {
+          hlsloadend() ;
+        }
+      }
+      break ;
+  }
+  if ( hlsactive && ( datamode == STOPPED ) && // First segment known?
+       ( mp3client == NULL ) && hlsnext ( &url ) )
+  {
+    hlsplay ( url ) ;                          // Yes, start playing
+  }
+}
@@ -0,0 +1,409 @@
+//******************************************************************************************
+// Non-blocking connection to a host.                                                      *
+//******************************************************************************************
+// WiFiClient::connect() blocks for the DNS lookup and the TCP connect.  loop() would not  *
+// run for seconds if a host is slow or down.  A hostconn_t connects in steps.  Each step  *
+// is advanced by connpoll() from loop() and never waits:                                  *
+// - CONN_RESOLVE: DNS lookup by lwIP, the result is delivered by a callback;              *
+//                 the lookup is started with the core lock of lwIP held, the callback     *
+//                 runs with it held in the lwIP task and only stores the result;          *
+// - CONN_CONNECT: TCP connect on a non-blocking socket, done when it is writable;         *
+// - CONN_SEND:    the GET request is sent, as far as the socket accepts it;               *
+// - CONN_DONE:    the socket is handed over to a WiFiClient, see conntake().              *
+// Every step has its own timeout.  The caller waits for the header, the stream and the    *
+// gapless prefetch allow CONNHEADERMS for that.                                           *
+// The connection of the stream itself (mp3client) is started by streamconnect() and       *
+// taken over by streamconnpoll().  A failure leaves mp3client NULL, timer10sec() will     *
+// see that there is no input.  The times of the last connection are shown by "connstat".  *
+//******************************************************************************************
+#define CONNDNSMS      5000                    // Max time for DNS lookup
+#define CONNTCPMS      5000                    // Max time for TCP connect
+#define CONNSENDMS     2000                    // Max time to send the request
+#define CONNHEADERMS   5000                    // Max time from connect to end of header
+#define CONNHOSTSIZ    80                      // Max length of a host name
+#define CONNICY        "Icy-MetaData:1\r\n"    // Extra header for streams, request metadata
+
+enum connstate_t { CONN_IDLE, CONN_RESOLVE, CONN_CONNECT, CONN_SEND,
+                   CONN_DONE, CONN_FAIL } ;     // States of a connection
+
+struct hostconn_t
+{
+  connstate_t          state ;                 // State of the connection
+  char                 host[CONNHOSTSIZ] ;     // Host without port and path
+  uint16_t             port ;                  // Port number
+  String               request ;               // GET request for the host
+  size_t               sent ;                  // Part of the request sent
+  int                  fd ;                    // Socket in CONN_CONNECT and CONN_SEND
+  char                 dnsname[CONNHOSTSIZ] ;  // Name being looked up, under core lock
+  ip_addr_t            ip ;                    // IP address of host, result of lookup
+  std::atomic<uint8_t> dns ;                   // 0 = busy, 1 = found, 2 = not found
+  uint32_t             stepms ;                // Start of current step
+  uint32_t             resolvems ;             // Duration of DNS lookup
+  uint32_t             connectms ;             // Duration of TCP connect
+  WiFiClient*          client ;                // Result in CONN_DONE
+} ;
+
+hostconn_t   streamconn ;                      // Connection for mp3client
+uint32_t     streamhdrms = 0 ;                 // Start of wait for header, 0 if none
+uint32_t     conncount ;                       // Statistics: stream connections started
+uint32_t     connfails ;                       // Failed stream connections
+uint32_t     connlastdns ;                     // Last DNS lookup in msec
+uint32_t     connlasttcp ;                     // Last TCP connect in msec
+uint32_t     connlasthdr ;                     // Last wait for header in msec
+
+//******************************************************************************************
+//                              C O N N D N S F O U N D                                    *
+//******************************************************************************************
+// Callback of the DNS lookup.  Runs in the lwIP task with the core lock held, only the    *
+// result is stored here for connpoll().  The state of the connection is not looked at.    *
+// The result of an aborted lookup for another host is ignored.                            *
+//******************************************************************************************
+void conndnsfound ( const char* name, const ip_addr_t* ipaddr, void* arg )
+{
+  hostconn_t* c = (hostconn_t*)arg ;           // Connection that asked for it
+
+  if ( strcmp ( name, c->dnsname ) )
+  {
+    return ;                                   // Not waiting for this one anymore
+  }
+  if ( ipaddr )
+  {
+    c->ip = *ipaddr ;                          // Found, store address
+    c->dns.store ( 1, std::memory_order_release ) ;
+  }
+  else
+  {
+    c->dns.store ( 2, std::memory_order_release ) ; // Host not found
+  }
+}
+
+
+//******************************************************************************************
+//                                C O N N A B O R T                                        *
+//******************************************************************************************
+// Stop a connection in any state.  Closes the socket or the client that was not taken.    *
+//******************************************************************************************
+void connabort ( hostconn_t* c )
+{
+  if ( ( c->state == CONN_CONNECT ) || ( c->state == CONN_SEND ) )
+  {
+    close ( c->fd ) ;                          // Socket still ours
+  }
+  if ( c->state == CONN_DONE )
+  {
+    c->client->stop() ;                        // Client not taken over
+    delete ( c->client ) ;
+  }
+  c->client = NULL ;
+  c->state = CONN_IDLE ;
+}
+
+
+//******************************************************************************************
+//                                 C O N N F A I L                                         *
+//******************************************************************************************
+// A step of the connection failed.                                                        *
+//******************************************************************************************
+void connfail ( hostconn_t* c, const char* why )
+{
+  dbgprint ( "Connect to %s failed: %s", c->host, why ) ;
+  connabort ( c ) ;
+  c->state = CONN_FAIL ;
+}
+
+
+//******************************************************************************************
+//                                C O N N S T A R T                                        *
+//******************************************************************************************
+// Start a connection to url (like "skonto.ls.lv:8002/mp3").  The GET request includes     *
+// the extra header lines in hdrs.  Returns false if it failed at once.                    *
+//******************************************************************************************
+bool connstart ( hostconn_t* c, const char* url, const char* hdrs )
+{
+  const char* path ;                           // Path like "/mp3" in url
+  const char* colon ;                          // Position of ":" before path
+  size_t      len ;                            // Length of host name
+  char*       pfs ;                            // Pointer to formatted string
+  err_t       err ;                            // Result of DNS lookup
+
+  connabort ( c ) ;                            // Stop a previous connection
+  path = strchr ( url, '/' ) ;                 // Search for begin of extension
+  if ( path == NULL )
+  {
+    path = url + strlen ( url ) ;              // No extension, use "/"
+  }
+  colon = (const char*)memchr ( url, ':', path - url ) ; // Portnumber available?
+  len = ( colon ? colon : path ) - url ;
+  if ( len >= sizeof(c->host) )
+  {
+    len = sizeof(c->host) - 1 ;
+  }
+  memcpy ( c->host, url, len ) ;
+  c->host[len] = '\0' ;
+  c->port = colon ? atoi ( colon + 1 ) : 80 ;
+  c->request = String ( "GET " ) +
+               ( *path ? path : "/" ) +
+               String ( " HTTP/1.1\r\n" ) +
+               String ( "Host: " ) +
+               c->host +
+               String ( "\r\n" ) +
+               hdrs +
+               String ( "Connection: close\r\n\r\n" ) ;
+  pfs = dbgprint ( "Connect to %s on port %d, extension %s",
+                   c->host, c->port, *path ? path : "/" ) ;
+  displayinfo ( pfs, 60, 66, YELLOW ) ;        // Show info at position 60..125
+  c->stepms = millis() ;
+  c->resolvems = 0 ;
+  c->connectms = 0 ;
+  c->state = CONN_RESOLVE ;
+  LOCK_TCPIP_CORE() ;                          // No callback while the lookup starts
+  strcpy ( c->dnsname, c->host ) ;             // Results for other names are ignored
+  c->dns = 0 ;
+  err = dns_gethostbyname ( c->host, &c->ip, conndnsfound, c ) ;
+  if ( err == ERR_OK )                         // Known or numeric address?
+  {
+    c->dns = 1 ;                               // Yes, connect at next poll
+  }
+  UNLOCK_TCPIP_CORE() ;
+  if ( ( err != ERR_OK ) && ( err != ERR_INPROGRESS ) )
+  {
+    connfail ( c, "DNS lookup" ) ;
+    return false ;
+  }
+  return true ;
+}
+
+
+//******************************************************************************************
+//                                 C O N N P O L L                                         *
+//******************************************************************************************
+// Advance a connection as far as possible without waiting.  Returns the new state.        *
+//******************************************************************************************
+connstate_t connpoll ( hostconn_t* c )
+{
+  uint32_t    now = millis() ;
+  sockaddr_in addr ;                           // Address of host
+  fd_set      fds ;                            // For select()
+  timeval     tv = { 0, 0 } ;                  // select() does not wait
+  int         err ;                            // Result of connect
+  socklen_t   len = sizeof(err) ;
+  int         n ;                              // Bytes sent
+  uint8_t     dns ;                            // Result of DNS lookup
+
+  switch ( c->state )
+  {
+    case CONN_RESOLVE :
+      dns = c->dns.load ( std::memory_order_acquire ) ; // Result with the address
+      if ( dns == 0 )                          // Still busy?
+      {
+        if ( ( now - c->stepms ) > CONNDNSMS )
+        {
+          connfail ( c, "DNS timeout" ) ;
+        }
+        break ;
+      }
+      if ( dns == 2 )
+      {
+        connfail ( c, "host not found" ) ;
+        break ;
+      }
+      c->resolvems = now - c->stepms ;
+      c->stepms = now ;
+      c->fd = socket ( AF_INET, SOCK_STREAM, IPPROTO_TCP ) ;
+      if ( c->fd < 0 )
+      {
+        connfail ( c, "no socket" ) ;
+        break ;
+      }
+      c->state = CONN_CONNECT ;                // Socket is ours from now on
+      fcntl ( c->fd, F_SETFL, fcntl ( c->fd, F_GETFL, 0 ) | O_NONBLOCK ) ;
+      memset ( &addr, 0, sizeof(addr) ) ;
+      addr.sin_family = AF_INET ;
+      addr.sin_port = htons ( c->port ) ;
+      addr.sin_addr.s_addr = ip_2_ip4 ( &c->ip )->addr ;
+      if ( ( connect ( c->fd, (struct sockaddr*)&addr, sizeof(addr) ) < 0 ) &&
+           ( errno != EINPROGRESS ) )
+      {
+        connfail ( c, "connect" ) ;
+      }
+      break ;
+    case CONN_CONNECT :
+      FD_ZERO ( &fds ) ;
+      FD_SET ( c->fd, &fds ) ;
+      if ( select ( c->fd + 1, NULL, &fds, NULL, &tv ) <= 0 ) // Writable, so connected?
+      {
+        if ( ( now - c->stepms ) > CONNTCPMS )
+        {
+          connfail ( c, "connect timeout" ) ;
+        }
+        break ;
+      }
+      getsockopt ( c->fd, SOL_SOCKET, SO_ERROR, &err, &len ) ;
+      if ( err )                               // Refused or unreachable?
+      {
+        connfail ( c, "connect refused" ) ;
+        break ;
+      }
+      c->connectms = now - c->stepms ;
+      c->stepms = now ;
+      c->sent = 0 ;
+      c->state = CONN_SEND ;
+    // Fall through
+    case CONN_SEND :
+      n = send ( c->fd, c->request.c_str() + c->sent,
+                 c->request.length() - c->sent, MSG_DONTWAIT ) ;
+      if ( n > 0 )
+      {
+        c->sent += n ;
+      }
+      else if ( ( n < 0 ) && ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) )
+      {
+        connfail ( c, "send" ) ;
+        break ;
+      }
+      if ( c->sent < c->request.length() )     // Not all sent yet?
+      {
+        if ( ( now - c->stepms ) > CONNSENDMS )
+        {
+          connfail ( c, "send timeout" ) ;
+        }
+        break ;
+      }
+      // WiFiClient expects a blocking socket, its reads do not wait anyway
+      fcntl ( c->fd, F_SETFL, fcntl ( c->fd, F_GETFL, 0 ) & ~O_NONBLOCK ) ;
+      c->client = new WiFiClient ( c->fd ) ;
+      c->state = CONN_DONE ;
+      dbgprint ( "Connected to server, DNS %d msec, connect %d msec",
+                 c->resolvems, c->connectms ) ;
+      break ;
+    default :
+      break ;
+  }
+  return c->state ;
+}
+
+
+//******************************************************************************************
+//                                 C O N N T A K E                                         *
+//******************************************************************************************
+// Take over the client of a connection in CONN_DONE.  The connection becomes idle.        *
+//******************************************************************************************
+WiFiClient* conntake ( hostconn_t* c )
+{
+  WiFiClient* client = c->client ;
+
+  c->client = NULL ;
+  c->state = CONN_IDLE ;
+  return client ;
+}
+
+
+//******************************************************************************************
+//                             S T R E A M C O N N E C T                                   *
+//******************************************************************************************
+// Start the connection for mp3client.  datamode has been set by the caller, loop() reads  *
+// the header as soon as mp3client is set by streamconnpoll().                             *
+//******************************************************************************************
+bool streamconnect ( const char* url )
+{
+  streamhdrms = 0 ;
+  conncount++ ;
+  if ( !connstart ( &streamconn, url,         // Metadata, but not for HLS segments
+                    hlsactive ? "" : CONNICY ) )
+  {
+    connfails++ ;
+    return false ;
+  }
+  return true ;
+}
+
+
+//******************************************************************************************
+//                            S T R E A M C O N N S T O P                                  *
+//******************************************************************************************
+// Stop a stream connection that is still in progress.                                     *
+//******************************************************************************************
+void streamconnstop()
+{
+  connabort ( &streamconn ) ;
+  streamhdrms = 0 ;
+}
+
+
+//******************************************************************************************
+//                            S T R E A M C O N N P O L L                                  *
+//******************************************************************************************
+// Called from loop().  Advance the stream connection and check the wait for the header.   *
+//******************************************************************************************
+void streamconnpoll()
+{
+  uint32_t now = millis() ;
+
+  switch ( connpoll ( &streamconn ) )
+  {
+    case CONN_DONE :
+      rxpause() ;
+      mp3client = conntake ( &streamconn ) ;   // Header is read and parsed now
+      rxeof = false ;                          // Not closed yet
+      rxresume() ;
+      connlastdns = streamconn.resolvems ;
+      connlasttcp = streamconn.connectms ;
+      streamhdrms = now ;
+      break ;
+    case CONN_FAIL :
+      connfails++ ;                            // timer10sec() handles the missing input
+      streamconn.state = CONN_IDLE ;
+      break ;
+    default :
+      break ;
+  }
+  if ( streamhdrms == 0 )                      // Waiting for header?
+  {
+    return ;
+  }
+  if ( datamode & ( DATA | METADATA | PLAYLISTDATA ) ) // Header complete?
+  {
+    connlasthdr = now - streamhdrms ;          // Yes, connection is complete
+    streamhdrms = 0 ;
+  }
+  else if ( !( datamode & ( INIT | HEADER | PLAYLISTINIT | PLAYLISTHEADER ) ) )
+  {
+    streamhdrms = 0 ;                          // Stopped, nothing to wait for
+  }
+  else if ( ( now - streamhdrms ) > CONNHEADERMS )
+  {
+    dbgprint ( "No header from %s", streamconn.host ) ;
+    connfails++ ;
+    streamhdrms = 0 ;
+    rxpause() ;
+    mp3client->stop() ;                        // Give up, no input now
+    delete ( mp3client ) ;
+    mp3client = NULL ;
+    rxresume() ;
+  }
+}
+
+
+//******************************************************************************************
+//                                 C O N N R E S E T                                       *
+//******************************************************************************************
+// Clear the statistics of stream connections.                                             *
+//******************************************************************************************
+void connreset()
+{
+  conncount = 0 ;
+  connfails = 0 ;
+}
+
+
+//******************************************************************************************
+//                                  C O N N I N F O                                        *
+//******************************************************************************************
+// Format the statistics of stream connections for the "connstat" command.                 *
+//******************************************************************************************
+void conninfo ( char* reply, size_t len )
+{
+  snprintf ( reply, len, "Stream connections: %d started, %d failed, last DNS %d msec, "
+             "connect %d msec, header %d msec",
+             conncount, connfails, connlastdns, connlasttcp, connlasthdr ) ;
+}
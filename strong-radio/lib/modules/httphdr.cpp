@@ -0,0 +1,184 @@
+//******************************************************************************************
+// Parser for the HTTP/ICY header of a stream.                                             *
+//******************************************************************************************
+// The header is collected line by line in a fixed buffer and interpreted in place.  Keys  *
+// are compared case-insensitive without making a lowercase copy.  The result is stored    *
+// in a httphdr_t, so there is no heap traffic at all.  Lines that do not fit in the       *
+// buffer are truncated.  The header ends with an empty line after a content-type line.    *
+//******************************************************************************************
+#define HDRLINESIZ 256                          // Max length of a header line
+
+struct httphdr_t
+{
+  char     line[HDRLINESIZ] ;                   // Current header line
+  uint16_t linelen ;                            // Length of current line
+  uint8_t  lfcount ;                            // Detection of end of header
+  bool     ctseen ;                             // Content-type line seen
+  bool     done ;                               // End of header seen
+  int      status ;                             // HTTP status code, 0 if not seen
+  char     contenttype[40] ;                    // Content-type
+  int      icybr ;                              // icy-br in kb/sec, 0 if not seen
+  int      metaint ;                            // icy-metaint, 0 if not seen
+  char     icyname[64] ;                        // icy-name
+  bool     chunked ;                            // Transfer-encoding is chunked
+  char     location[128] ;                      // Location for redirect
+} ;
+
+httphdr_t    streamhdr ;                        // Header of the mp3 stream
+
+//******************************************************************************************
+//                                 H D R I N I T                                           *
+//******************************************************************************************
+// Prepare the parser for a new header.                                                    *
+//******************************************************************************************
+void hdrinit ( httphdr_t* h )
+{
+  memset ( h, 0, sizeof(*h) ) ;                 // All results empty
+}
+
+
+//******************************************************************************************
+//                                H D R V A L U E                                          *
+//******************************************************************************************
+// Check if line starts with key (lower case, including the colon), case-insensitive.      *
+// Return a pointer to the value without leading spaces, or NULL if the key does not match.*
+//******************************************************************************************
+const char* hdrvalue ( const char* line, const char* key )
+{
+  size_t len = strlen ( key ) ;                 // Length of key
+
+  if ( strncasecmp ( line, key, len ) )         // Key matches?
+  {
+    return NULL ;                               // No
+  }
+  line += len ;                                 // Yes, skip key
+  while ( *line == ' ' )
+  {
+    line++ ;                                    // Skip leading spaces
+  }
+  return line ;
+}
+
+
+//******************************************************************************************
+//                                H D R C O P Y                                            *
+//******************************************************************************************
+// Copy a header value to a fixed size field.  Trailing spaces are removed.                *
+//******************************************************************************************
+void hdrcopy ( char* dest, const char* val, size_t size )
+{
+  size_t len = strlen ( val ) ;                 // Length of value
+
+  while ( len && ( val[len - 1] == ' ' ) )
+  {
+    len-- ;                                     // Remove trailing spaces
+  }
+  if ( len >= size )
+  {
+    len = size - 1 ;                            // Truncate to field size
+  }
+  memcpy ( dest, val, len ) ;
+  dest[len] = '\0' ;
+}
+
+
+//******************************************************************************************
+//                                H D R L I N E                                            *
+//******************************************************************************************
+// Interpret a complete header line.                                                       *
+//******************************************************************************************
+void hdrline ( httphdr_t* h )
+{
+  const char* val ;                             // Value after key
+
+  h->line[h->linelen] = '\0' ;                  // Delimit the line
+  if ( ( h->status == 0 ) &&                    // Status line?  Like "HTTP/1.1 200 OK"
+       ( ( strncasecmp ( h->line, "http/", 5 ) == 0 ) ||
+         ( strncasecmp ( h->line, "icy ", 4 ) == 0 ) ) )
+  {
+    if ( ( val = strchr ( h->line, ' ' ) ) )    // Status code after first space
+    {
+      h->status = atoi ( val ) ;
+    }
+    dbgprint ( h->line ) ;
+  }
+  else if ( chkhdrline ( h->line ) )            // Reasonable input?
+  {
+    dbgprint ( h->line ) ;                      // Yes, Show it
+    if ( ( val = hdrvalue ( h->line, "content-type:" ) ) )
+    {
+      h->ctseen = true ;                        // Yes, remember seeing this
+      hdrcopy ( h->contenttype, val, sizeof(h->contenttype) ) ;
+      for ( char* q = h->contenttype ; *q ; q++ )
+      {
+        *q = tolower ( *q ) ;                   // Content-type is case-insensitive
+      }
+      dbgprint ( "%s seen.", h->contenttype ) ;
+    }
+    else if ( ( val = hdrvalue ( h->line, "icy-br:" ) ) )
+    {
+      h->icybr = atoi ( val ) ;                 // Found bitrate tag, read the bitrate
+      if ( h->icybr == 0 )                      // For Ogg br is like "Quality 2"
+      {
+        h->icybr = 87 ;                         // Dummy bitrate
+      }
+    }
+    else if ( ( val = hdrvalue ( h->line, "icy-metaint:" ) ) )
+    {
+      h->metaint = atoi ( val ) ;               // Found metaint tag, read the value
+    }
+    else if ( ( val = hdrvalue ( h->line, "icy-name:" ) ) )
+    {
+      hdrcopy ( h->icyname, val, sizeof(h->icyname) ) ;
+    }
+    else if ( ( val = hdrvalue ( h->line, "transfer-encoding:" ) ) )
+    {
+      h->chunked = ( strncasecmp ( val, "chunked", 7 ) == 0 ) ;
+    }
+    else if ( ( val = hdrvalue ( h->line, "location:" ) ) )
+    {
+      hdrcopy ( h->location, val, sizeof(h->location) ) ;
+    }
+  }
+  h->linelen = 0 ;                              // Reset this line
+}
+
+
+//******************************************************************************************
+//                                H D R P A R S E                                          *
+//******************************************************************************************
+// Parse the next span of header data.  Returns the number of bytes used.  Stops at the    *
+// end of the header (h->done is set), the rest of the span is data.                       *
+//******************************************************************************************
+uint32_t hdrparse ( httphdr_t* h, const uint8_t* p, uint32_t len )
+{
+  uint32_t i ;                                  // Index in span
+  uint8_t  b ;                                  // Next byte
+
+  for ( i = 0 ; ( i < len ) && !h->done ; i++ )
+  {
+    b = p[i] ;
+    if ( ( b > 0x7F ) ||                        // Ignore unprintable characters
+         ( b == '\r' ) ||                       // Ignore CR
+         ( b == '\0' ) )                        // Ignore NULL
+    {
+      // Yes, ignore
+    }
+    else if ( b == '\n' )                       // Linefeed ?
+    {
+      h->lfcount++ ;                            // Count linefeeds
+      hdrline ( h ) ;                           // Handle the line
+      h->done = ( h->lfcount == 2 ) &&          // Some data seen and a double LF?
+                h->ctseen ;
+    }
+    else
+    {
+      if ( h->linelen < ( HDRLINESIZ - 1 ) )    // Room in line?
+      {
+        h->line[h->linelen++] = b ;             // Normal character, put in line
+      }
+      h->lfcount = 0 ;                          // Reset double CRLF detection
+    }
+  }
+  return i ;
+}
@@ -0,0 +1,170 @@
+//******************************************************************************************
+// Parser for ICY metadata.                                                                *
+//******************************************************************************************
+// A metadata block like "StreamTitle='Don McLean - American Pie';StreamUrl='';" is        *
+// collected in a fixed buffer and split in place into key/value pairs.  The value of      *
+// StreamTitle is hashed, the title is only shown if the hash has changed.  Most stations  *
+// repeat the same title every few seconds, this saves the copies and the display update.  *
+// There is no heap use.                                                                   *
+//******************************************************************************************
+#define ICYMETASIZ     ( 255 * 16 )            // Max length of a metadata block
+#define ICYMAXPAIRS    8                       // Max number of key/value pairs
+
+struct icymeta_t
+{
+  char        block[ICYMETASIZ + 1] ;          // Metadata block, room for delimiter
+  uint16_t    len ;                            // Length of block so far
+  uint8_t     npairs ;                         // Number of pairs found
+  const char* key[ICYMAXPAIRS] ;               // Keys, point into block
+  const char* val[ICYMAXPAIRS] ;               // Values, point into block
+  uint32_t    titlehash ;                      // Hash of last StreamTitle, 0 if none
+} ;
+
+icymeta_t    icymeta ;                         // Metadata of the mp3 stream
+
+//******************************************************************************************
+//                               I C Y M E T A I N I T                                     *
+//******************************************************************************************
+// Prepare for a new stream.  The first title will always be shown.                        *
+//******************************************************************************************
+void icymetainit ( icymeta_t* m )
+{
+  m->len = 0 ;
+  m->npairs = 0 ;
+  m->titlehash = 0 ;                           // No title seen yet
+}
+
+
+//******************************************************************************************
+//                                I C Y M E T A A D D                                      *
+//******************************************************************************************
+// Add a run of bytes to the metadata block.  Bytes beyond the maximum size are dropped.   *
+//******************************************************************************************
+void icymetaadd ( icymeta_t* m, const uint8_t* p, uint32_t len )
+{
+  if ( len > (uint32_t)( ICYMETASIZ - m->len ) )
+  {
+    len = ICYMETASIZ - m->len ;                // Limit to size of buffer
+  }
+  memcpy ( m->block + m->len, p, len ) ;
+  m->len += len ;
+}
+
+
+//******************************************************************************************
+//                               I C Y M E T A H A S H                                     *
+//******************************************************************************************
+// FNV-1a hash of a string.  Never returns 0, that means "no title".                       *
+//******************************************************************************************
+uint32_t icymetahash ( const char* str )
+{
+  uint32_t h = 2166136261 ;                    // FNV offset basis
+
+  while ( *str )
+  {
+    h = ( h ^ (uint8_t)*str++ ) * 16777619 ;   // FNV prime
+  }
+  return h ? h : 1 ;
+}
+
+
+//******************************************************************************************
+//                              I C Y M E T A P A R S E                                    *
+//******************************************************************************************
+// Split the block in place into key/value pairs.  Values may be quoted, a quoted value    *
+// ends with "';", so a quote inside a title is allowed.                                   *
+//******************************************************************************************
+void icymetaparse ( icymeta_t* m )
+{
+  char* p = m->block ;                         // Scan pointer
+  char* end ;                                  // End of value
+  char* eq ;                                   // Position of "="
+
+  m->block[m->len] = '\0' ;                    // Delimit the block, padding is NUL too
+  m->npairs = 0 ;
+  while ( *p && ( m->npairs < ICYMAXPAIRS ) )
+  {
+    if ( ( eq = strchr ( p, '=' ) ) == NULL )  // Find end of key
+    {
+      break ;                                  // No more pairs
+    }
+    *eq++ = '\0' ;                             // Delimit key
+    m->key[m->npairs] = p ;
+    if ( *eq == '\'' )                         // Quoted value?
+    {
+      eq++ ;                                   // Yes, skip quote
+      if ( ( end = strstr ( eq, "';" ) ) )     // Search for end of value
+      {
+        *end = '\0' ;
+        p = end + 2 ;                          // Next pair
+      }
+      else
+      {
+        p = eq + strlen ( eq ) ;               // Last pair, strip closing quote
+        if ( ( p > eq ) && ( p[-1] == '\'' ) )
+        {
+          p[-1] = '\0' ;
+        }
+      }
+    }
+    else if ( ( end = strchr ( eq, ';' ) ) )   // Unquoted value
+    {
+      *end = '\0' ;
+      p = end + 1 ;
+    }
+    else
+    {
+      p = eq + strlen ( eq ) ;                 // Last pair
+    }
+    m->val[m->npairs++] = eq ;
+  }
+}
+
+
+//******************************************************************************************
+//                                I C Y M E T A G E T                                      *
+//******************************************************************************************
+// Return the value of a key in the last parsed block, or NULL if not present.             *
+//******************************************************************************************
+const char* icymetaget ( icymeta_t* m, const char* key )
+{
+  uint8_t i ;                                  // Loop control
+
+  for ( i = 0 ; i < m->npairs ; i++ )
+  {
+    if ( strcasecmp ( m->key[i], key ) == 0 )
+    {
+      return m->val[i] ;
+    }
+  }
+  return NULL ;
+}
+
+
+//******************************************************************************************
+//                                I C Y M E T A E N D                                      *
+//******************************************************************************************
+// A metadata block is complete.  Parse it and show the title if it has changed.           *
+// Returns true if the title has changed.                                                  *
+//******************************************************************************************
+bool icymetaend ( icymeta_t* m )
+{
+  const char* title ;                          // Value of StreamTitle
+  uint32_t    h ;                              // Hash of title
+
+  icymetaparse ( m ) ;                         // Split in pairs
+  m->len = 0 ;                                 // Ready for next block
+  if ( ( title = icymetaget ( m, "StreamTitle" ) ) == NULL )
+  {
+    return false ;                             // No title in this block
+  }
+  h = icymetahash ( title ) ;
+  if ( h == m->titlehash )                     // Same title as before?
+  {
+    return false ;                             // Yes, nothing to do
+  }
+  m->titlehash = h ;
+  dbgprint ( "Streamtitle changed: %s", title ) ;
+  showstreamtitle ( title ) ;                  // Show artist and title
+  return true ;
+}
@@ -5,36 +5,49 @@
 //******************************************************************************************
 void stop_mp3client ()
 {
+  rxpause() ;                                        // Receive task must not read now
   if ( mp3client )
   {
-    if ( mp3client->connected() )                    // Need to stop client?
+    if ( fastzap )                                   // Fast station switch?
+    {
+      zapdetach ( mp3client ) ;                      // Yes, close after next connect
+    }
+    else
     {
       dbgprint ( "Stopping client" ) ;               // Stop connection to host
-      mp3client->flush() ;
-      mp3client->stop() ;
-      delay ( 500 ) ;
+      mp3client->stop() ;                            // Closes at once, no need to wait
+      delete ( mp3client ) ;
     }
-    delete ( mp3client ) ;
     mp3client = NULL ;
   }
+  rxeof = false ;                                    // Next client not yet closed
+  rxresume() ;
+  streamconnstop() ;                                 // Cancel connect in progress
+  xmlstop() ;                                        // Cancel iHeartRadio lookup
+  prefetchstop() ;                                   // Cancel prefetch of next entry
+  hlsstop() ;                                        // Stop reading HLS playlists
 }
 
 
 //******************************************************************************************
 //                            C O N N E C T T O H O S T                                    *
-
 //******************************************************************************************
 // Connect to the Internet radio server specified by newpreset.                            *
 //******************************************************************************************
 bool connecttohost()
 {
-  int         inx ;                                 // Position of ":" in hostname
-  char*       pfs ;                                 // Pointer to formatted string
-  int         port = 80 ;                           // Port number for host
-  String      extension = "/" ;                     // May be like "/mp3" in "skonto.ls.lv:8002/mp3"
-  String      hostwoext ;                           // Host without extension and portnumber
-
   stop_mp3client() ;                                // Disconnect if still connected
+  if ( plvalid && playlist_num &&                   // Next entry of cached playlist?
+       ( host == playlist ) )
+  {
+    return playlistgo() ;                           // Yes, connect to entry directly
+  }
+  if ( host.endsWith ( ".m3u8" ) ||                 // HLS stream?
+       ( host.indexOf ( ".m3u8?" ) > 0 ) )
+  {
+    datamode = STOPPED ;                            // Yes, hlspoll() starts the segments
+    return hlsstart ( host.c_str() ) ;
+  }
   dbgprint ( "Connect to new host %s", host.c_str() ) ;
   displayinfo ( "   ** Internet radio **", 0, 20, WHITE ) ;
   datamode = INIT ;                                 // Start default in metamode
@@ -49,40 +62,8 @@ bool connecttohost()
     }
     dbgprint ( "Playlist request, entry %d", playlist_num ) ;
   }
-  // In the URL there may be an extension
-  inx = host.indexOf ( "/" ) ;                      // Search for begin of extension
-  if ( inx > 0 )                                    // Is there an extension?
-  {
-    extension = host.substring ( inx ) ;            // Yes, change the default
-    hostwoext = host.substring ( 0, inx ) ;         // Host without extension
-  }
-  // In the URL there may be a portnumber
-  inx = host.indexOf ( ":" ) ;                      // Search for separator
-  if ( inx >= 0 )                                   // Portnumber available?
-  {
-    port = host.substring ( inx + 1 ).toInt() ;     // Get portnumber as integer
-    hostwoext = host.substring ( 0, inx ) ;         // Host without portnumber
-  }
-  pfs = dbgprint ( "Connect to %s on port %d, extension %s",
-                   hostwoext.c_str(), port, extension.c_str() ) ;
-  displayinfo ( pfs, 60, 66, YELLOW ) ;             // Show info at position 60..125
-  mp3client = new WiFiClient() ;
-  if ( mp3client->connect ( hostwoext.c_str(), port ) )
-  {
-    dbgprint ( "Connected to server" ) ;
-    // This will send the request to the server. Request metadata.
-    mp3client->print ( String ( "GET " ) +
-                       extension +
-                      String ( " HTTP/1.1\r\n" ) +
-                      String ( "Host: " ) +
-                      hostwoext +
-                      String ( "\r\n" ) +
-                      String ( "Icy-MetaData:1\r\n" ) +
-                      String ( "Connection: close\r\n\r\n" ) ) ;
-    return true ;
-  }
-  dbgprint ( "Request %s failed!", host.c_str() ) ;
-  return false ;
+  prebufstart() ;                                   // Hold playback until buffer is filled
+  return streamconnect ( host.c_str() ) ;           // streamconnpoll() sets mp3client
 }
 
 
@@ -96,6 +77,7 @@ bool connecttofile()
   String path ;                                           // Full file spec
   char*  p ;                                              // Pointer to filename
 
+  stop_mp3client() ;                                      // Stop a connect in progress
   displayinfo ( "   **** MP3 Player ****", 0, 20, WHITE ) ;
   path = host.substring ( 9 ) ;                           // Path, skip the "localhost" part
   mp3file = SPIFFS.open ( path, "r" ) ;                   // Open the file
@@ -105,11 +87,14 @@ bool connecttofile()
     return false ;
   }
   p = (char*)path.c_str() + 1 ;                           // Point to filename
-  showstreamtitle ( p, true ) ;                           // Show the filename as title
+  showstreamtitle ( p ) ;                                 // Show the filename as title
   displayinfo ( "Playing from local file",
                 60, 68, YELLOW ) ;                        // Show Source at position 60
-  icyname = "" ;                                          // No icy name yet
+  hdrinit ( &streamhdr ) ;                                // No icy name yet
+  sniffstart() ;                                          // Detect format of the file
   chunked = false ;                                       // File not chunked
+  metaint = 0 ;                                           // No metadata in file
+  streamfunc = handlebytes_ch ;                           // Generic handling until format known
   return true ;
 }
 
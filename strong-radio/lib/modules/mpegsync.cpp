@@ -0,0 +1,291 @@
+//******************************************************************************************
+// MPEG audio frame analyzer.                                                              *
+//******************************************************************************************
+// Follows the frame headers in the MP3 data that is sent to the VS1053.  At the start of  *
+// a stream all bytes up to the first valid frame header are skipped, so the decoder will  *
+// start on a frame boundary.  After that only the frame headers are examined: the bytes   *
+// in between are skipped in one step, so the cost per byte is negligible.  If the sync is *
+// lost later on, the analyzer searches again, but the data is still played.               *
+// The real bitrate (average over all frames), VBR/CBR and the sample rate are measured.   *
+// The measured bitrate replaces the bitrate from the "icy-br" header.                     *
+// If no frame header is found in the first MPEGHUNTMAX bytes, the analyzer gives up and   *
+// all data is passed as is.                                                               *
+//******************************************************************************************
+#define MPEGHUNTMAX    16384                   // Max bytes to skip for first frame
+#define MPEGUPDATE     64                      // Update bitrate every 64 frames
+#define MPEGMASK       0xFFFE0C00              // Sync, version, layer and sample rate
+
+enum mpegstate_t { MS_HUNT, MS_SYNC, MS_OFF } ; // States of the analyzer
+
+struct mpegsync_t
+{
+  mpegstate_t state ;                          // State of the analyzer
+  uint32_t    word ;                           // Last 4 bytes of header seen
+  uint8_t     hdr[4] ;                         // Header of first frame, to be played
+  uint8_t     hdrcnt ;                         // Number of bytes of next header seen
+  uint32_t    remain ;                         // Bytes left in current frame
+  uint32_t    fixed ;                          // Fixed part of the header of the first frame
+  uint32_t    hunted ;                         // Bytes skipped while searching
+  uint32_t    frames ;                         // Number of frames seen
+  uint64_t    bytes ;                          // Total length of all frames
+  uint64_t    samples ;                        // Total number of samples in all frames
+  uint32_t    samplerate ;                     // Sample rate in Hz
+  uint8_t     version ;                        // 10 for MPEG 1, 20 for MPEG 2, 25 for MPEG 2.5
+  uint8_t     layer ;                          // Layer 1, 2 or 3
+  uint16_t    minbr ;                          // Lowest bitrate seen in kb/sec
+  uint16_t    maxbr ;                          // Highest bitrate seen in kb/sec
+  uint16_t    resyncs ;                        // Number of times sync was lost
+} ;
+
+mpegsync_t   mpegsync ;                        // Analyzer for the mp3 stream
+
+// Bitrates in kb/sec for MPEG 1 layer 1, 2, 3 and MPEG 2/2.5 layer 1, 2/3.
+const uint16_t mpegbrtab[5][16] =
+{
+  { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+  { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+  { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 0 },
+  { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+  { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0 }
+} ;
+
+// Sample rates in Hz for MPEG 1.  Half for MPEG 2, a quarter for MPEG 2.5.
+const uint16_t mpegsrtab[4] = { 44100, 48000, 32000, 0 } ;
+
+//******************************************************************************************
+//                                M P E G I N I T                                          *
+//******************************************************************************************
+// Prepare the analyzer for a new stream.  If search is false, all data is passed as is.   *
+//******************************************************************************************
+void mpeginit ( mpegsync_t* m, bool search )
+{
+  memset ( m, 0, sizeof(*m) ) ;                // All counters zero
+  m->state = search ? MS_HUNT : MS_OFF ;
+}
+
+
+//******************************************************************************************
+//                                M P E G F R A M E                                        *
+//******************************************************************************************
+// Check a frame header and account the frame.  Returns false if the header is invalid or  *
+// does not match the first frame.  On success, m->remain is set to the rest of the frame. *
+//******************************************************************************************
+bool mpegframe ( mpegsync_t* m, uint32_t h )
+{
+  uint8_t  ver = ( h >> 19 ) & 3 ;             // 0 = MPEG 2.5, 2 = MPEG 2, 3 = MPEG 1
+  uint8_t  lay = 4 - ( ( h >> 17 ) & 3 ) ;     // Layer 1..3, 4 is reserved
+  uint8_t  bri = ( h >> 12 ) & 15 ;            // Bitrate index
+  uint8_t  sri = ( h >> 10 ) & 3 ;             // Sample rate index
+  uint32_t pad = ( h >> 9 ) & 1 ;              // Padding bit
+  uint32_t br ;                                // Bitrate in kb/sec
+  uint32_t sr ;                                // Sample rate in Hz
+  uint32_t len ;                               // Frame length in bytes
+  uint32_t spf ;                               // Samples per frame
+
+  if ( ( ( h >> 21 ) != 0x7FF ) ||             // Frame sync?
+       ( ver == 1 ) || ( lay == 4 ) ||         // Reserved version or layer?
+       ( sri == 3 ) ||                         // Reserved sample rate?
+       ( ( h & 3 ) == 2 ) )                    // Reserved emphasis?
+  {
+    return false ;
+  }
+  if ( m->frames && ( ( h & MPEGMASK ) != m->fixed ) )
+  {
+    return false ;                             // Does not match the first frame
+  }
+  if ( ver == 3 )
+  {
+    br = mpegbrtab[lay - 1][bri] ;             // MPEG 1
+  }
+  else
+  {
+    br = mpegbrtab[lay == 1 ? 3 : 4][bri] ;    // MPEG 2 or 2.5
+  }
+  if ( br == 0 )                               // Free format or bad index?
+  {
+    return false ;
+  }
+  sr = mpegsrtab[sri] ;
+  if ( ver != 3 )
+  {
+    sr >>= ( ver == 2 ) ? 1 : 2 ;              // Lower sample rates for MPEG 2/2.5
+  }
+  if ( lay == 1 )
+  {
+    spf = 384 ;                                // Layer 1
+    len = ( 12000 * br / sr + pad ) * 4 ;
+  }
+  else if ( ( lay == 3 ) && ( ver != 3 ) )
+  {
+    spf = 576 ;                                // Layer 3, MPEG 2/2.5
+    len = 72000 * br / sr + pad ;
+  }
+  else
+  {
+    spf = 1152 ;                               // Layer 2 or MPEG 1 layer 3
+    len = 144000 * br / sr + pad ;
+  }
+  if ( m->frames == 0 )                        // First frame?
+  {
+    m->fixed = h & MPEGMASK ;                  // Yes, other frames must match
+    m->samplerate = sr ;
+    m->version = ( ver == 3 ) ? 10 : ( ver == 2 ) ? 20 : 25 ;
+    m->layer = lay ;
+    m->minbr = br ;
+    m->maxbr = br ;
+  }
+  if ( br < m->minbr )                         // Track range of bitrates for VBR
+  {
+    m->minbr = br ;
+  }
+  if ( br > m->maxbr )
+  {
+    m->maxbr = br ;
+  }
+  m->frames++ ;
+  m->bytes += len ;
+  m->samples += spf ;
+  m->remain = len - 4 ;                        // Header has been seen
+  return true ;
+}
+
+
+//******************************************************************************************
+//                                M P E G K B P S                                          *
+//******************************************************************************************
+// Return the average bitrate of all frames in kb/sec, 0 if not known.                     *
+//******************************************************************************************
+int mpegkbps ( mpegsync_t* m )
+{
+  if ( m->samples == 0 )
+  {
+    return 0 ;
+  }
+  return ( m->bytes * 8 * m->samplerate / m->samples + 500 ) / 1000 ;
+}
+
+
+//******************************************************************************************
+//                               M P E G U P D A T E                                       *
+//******************************************************************************************
+// Called after every MPEGUPDATE frames.  The measured bitrate replaces the header value.  *
+//******************************************************************************************
+void mpegupdate ( mpegsync_t* m )
+{
+  int br = mpegkbps ( m ) ;                    // Measured bitrate
+
+  if ( m->frames == MPEGUPDATE )               // First update for this stream?
+  {
+    dbgprint ( "MPEG %d.%d layer %d, %d Hz, %d kb/sec %s, header said %d",
+               m->version / 10, m->version % 10, m->layer, m->samplerate,
+               br, ( m->minbr == m->maxbr ) ? "CBR" : "VBR", bitrate ) ;
+  }
+  bitrate = br ;                               // Use the real bitrate from now on
+}
+
+
+//******************************************************************************************
+//                                 M P E G H U N T                                         *
+//******************************************************************************************
+// Search for a valid frame header.  Returns the number of bytes used.  If a header is     *
+// found, the analyzer is in sync and the 4 header bytes are in m->hdr.  The caller has    *
+// to play these, the other bytes that were used are skipped.                              *
+//******************************************************************************************
+uint32_t mpeghunt ( mpegsync_t* m, const uint8_t* p, uint32_t len )
+{
+  uint32_t i ;                                 // Index in span
+
+  for ( i = 0 ; i < len ; i++ )
+  {
+    m->word = ( m->word << 8 ) | p[i] ;        // Shift in next byte
+    if ( ++m->hunted < 4 )                     // 4 bytes seen?
+    {
+      continue ;                               // No, not a header yet
+    }
+    if ( ( ( m->word >> 21 ) == 0x7FF ) &&     // Quick check on frame sync
+         mpegframe ( m, m->word ) )            // Valid header?
+    {
+      m->hdr[0] = m->word >> 24 ;              // Yes, save header for the caller
+      m->hdr[1] = m->word >> 16 ;
+      m->hdr[2] = m->word >> 8 ;
+      m->hdr[3] = m->word ;
+      m->state = MS_SYNC ;
+      if ( m->hunted > 4 )
+      {
+        dbgprint ( "MPEG frame sync after %d bytes", m->hunted - 4 ) ;
+      }
+      return i + 1 ;
+    }
+    if ( m->hunted >= MPEGHUNTMAX )            // Searched long enough?
+    {
+      dbgprint ( "No MPEG frame sync found" ) ;
+      m->state = MS_OFF ;                      // Yes, give up
+      return i + 1 ;
+    }
+  }
+  return len ;
+}
+
+
+//******************************************************************************************
+//                                M P E G T R A C K                                        *
+//******************************************************************************************
+// Follow the frame headers in a span of data that will be played.  If a header turns out  *
+// to be invalid, the analyzer starts searching again.                                     *
+//******************************************************************************************
+void mpegtrack ( mpegsync_t* m, const uint8_t* p, uint32_t len )
+{
+  uint32_t n ;                                 // Bytes to skip
+
+  while ( len && ( m->state == MS_SYNC ) )
+  {
+    if ( m->remain )                           // Inside a frame?
+    {
+      n = ( len < m->remain ) ? len : m->remain ;
+      m->remain -= n ;                         // Yes, skip to end of frame
+      p += n ;
+      len -= n ;
+      continue ;
+    }
+    m->word = ( m->word << 8 ) | *p++ ;        // Collect next header
+    len-- ;
+    if ( ++m->hdrcnt == 4 )                    // Complete header?
+    {
+      m->hdrcnt = 0 ;
+      if ( !mpegframe ( m, m->word ) )         // Yes, check it
+      {
+        m->resyncs++ ;                         // Lost sync, search again
+        m->word = 0 ;                          // Bytes of this header are played already,
+        m->hunted = 0 ;                        // search starts with the next byte
+        m->state = MS_HUNT ;
+        dbgprint ( "MPEG frame sync lost" ) ;
+      }
+      else if ( ( m->frames % MPEGUPDATE ) == 0 )
+      {
+        mpegupdate ( m ) ;                     // Time to update the bitrate
+      }
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                 M P E G I N F O                                         *
+//******************************************************************************************
+// Format the results of the analyzer for the "mpegstat" command.                          *
+//******************************************************************************************
+void mpeginfo ( char* reply, size_t len )
+{
+  mpegsync_t* m = &mpegsync ;
+
+  if ( m->frames == 0 )
+  {
+    snprintf ( reply, len, "No MPEG frames seen" ) ;
+    return ;
+  }
+  snprintf ( reply, len, "MPEG %d.%d layer %d, %d Hz, %d kb/sec %s (%d-%d), "
+             "%d frames, %d resyncs",
+             m->version / 10, m->version % 10, m->layer, m->samplerate,
+             mpegkbps ( m ), ( m->minbr == m->maxbr ) ? "CBR" : "VBR",
+             m->minbr, m->maxbr, m->frames, m->resyncs ) ;
+}
@@ -0,0 +1,212 @@
+//******************************************************************************************
+// Receive task for the stream.                                                            *
+//******************************************************************************************
+// The data of mp3client is read by a separate task on core 0, the core of the WiFi and    *
+// lwIP tasks.  loop() and the feeder task stay on core 1.  The task moves as many bytes   *
+// as the socket has into the writable span of the ringbuffer with one read(buf,len), so   *
+// it is the producer of the ringbuffer now.  If there is no data, the task sleeps in      *
+// select() until the socket is readable, at most RXWAITMS msec.  If the ringbuffer is     *
+// full, there is no stream or a local file is played, it sleeps RXIDLEMS msec.            *
+// loop() still reads local files.  With "netrx=0" loop() reads the stream again, at most  *
+// 1024 bytes per pass, to compare.  "rxstat" shows the throughput and the CPU share.      *
+// rxlock is held by the task while it reads.  Code that changes or deletes mp3client      *
+// takes it too, see rxpause().  It is recursive, stop_mp3client() may be called with it.  *
+// The producer sets rxeof if the server closed the connection, so the feeder can see the  *
+// end of the stream without touching mp3client.                                           *
+//******************************************************************************************
+#define RXPRIO         2                       // Priority of task, above loop(), below feeder
+#define RXSTACK        4096                    // Stack size
+#define RXCORE         0                       // Protocol core, with WiFi and lwIP
+#define RXWAITMS       50                      // Max sleep waiting for the socket
+#define RXIDLEMS       10                      // Sleep if there is nothing to do
+
+TaskHandle_t          rxhandle = NULL ;        // Handle of the receive task
+SemaphoreHandle_t     rxlock = NULL ;          // Protects mp3client while reading
+bool                  netrx = true ;           // Stream is read by the receive task
+volatile bool         rxeof = false ;          // Connection of mp3client closed by server
+uint32_t              rxbytes ;                // Statistics: bytes received
+uint32_t              rxtotal ;                // Bytes received, not reset, for timer10sec()
+uint32_t              rxreads ;                // Reads with data
+uint32_t              rxwaits ;                // Sleeps on the socket
+uint64_t              rxbusyus ;               // Time spent reading
+uint32_t              rxstamp ;                // millis() at reset of statistics
+
+//******************************************************************************************
+//                                  R X P A U S E                                          *
+//******************************************************************************************
+// Keep the receive task out of mp3client until rxresume().                                *
+//******************************************************************************************
+void rxpause()
+{
+  xSemaphoreTakeRecursive ( rxlock, portMAX_DELAY ) ;
+}
+
+
+//******************************************************************************************
+//                                 R X R E S U M E                                         *
+//******************************************************************************************
+// Allow the receive task to read again.                                                   *
+//******************************************************************************************
+void rxresume()
+{
+  xSemaphoreGiveRecursive ( rxlock ) ;
+}
+
+
+//******************************************************************************************
+//                                  R X B U R S T                                          *
+//******************************************************************************************
+// Read at most maxlen bytes from mp3client into the ringbuffer.  Called by the producer   *
+// of the ringbuffer with rxlock held.  Returns the number of bytes read.                  *
+//******************************************************************************************
+uint32_t rxburst ( uint32_t maxlen )
+{
+  uint32_t  t0 = micros() ;                    // Start of the burst
+  uint8_t*  p ;                                // Span in ringbuffer
+  uint32_t  n ;                                // Length of span
+  uint32_t  total = 0 ;                        // Bytes read
+  int       res ;                              // Result of read
+
+  while ( ( total < maxlen ) && ( n = ringwspan ( &p ) ) ) // Room in the ringbuffer?
+  {
+    if ( n > ( maxlen - total ) )              // Yes, limit to maxlen
+    {
+      n = maxlen - total ;
+    }
+    res = mp3client->read ( p, n ) ;           // Read a block from the stream
+    if ( res <= 0 )                            // Anything read?
+    {
+      break ;                                  // No, try again later
+    }
+    ringwcommit ( res ) ;                      // Store the block in the ringbuffer
+    total += res ;
+    rxreads++ ;
+  }
+  if ( !ringspace() && mp3client->available() ) // Input left, but buffer full?
+  {
+    ringoverflows++ ;                          // Yes, count backpressure
+  }
+  rxeof = !mp3client->connected() ;            // No more data to expect?
+  rxbytes += total ;
+  rxtotal += total ;
+  rxbusyus += micros() - t0 ;
+  return total ;
+}
+
+
+//******************************************************************************************
+//                                  R X E N D E D                                          *
+//******************************************************************************************
+// True if all data of mp3client has been received.  False if there is no mp3client.       *
+//******************************************************************************************
+bool rxended()
+{
+  bool res = false ;                           // Result
+
+  rxpause() ;
+  if ( mp3client )
+  {
+    res = !mp3client->connected() && ( mp3client->available() == 0 ) ;
+  }
+  rxresume() ;
+  return res ;
+}
+
+
+//******************************************************************************************
+//                                   R X T A S K                                           *
+//******************************************************************************************
+// The receive task.  Reads the stream as long as there is data and room in the            *
+// ringbuffer, then sleeps on the socket.                                                  *
+//******************************************************************************************
+void rxtask ( void* parameter )
+{
+  int      fd ;                                // Socket to wait for, -1 if none
+  fd_set   fds ;                               // For select()
+  timeval  tv ;                                // Timeout of select()
+
+  while ( true )
+  {
+    fd = -1 ;
+    rxpause() ;
+    if ( netrx && !localfile && mp3client &&   // Stream to read?
+         ( datamode & ( INIT | HEADER | DATA | METADATA | PLAYLISTINIT |
+                        PLAYLISTHEADER | PLAYLISTDATA ) ) )
+    {
+      rxburst ( 0xFFFFFFFF ) ;                 // Yes, as much as possible
+      if ( ringspace() && mp3client->connected() &&
+           ( mp3client->available() == 0 ) )   // All read, more to expect?
+      {
+        fd = mp3client->fd() ;                 // Yes, wait for the socket
+      }
+    }
+    rxresume() ;
+    if ( fd >= 0 )
+    {
+      FD_ZERO ( &fds ) ;
+      FD_SET ( fd, &fds ) ;
+      tv.tv_sec = 0 ;
+      tv.tv_usec = RXWAITMS * 1000 ;
+      select ( fd + 1, &fds, NULL, NULL, &tv ) ; // Sleep until data arrives
+      rxwaits++ ;
+    }
+    else
+    {
+      vTaskDelay ( RXIDLEMS / portTICK_PERIOD_MS ) ; // Nothing to do, or buffer full
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                  R X S T A R T                                          *
+//******************************************************************************************
+// Create the receive task.  Called once from setup().                                     *
+//******************************************************************************************
+void rxstart()
+{
+  rxlock = xSemaphoreCreateRecursiveMutex() ;
+  rxstamp = millis() ;
+  xTaskCreatePinnedToCore ( rxtask, "netrx", RXSTACK, NULL,
+                            RXPRIO, &rxhandle, RXCORE ) ;
+  dbgprint ( "Receive task started" ) ;
+}
+
+
+//******************************************************************************************
+//                                  R X R E S E T                                          *
+//******************************************************************************************
+// Clear the statistics of the receiver.                                                   *
+//******************************************************************************************
+void rxreset()
+{
+  rxbytes = 0 ;
+  rxreads = 0 ;
+  rxwaits = 0 ;
+  rxbusyus = 0 ;
+  rxstamp = millis() ;
+}
+
+
+//******************************************************************************************
+//                                   R X I N F O                                           *
+//******************************************************************************************
+// Format the statistics of the receiver for the "rxstat" command.  The CPU share is the   *
+// time spent in reads, relative to the time since the reset, of one core.                 *
+//******************************************************************************************
+void rxinfo ( char* reply, size_t len )
+{
+  uint32_t ms = millis() - rxstamp ;           // Time since reset
+
+  if ( ms < 1000 )
+  {
+    ms = 1000 ;                                // Prevent division by zero
+  }
+  snprintf ( reply, len, "Receive (%s): %u bytes/sec, %u reads of %u bytes average, "
+             "%u waits on socket, CPU %u.%u%%",
+             netrx ? "task on core 0" : "loop()",
+             (uint32_t)( (uint64_t)rxbytes * 1000 / ms ),
+             rxreads, rxreads ? rxbytes / rxreads : 0, rxwaits,
+             (uint32_t)( rxbusyus / ( (uint64_t)ms * 10 ) ),
+             (uint32_t)( ( rxbusyus / ms ) % 10 ) ) ;
+}
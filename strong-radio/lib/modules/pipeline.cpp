@@ -0,0 +1,287 @@
+//******************************************************************************************
+// Specialized stream pipelines.                                                           *
+//******************************************************************************************
+// Chunked transfer and ICY metadata are known once the header has been parsed and the     *
+// format of the stream has been detected.  From then on the spans from the ringbuffer     *
+// are handled by a pipeline that is specialized at compile time for that combination,     *
+// so there are no tests on "chunked" or "metaint" per span or per byte.  The plain        *
+// pipeline without metadata is also used for local files, the source makes no             *
+// difference after the ringbuffer.  Only the metadata boundary (once per metaint bytes)   *
+// goes through the generic handlebytes().                                                 *
+// A transport stream (HLS segments) has its own pipeline, see tsdemux.cpp.                *
+// The command "pipebench" compares the specialized pipelines with a per byte loop over    *
+// handlebyte(), the path used before spans were handled.                                  *
+//******************************************************************************************
+#define PIPEBENCHSIZ   16384                   // Payload bytes for the benchmark
+#define PIPEBENCHMETA  4000                    // Metaint for the benchmark
+#define PIPEBENCHLOOP  8                       // Runs per measurement
+
+typedef uint32_t ( *streamfunc_t ) ( uint8_t* p, uint32_t len ) ;
+
+streamfunc_t streamfunc = handlebytes_ch ;     // Handler for the next span from the ringbuffer
+bool         pipemute = false ;                // Do not send to VS1053 (benchmark)
+bool         pipebenchreq = false ;            // Request for benchmark
+
+//******************************************************************************************
+//                                P I P E D A T A                                          *
+//******************************************************************************************
+// Handle a span of payload (no chunk framing).  Returns the number of bytes used.         *
+//******************************************************************************************
+template <bool META> uint32_t pipedata ( uint8_t* p, uint32_t len )
+{
+  uint32_t n ;                                         // Bytes used
+
+  if ( META )                                          // Metadata in stream?
+  {
+    if ( ( datamode != DATA ) ||                       // Yes, metadata block or boundary?
+         ( len >= (uint32_t)datacount ) )
+    {
+      return handlebytes ( p, len ) ;                  // Yes, generic handling
+    }
+    n = playrun ( p, len ) ;                           // No, just audio
+    datacount -= n ;
+    return n ;
+  }
+  return playrun ( p, len ) ;                          // No metadata, all audio
+}
+
+
+//******************************************************************************************
+//                                P I P E L I N E                                          *
+//******************************************************************************************
+// Handle a span from the ringbuffer.  Returns the number of bytes used.                   *
+//******************************************************************************************
+template <bool CHUNKED, bool META> uint32_t pipeline ( uint8_t* p, uint32_t len )
+{
+  const uint8_t* pl ;                                  // Payload in span
+  uint32_t       plen ;                                // Length of payload
+  uint32_t       used ;                                // Bytes used from input span
+  uint32_t       n ;                                   // Bytes used by pipedata
+
+  if ( !( datamode & ( DATA | METADATA ) ) )           // Still playing this stream?
+  {
+    return handlebytes_ch ( p, len ) ;                 // No, generic handling
+  }
+  if ( !CHUNKED )
+  {
+    return pipedata<META> ( p, len ) ;
+  }
+  used = chunkdecode ( &chunkdec, p, len, &pl, &plen ) ;
+  while ( plen )                                       // Handle all of the payload
+  {
+    n = pipedata<META> ( (uint8_t*)pl, plen ) ;
+    pl += n ;
+    plen -= n ;
+  }
+  return used ;
+}
+
+
+//******************************************************************************************
+//                                  P I P E T S                                            *
+//******************************************************************************************
+// Handle a span of a transport stream.  Returns the number of bytes used.                 *
+//******************************************************************************************
+template <bool CHUNKED> uint32_t pipets ( uint8_t* p, uint32_t len )
+{
+  const uint8_t* pl ;                                  // Payload in span
+  uint32_t       plen ;                                // Length of payload
+  uint32_t       used ;                                // Bytes used from input span
+
+  if ( datamode != DATA )                              // Still playing this stream?
+  {
+    return handlebytes_ch ( p, len ) ;                 // No, generic handling
+  }
+  if ( !CHUNKED )
+  {
+    return tsfeed ( &tsdemux, p, len ) ;
+  }
+  used = chunkdecode ( &chunkdec, p, len, &pl, &plen ) ;
+  if ( plen )
+  {
+    tsfeed ( &tsdemux, pl, plen ) ;                    // Uses all of the payload
+  }
+  return used ;
+}
+
+
+//******************************************************************************************
+//                              P I P E S E L E C T                                        *
+//******************************************************************************************
+// Return the pipeline for the current stream.                                             *
+//******************************************************************************************
+streamfunc_t pipeselect()
+{
+  if ( streamfmt == FMT_TS )                           // Transport stream?
+  {
+    return chunked ? pipets<true> : pipets<false> ;    // Yes, no metadata
+  }
+  if ( chunked )
+  {
+    return metaint ? pipeline<true, true> : pipeline<true, false> ;
+  }
+  return metaint ? pipeline<false, true> : pipeline<false, false> ;
+}
+
+
+//******************************************************************************************
+//                                P I P E B Y T E S                                        *
+//******************************************************************************************
+// Handle a span byte by byte with handlebyte().  Reference for the benchmark only.        *
+//******************************************************************************************
+uint32_t pipebytes ( uint8_t* p, uint32_t len )
+{
+  const uint8_t* pl = p ;                              // Payload in span
+  uint32_t       plen = len ;                          // Length of payload
+  uint32_t       used = len ;                          // Bytes used from input span
+
+  if ( chunked )
+  {
+    used = chunkdecode ( &chunkdec, p, len, &pl, &plen ) ;
+  }
+  while ( plen-- )
+  {
+    handlebyte ( *pl++ ) ;                             // One byte at a time
+  }
+  return used ;
+}
+
+
+//******************************************************************************************
+//                             P I P E B E N C H D A T A                                   *
+//******************************************************************************************
+// Fill a buffer with a test stream.  Returns the length.                                  *
+//******************************************************************************************
+uint32_t pipebenchdata ( uint8_t* buf, bool ch, bool meta )
+{
+  uint8_t  icy[1000] ;                                 // One chunk of the ICY stream
+  uint32_t len = 0 ;                                   // Length of stream
+  uint32_t audio = 0 ;                                 // Audio bytes so far
+  uint32_t cnt = PIPEBENCHMETA ;                       // Audio bytes to next metadata
+  uint32_t run ;                                       // Bytes in chunk
+
+  while ( audio < PIPEBENCHSIZ )
+  {
+    run = 0 ;
+    while ( ( run < sizeof(icy) ) && ( audio < PIPEBENCHSIZ ) )
+    {
+      if ( meta && ( cnt == 0 ) )                      // Time for metadata?
+      {
+        icy[run++] = 0 ;                               // Yes, empty metadata block
+        cnt = PIPEBENCHMETA ;
+      }
+      else
+      {
+        icy[run++] = audio++ ;                         // Audio data
+        cnt-- ;
+      }
+    }
+    if ( ch )
+    {
+      len += sprintf ( (char*)buf + len, "%X\r\n", run ) ;
+    }
+    memcpy ( buf + len, icy, run ) ;
+    len += run ;
+    if ( ch )
+    {
+      len += sprintf ( (char*)buf + len, "\r\n" ) ;
+    }
+  }
+  return len ;
+}
+
+
+//******************************************************************************************
+//                              P I P E B E N C H R U N                                    *
+//******************************************************************************************
+// Handle a test stream like loop() does.  Returns the time in microseconds.               *
+//******************************************************************************************
+uint32_t pipebenchrun ( streamfunc_t f, uint8_t* buf, uint32_t len,
+                        bool ch, bool meta )
+{
+  uint32_t t0 ;                                        // Start time
+  uint32_t i ;                                         // Index in stream
+  uint32_t n ;                                         // Span length
+  int      run ;                                       // Loop control
+
+  t0 = micros() ;
+  for ( run = 0 ; run < PIPEBENCHLOOP ; run++ )
+  {
+    datamode = DATA ;                                  // Set up as after the header
+    streamfmt = FMT_MP3 ;                              // Format is known
+    sniffing = false ;
+    bufcnt = 0 ;
+    chunked = ch ;
+    chunkinit ( &chunkdec ) ;
+    metaint = meta ? PIPEBENCHMETA : 0 ;
+    datacount = metaint ;
+    mpeginit ( &mpegsync, false ) ;
+    for ( i = 0 ; i < len ; i += n )
+    {
+      n = len - i ;
+      if ( n > 32 )                                    // Spans like in loop()
+      {
+        n = 32 ;
+      }
+      n = f ( buf + i, n ) ;
+    }
+  }
+  return micros() - t0 ;
+}
+
+
+//******************************************************************************************
+//                                 P I P E B E N C H                                       *
+//******************************************************************************************
+// Compare the per byte path with the specialized pipelines.  Only if the player is        *
+// stopped.  Nothing is sent to the VS1053.                                                *
+//******************************************************************************************
+void pipebench()
+{
+  const char*  names[] = { "plain", "metadata", "chunked", "chunked+metadata" } ;
+  streamfunc_t pipes[] = { pipeline<false, false>, pipeline<false, true>,
+                           pipeline<true, false>, pipeline<true, true> } ;
+  uint8_t*    buf ;                                    // Test stream
+  uint32_t    len ;                                    // Length of test stream
+  uint32_t    tg, ts ;                                 // Time per byte/specialized
+  uint32_t    cg, cs ;                                 // Bytes played per byte/specialized
+  uint32_t    oldtotal = totalcount ;                  // Restored for timer10sec and health
+  int         v ;                                      // Variant
+  bool        ch, meta ;                               // Properties of variant
+
+  if ( datamode != STOPPED )
+  {
+    dbgprint ( "Benchmark needs a stopped player" ) ;
+    return ;
+  }
+  buf = (uint8_t*)malloc ( PIPEBENCHSIZ * 2 ) ;        // Room for framing
+  if ( buf == NULL )
+  {
+    dbgprint ( "No memory for benchmark" ) ;
+    return ;
+  }
+  pipemute = true ;                                    // Do not play the test stream
+  for ( v = 0 ; v < 4 ; v++ )
+  {
+    meta = v & 1 ;
+    ch = v & 2 ;
+    len = pipebenchdata ( buf, ch, meta ) ;
+    totalcount = 0 ;
+    tg = pipebenchrun ( pipebytes, buf, len, ch, meta ) ;
+    cg = totalcount ;
+    totalcount = 0 ;
+    ts = pipebenchrun ( pipes[v], buf, len, ch, meta ) ;
+    cs = totalcount ;
+    dbgprint ( "Pipeline %s: per byte %d usec, specialized %d usec, %d/%d bytes",
+               names[v], tg, ts, cg, cs ) ;
+  }
+  pipemute = false ;
+  free ( buf ) ;
+  datamode = STOPPED ;                                 // Restore state
+  streamfmt = FMT_UNKNOWN ;
+  bufcnt = 0 ;
+  chunked = false ;
+  metaint = 0 ;
+  totalcount = oldtotal ;
+  streamfunc = handlebytes_ch ;
+}
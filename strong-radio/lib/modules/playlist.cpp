@@ -0,0 +1,233 @@
+//******************************************************************************************
+// Cache for .m3u playlists.                                                               *
+//******************************************************************************************
+// The playlist is downloaded and parsed once.  The URLs and the titles from the #EXTINF   *
+// lines are stored in one arena, with a table of offsets per entry.  Selecting another    *
+// entry of the same playlist connects directly to the URL of the entry, the playlist is   *
+// not downloaded again.                                                                   *
+// If the arena or the table is full, the remaining entries are written to a file on       *
+// SPIFFS, one line per entry: "<url><TAB><title>".  If that file cannot be created, the   *
+// failure is latched and the rest of the playlist is dropped.                             *
+//******************************************************************************************
+#define PLARENASIZ     4096                    // Size of arena for URLs and titles
+#define PLMAXENTRIES   128                     // Max entries in memory
+#define PLNOTITLE      0xFFFF                  // Offset if entry has no title
+#define PLSPILLFILE    "/playlist.tmp"         // File for entries that do not fit
+
+char       plarena[PLARENASIZ] ;               // URLs and titles, delimited by NUL
+uint16_t   plarenalen ;                        // Bytes used in arena
+uint16_t   plurl[PLMAXENTRIES] ;               // Offset of URL per entry
+uint16_t   pltitle[PLMAXENTRIES] ;             // Offset of title per entry
+int        plcount ;                           // Number of entries in memory
+int        plspilled ;                         // Number of entries in spill file
+char       pltitlepend[100] ;                  // Title from last #EXTINF line
+bool       plvalid = false ;                   // Cache is complete for "playlist"
+File       plspill ;                           // Spill file while parsing
+bool       plspillfail ;                       // Spill file could not be created
+
+//******************************************************************************************
+//                              P L A Y L I S T I N I T                                    *
+//******************************************************************************************
+// Start parsing a new playlist.                                                           *
+//******************************************************************************************
+void playlistinit()
+{
+  plarenalen = 0 ;
+  plcount = 0 ;
+  plspilled = 0 ;
+  plspillfail = false ;
+  pltitlepend[0] = '\0' ;
+  plvalid = false ;
+}
+
+
+//******************************************************************************************
+//                                P L A R E N A A D D                                      *
+//******************************************************************************************
+// Copy a string into the arena.  Returns the offset.                                      *
+//******************************************************************************************
+uint16_t plarenaadd ( const char* str )
+{
+  uint16_t offset = plarenalen ;               // Offset of this string
+
+  strcpy ( plarena + plarenalen, str ) ;
+  plarenalen += strlen ( str ) + 1 ;
+  return offset ;
+}
+
+
+//******************************************************************************************
+//                                   P L A D D                                             *
+//******************************************************************************************
+// Add an entry to the cache.  Spill to SPIFFS if it does not fit in memory.               *
+//******************************************************************************************
+void pladd ( const char* url, const char* title )
+{
+  size_t need = strlen ( url ) + 1 ;           // Room needed in arena
+
+  if ( *title )
+  {
+    need += strlen ( title ) + 1 ;
+  }
+  if ( ( plspilled == 0 ) &&                   // Still room in memory?
+       ( plcount < PLMAXENTRIES ) &&
+       ( ( plarenalen + need ) <= PLARENASIZ ) )
+  {
+    plurl[plcount] = plarenaadd ( url ) ;      // Yes, store entry in memory
+    pltitle[plcount] = *title ? plarenaadd ( title ) : PLNOTITLE ;
+    plcount++ ;
+    return ;
+  }
+  if ( plspillfail )                           // No spill file?
+  {
+    return ;                                   // No, entry is dropped
+  }
+  if ( plspilled == 0 )                        // First entry to spill?
+  {
+    plspill = SPIFFS.open ( PLSPILLFILE, "w" ) ;
+    if ( !plspill )
+    {
+      dbgprint ( "Playlist too large, cannot create %s, rest dropped", PLSPILLFILE ) ;
+      plspillfail = true ;                     // Do not try again for every entry
+      return ;
+    }
+    dbgprint ( "Playlist too large, spill to %s", PLSPILLFILE ) ;
+  }
+  plspill.printf ( "%s\t%s\n", url, title ) ;
+  plspilled++ ;
+}
+
+
+//******************************************************************************************
+//                              P L A Y L I S T L I N E                                    *
+//******************************************************************************************
+// Handle a line of the playlist.                                                          *
+//******************************************************************************************
+void playlistline ( const char* line )
+{
+  const char* p ;                              // Pointer in line
+
+  if ( strncmp ( line, "#EXTINF:", 8 ) == 0 )  // Info?
+  {
+    if ( ( p = strchr ( line, ',' ) ) )        // Comma in this line?
+    {
+      strncpy ( pltitlepend, p + 1, sizeof(pltitlepend) ) ;
+      pltitlepend[sizeof(pltitlepend) - 1] = '\0' ;
+    }
+    return ;
+  }
+  if ( *line == '#' )                          // Commentline?
+  {
+    return ;                                   // Ignore commentlines
+  }
+  if ( ( p = strstr ( line, "http://" ) ) )    // Does URL contain "http://"?
+  {
+    line = p + 7 ;                             // Yes, remove it
+  }
+  pladd ( line, pltitlepend ) ;
+  dbgprint ( "Entry %d in playlist found: %s", plcount + plspilled, line ) ;
+  pltitlepend[0] = '\0' ;                      // Title is used
+}
+
+
+//******************************************************************************************
+//                            P L A Y L I S T E N T R Y                                    *
+//******************************************************************************************
+// Get URL and title of entry num of the cached playlist.  Returns false if there is no    *
+// such entry.                                                                             *
+//******************************************************************************************
+bool playlistentry ( int num, String* url, String* title )
+{
+  File   f ;                                   // Spill file
+  String line ;                                // Line from spill file
+  int    inx ;                                 // Position of TAB
+  int    i ;                                   // Loop control
+
+  if ( ( num < 1 ) || ( num > ( plcount + plspilled ) ) )
+  {
+    return false ;
+  }
+  if ( num <= plcount )                        // Entry in memory?
+  {
+    i = num - 1 ;
+    *url = plarena + plurl[i] ;                // Yes, copy from arena
+    *title = ( pltitle[i] != PLNOTITLE ) ? plarena + pltitle[i] : "" ;
+    return true ;
+  }
+  f = SPIFFS.open ( PLSPILLFILE, "r" ) ;       // Search in spill file
+  if ( !f )
+  {
+    dbgprint ( "Cannot open %s", PLSPILLFILE ) ;
+    return false ;                             // Spill file has gone
+  }
+  for ( i = plcount ; ( i < num ) && f.available() ; i++ )
+  {
+    line = f.readStringUntil ( '\n' ) ;
+  }
+  f.close() ;
+  inx = line.indexOf ( "\t" ) ;
+  if ( ( i < num ) || ( inx == 0 ) || ( line.length() == 0 ) ) // Entry not in file?
+  {
+    return false ;                             // Yes, no URL for it
+  }
+  *url = line.substring ( 0, inx ) ;
+  *title = ( inx >= 0 ) ? line.substring ( inx + 1 ) : "" ;
+  return true ;
+}
+
+
+//******************************************************************************************
+//                               P L A Y L I S T G O                                       *
+//******************************************************************************************
+// Connect to entry playlist_num of the cached playlist.                                   *
+//******************************************************************************************
+bool playlistgo()
+{
+  String title ;                               // Title of entry
+  bool   res ;                                 // Result of connect
+
+  if ( !playlistentry ( playlist_num, &host, &title ) )
+  {
+    dbgprint ( "Entry %d not in playlist", playlist_num ) ;
+    playlist_num = 0 ;                         // End of playlist
+    datamode = STOPREQD ;                      // Stop player
+    return false ;
+  }
+  if ( title.length() )
+  {
+    showstreamtitle ( title.c_str() ) ;        // Show artist and title
+  }
+  dbgprint ( "Entry %d of playlist: %s", playlist_num, host.c_str() ) ;
+  res = connecttohost() ;                      // Connect to it
+  host = playlist ;                            // Back to the .m3u host
+  return res ;
+}
+
+
+//******************************************************************************************
+//                              P L A Y L I S T P O L L                                    *
+//******************************************************************************************
+// Called from loop().  If the playlist has been read completely, the cache is valid and   *
+// the requested entry is started.                                                         *
+//******************************************************************************************
+void playlistpoll()
+{
+  if ( ( datamode != PLAYLISTDATA ) ||         // Reading playlist?
+       ringavail() ||                          // And all data handled?
+       ( mp3client && mp3client->connected() ) )
+  {
+    return ;                                   // No, not complete yet
+  }
+  if ( metaline.length() )                     // Last line without linefeed?
+  {
+    handlebyte ( '\n' ) ;                      // Yes, handle it
+  }
+  if ( plspilled )
+  {
+    plspill.close() ;
+  }
+  plvalid = true ;                             // Cache is complete
+  dbgprint ( "Playlist has %d entries, %d in memory, %d bytes",
+             plcount + plspilled, plcount, plarenalen ) ;
+  playlistgo() ;
+}
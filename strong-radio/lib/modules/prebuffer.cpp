@@ -0,0 +1,202 @@
+//******************************************************************************************
+// Prebuffer routines.                                                                     *
+//******************************************************************************************
+// After the header of a stream has been handled, playback is held until the ringbuffer    *
+// contains enough data for a target time at the bitrate of the stream.  The target is     *
+// kept per preset.  Every underrun (decoder wants data, ringbuffer is empty) raises the   *
+// target of the current preset by 50% and starts a new prebuffer phase.  After 5 minutes  *
+// without underrun the target is lowered by 10%, so a good station will get a short       *
+// start-up time again.  With "prebuffer = 0" playback starts at once, the first underrun  *
+// raises the target to PREBUFMIN.                                                         *
+// prebuffering is released by the feeder task in prebufready() and set again by loop() in *
+// prebufunderrun(), the latter takes feedlock.  The feeder does not use mp3client, the    *
+// end of the connection is taken from rxeof, set by the producer of the ringbuffer.       *
+//******************************************************************************************
+#define PREBUFMIN      250                     // Minimal target in msec
+#define PREBUFMAX      30000                   // Maximal target in msec
+#define PREBUFSTABLE   300000                  // Time without underrun to lower the target
+
+uint16_t   prebuftarget[MAXPRESETS + 1] ;      // Target per preset in msec, 0 is not used yet
+uint16_t   prebufttfa[MAXPRESETS + 1] ;        // Last time to first audio per preset in msec
+bool       prebuffering = false ;              // True if playback is held
+bool       prebuffirst = false ;               // True if first audio not yet played
+uint32_t   prebufstamp ;                       // Time of connect to host
+uint32_t   prebufok ;                          // Time of last underrun or target change
+
+//******************************************************************************************
+//                               P R E B U F S L O T                                       *
+//******************************************************************************************
+// Return the index in the prebuffer tables for the current preset.  Stations that are     *
+// not a preset (station command) share the last entry.                                    *
+//******************************************************************************************
+int prebufslot()
+{
+  if ( ( currentpreset >= 0 ) && ( currentpreset < MAXPRESETS ) )
+  {
+    return currentpreset ;
+  }
+  return MAXPRESETS ;
+}
+
+
+//******************************************************************************************
+//                             P R E B U F T A R G E T                                     *
+//******************************************************************************************
+// Return the current target of the prebuffer in msec.                                     *
+//******************************************************************************************
+uint16_t prebuftargetms()
+{
+  int slot = prebufslot() ;                           // Index in table
+
+  if ( prebuftarget[slot] == 0 )                      // Not initialized yet?
+  {
+    prebuftarget[slot] = ini_block.prebuffer ;        // Yes, start with the default
+  }
+  return prebuftarget[slot] ;
+}
+
+
+//******************************************************************************************
+//                              P R E B U F S T A R T                                      *
+//******************************************************************************************
+// Called on connect to a new host.  Playback will be held until the target is reached.    *
+//******************************************************************************************
+void prebufstart()
+{
+  prebuffering = true ;                               // Hold playback
+  prebuffirst = true ;                                // Time to first audio not known yet
+  prebufstamp = millis() ;                            // For time to first audio
+  prebufok = prebufstamp ;                            // Stable period starts now
+}
+
+
+//******************************************************************************************
+//                              P R E B U F R E A D Y                                      *
+//******************************************************************************************
+// Return true if data from the ringbuffer may be sent to the decoder.                     *
+// Header and playlist data and the first bytes for format detection are never held.       *
+//******************************************************************************************
+bool prebufready()
+{
+  uint32_t target ;                                   // Target in bytes
+  int      br = bitrate ;                             // Bitrate in kb/sec
+
+  if ( !prebuffering || localfile || sniffing ||      // Hold playback?
+       !( datamode & ( DATA | METADATA ) ) )
+  {
+    return true ;                                     // No, go ahead
+  }
+  if ( br == 0 )                                      // Bitrate known?
+  {
+    br = 128 ;                                        // No, assume 128 kb/sec
+  }
+  target = (uint32_t)prebuftargetms() * br / 8 ;      // Bytes for target time
+  if ( target > ( ringbfsiz / 4 * 3 ) )               // Limit to 3/4 of the ringbuffer
+  {
+    target = ringbfsiz / 4 * 3 ;
+  }
+  if ( ( ringavail() < target ) && !rxeof )           // Target reached or no more data?
+  {
+    return false ;                                    // No, keep on buffering
+  }
+  prebuffering = false ;                              // Release playback
+  if ( prebuffirst )                                  // First audio for this connection?
+  {
+    prebuffirst = false ;
+    prebufttfa[prebufslot()] = millis() - prebufstamp ;
+    dbgprint ( "Prebuffer %d bytes, target %d msec, first audio after %d msec",
+               ringavail(), prebuftargetms(), prebufttfa[prebufslot()] ) ;
+    zapfirstaudio() ;                                 // End of station switch
+  }
+  return true ;
+}
+
+
+//******************************************************************************************
+//                            P R E B U F U N D E R R U N                                  *
+//******************************************************************************************
+// Called if the decoder needs data, but the ringbuffer is empty.  Raise the target for    *
+// this preset and hold playback until the new target is reached.                          *
+//******************************************************************************************
+void prebufunderrun()
+{
+  int      slot = prebufslot() ;                      // Index in table
+  uint32_t t ;                                        // New target
+
+  if ( !( datamode & ( DATA | METADATA ) ) )          // Playing a stream?
+  {
+    return ;                                          // No, do not bother the feeder
+  }
+  xSemaphoreTake ( feedlock, portMAX_DELAY ) ;        // Feeder must not release now
+  if ( prebuffering || localfile ||                   // Already waiting or playing a file?
+       !( datamode & ( DATA | METADATA ) ) )
+  {
+    xSemaphoreGive ( feedlock ) ;
+    return ;                                          // Yes, not an underrun
+  }
+  t = prebuftargetms() ;
+  t += t / 2 ;                                        // Raise target by 50%
+  if ( t < PREBUFMIN )                                // Target was 0 or very small?
+  {
+    t = PREBUFMIN ;                                   // Yes, start adapting here
+  }
+  if ( t > PREBUFMAX )
+  {
+    t = PREBUFMAX ;
+  }
+  prebuftarget[slot] = t ;
+  prebuffering = true ;                               // Hold playback again
+  prebufok = millis() ;                               // Start of new stable period
+  xSemaphoreGive ( feedlock ) ;
+  dbgprint ( "Underrun, prebuffer target now %d msec", t ) ;
+}
+
+
+//******************************************************************************************
+//                              P R E B U F A D A P T                                      *
+//******************************************************************************************
+// Lower the target if there was no underrun for a long time.  Called every 10 seconds.    *
+//******************************************************************************************
+void prebufadapt()
+{
+  int      slot = prebufslot() ;                      // Index in table
+  uint32_t t ;                                        // New target
+
+  if ( prebuffering || !( datamode & ( DATA | METADATA ) ) )
+  {
+    return ;                                          // Only while playing
+  }
+  if ( ( millis() - prebufok ) > PREBUFSTABLE )       // Stable for a long time?
+  {
+    t = prebuftargetms() ;
+    t -= t / 10 ;                                     // Yes, lower target by 10%
+    if ( t < PREBUFMIN )
+    {
+      t = PREBUFMIN ;
+    }
+    prebuftarget[slot] = t ;
+    prebufok = millis() ;                             // Start of new stable period
+  }
+}
+
+
+//******************************************************************************************
+//                              P R E B U F I N F O                                        *
+//******************************************************************************************
+// Format the target and last time to first audio of all presets that have been played.    *
+//******************************************************************************************
+void prebufinfo ( char* reply, size_t len )
+{
+  int    i ;                                          // Loop control
+  size_t n ;                                          // Length of reply so far
+
+  n = snprintf ( reply, len, "Prebuffer target/first audio in msec:" ) ;
+  for ( i = 0 ; ( i <= MAXPRESETS ) && ( n < len ) ; i++ )
+  {
+    if ( prebufttfa[i] )                              // Played this preset?
+    {
+      n += snprintf ( reply + n, len - n, " %02d:%d/%d", i,
+                      prebuftarget[i], prebufttfa[i] ) ;
+    }
+  }
+}
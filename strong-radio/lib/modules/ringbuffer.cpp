@@ -1,21 +1,88 @@
 //******************************************************************************************
 // Ringbuffer (fifo) routines.                                                             *
 //******************************************************************************************
+// Besides the byte-at-a-time putring()/getring() there is a span interface.  The caller   *
+// asks for the largest contiguous writable (or readable) region, moves as many bytes as   *
+// it likes with a single read(buf,len) or playChunk() and then commits the number of      *
+// bytes actually transferred.  A region never wraps, so at the end of the buffer two      *
+// calls may be needed to move all data.                                                   *
+//                                                                                         *
+// The ringbuffer is a lock-free single producer/single consumer queue.  Only the producer *
+// writes rbwindex, only the consumer writes rbrindex, there is no shared byte count.      *
+// The producer publishes data with a release store of rbwindex, the consumer returns      *
+// space with a release store of rbrindex.  So the producer may run in a task on one core  *
+// and the consumer in a task on the other core without a mutex.                           *
+// One byte is always left free to tell a full buffer from an empty one.                   *
+// putring(), ringspace(), ringwspan() and ringwcommit() are for the producer only.        *
+// getring(), ringrspan(), ringrcommit() and emptyring() are for the consumer only.        *
+// ringavail() may be called from both sides.                                              *
+// The size of the buffer is set by "buffersize" in the .ini file, see allocring().        *
 //******************************************************************************************
-//                              R I N G S P A C E                                          *
 //******************************************************************************************
-inline bool ringspace()
+//                              A L L O C R I N G                                          *
+//******************************************************************************************
+// Allocate the ringbuffer.  The requested size comes from the .ini file.  If PSRAM is     *
+// present the buffer will be placed there, otherwise in internal RAM.  If the allocation  *
+// fails, the size is halved until it succeeds.  The actual size is set in ringbfsiz.      *
+// 4 extra bytes are allocated, because SPI.writeBytes() reads whole 32 bit words.         *
+//******************************************************************************************
+void allocring ( uint32_t reqsize )
 {
-  return ( rcount < RINGBFSIZ ) ;     // True is at least one byte of free space is available
+  ringpsram = psramFound() ;                           // Use PSRAM if available
+  if ( reqsize < RINGBFSIZ )                           // Sensible size?
+  {
+    reqsize = RINGBFSIZ ;                              // No, use the default
+  }
+  ringbuf = NULL ;
+  for ( ringbfsiz = reqsize ; ringbfsiz >= RINGBFSIZ ; ringbfsiz /= 2 )
+  {
+    if ( ringpsram )
+    {
+      ringbuf = (uint8_t *) ps_malloc ( ringbfsiz + 4 ) ; // Try to get it from PSRAM
+    }
+    else
+    {
+      ringbuf = (uint8_t *) malloc ( ringbfsiz + 4 ) ;  // Try to get it from internal RAM
+    }
+    if ( ringbuf )
+    {
+      break ;                                          // Success
+    }
+  }
+  if ( ringbuf == NULL )                               // Still nothing?
+  {
+    ringpsram = false ;                                // Last resort: default in internal RAM
+    ringbfsiz = RINGBFSIZ ;
+    ringbuf = (uint8_t *) malloc ( ringbfsiz + 4 ) ;
+  }
+  dbgprint ( "Ringbuffer %u bytes in %s (requested %u)",
+             ringbfsiz, ringpsram ? "PSRAM" : "internal RAM",
+             reqsize ) ;
 }
 
 
 //******************************************************************************************
 //                              R I N G A V A I L                                          *
 //******************************************************************************************
-inline uint16_t ringavail()
+inline uint32_t ringavail()
 {
-  return rcount ;                     // Return number of bytes available
+  uint32_t w = rbwindex.load ( std::memory_order_acquire ) ;
+  uint32_t r = rbrindex.load ( std::memory_order_acquire ) ;
+
+  if ( w >= r )
+  {
+    return w - r ;                    // Return number of bytes available
+  }
+  return ringbfsiz - r + w ;          // Data wraps around the end
+}
+
+
+//******************************************************************************************
+//                              R I N G S P A C E                                          *
+//******************************************************************************************
+inline bool ringspace()
+{
+  return ( ringavail() < ( ringbfsiz - 1 ) ) ; // True is at least one byte of free space
 }
 
 
@@ -24,13 +91,15 @@ inline uint16_t ringavail()
 //******************************************************************************************
 void putring ( uint8_t b )                 // Put one byte in the ringbuffer
 {
+  uint32_t w = rbwindex.load ( std::memory_order_relaxed ) ;
+
   // No check on available space.  See ringspace()
-  *(ringbuf + rbwindex) = b ;         // Put byte in ringbuffer
-  if ( ++rbwindex == RINGBFSIZ )      // Increment pointer and
+  *(ringbuf + w) = b ;                // Put byte in ringbuffer
+  if ( ++w == ringbfsiz )             // Increment pointer and
   {
-    rbwindex = 0 ;                    // wrap at end
+    w = 0 ;                           // wrap at end
   }
-  rcount++ ;                          // Count number of bytes in the
+  rbwindex.store ( w, std::memory_order_release ) ; // Publish the byte
 }
 
 
@@ -39,44 +108,115 @@ void putring ( uint8_t b )                 // Put one byte in the ringbuffer
 //******************************************************************************************
 uint8_t getring()
 {
+  uint32_t r = rbrindex.load ( std::memory_order_relaxed ) ;
+  uint8_t  b ;                        // Byte to return
+
   // Assume there is always something in the bufferpace.  See ringavail()
-  if ( ++rbrindex == RINGBFSIZ )      // Increment pointer and
+  b = *(ringbuf + r) ;                // Get the oldest byte
+  if ( ++r == ringbfsiz )             // Increment pointer and
   {
-    rbrindex = 0 ;                    // wrap at end
+    r = 0 ;                           // wrap at end
   }
-  rcount-- ;                          // Count is now one less
-  return *(ringbuf + rbrindex) ;      // return the oldest byte
+  rbrindex.store ( r, std::memory_order_release ) ; // Release the space
+  return b ;                          // return the oldest byte
 }
 
+
 //******************************************************************************************
-//                               E M P T Y R I N G                                         *
+//                              R I N G W S P A N                                          *
 //******************************************************************************************
-void emptyring()
+// Return the number of contiguous bytes that may be written at *p.                        *
+// Zero if the ringbuffer is full.                                                         *
+//******************************************************************************************
+uint32_t ringwspan ( uint8_t** p )
+{
+  uint32_t w = rbwindex.load ( std::memory_order_relaxed ) ;
+  uint32_t r = rbrindex.load ( std::memory_order_acquire ) ;
+  uint32_t len ;                      // Contiguous free space
+
+  if ( r > w )
+  {
+    len = r - w - 1 ;                 // Free space up to the oldest byte
+  }
+  else
+  {
+    len = ringbfsiz - w ;             // Free space up to the end of the buffer
+    if ( r == 0 )
+    {
+      len-- ;                         // Keep one byte free
+    }
+  }
+  *p = ringbuf + w ;                  // Place to start writing
+  return len ;
+}
+
+
+//******************************************************************************************
+//                            R I N G W C O M M I T                                        *
+//******************************************************************************************
+// Mark n bytes at the span returned by ringwspan() as filled.                             *
+//******************************************************************************************
+void ringwcommit ( uint32_t n )
 {
-  rbwindex = 0 ;                      // Reset ringbuffer administration
-  rbrindex = RINGBFSIZ - 1 ;
-  rcount = 0 ;
+  uint32_t w = rbwindex.load ( std::memory_order_relaxed ) + n ;
+
+  if ( w == ringbfsiz )               // At the end?
+  {
+    w = 0 ;                           // Yes, wrap
+  }
+  rbwindex.store ( w, std::memory_order_release ) ; // Publish the new bytes
 }
 
+
+//******************************************************************************************
+//                              R I N G R S P A N                                          *
 //******************************************************************************************
-//                             G E T E N C R Y P T I O N T Y P E                           *
+// Return the number of contiguous bytes that may be read at *p.                           *
+// Zero if the ringbuffer is empty.                                                        *
 //******************************************************************************************
-// Read the encryption type of the network and return as a 4 byte name                     *
-//*********************4********************************************************************
-const char* getEncryptionType ( int thisType )
+uint32_t ringrspan ( uint8_t** p )
 {
-  switch (thisType)
+  uint32_t r = rbrindex.load ( std::memory_order_relaxed ) ;
+  uint32_t w = rbwindex.load ( std::memory_order_acquire ) ;
+  uint32_t len ;                      // Contiguous data
+
+  if ( w >= r )
+  {
+    len = w - r ;                     // Data up to the fill pointer
+  }
+  else
   {
-    case ENC_TYPE_WEP:
-      return "WEP " ;
-    case ENC_TYPE_TKIP:
-      return "WPA " ;
-    case ENC_TYPE_CCMP:
-      return "WPA2" ;
-    case ENC_TYPE_NONE:
-      return "None" ;
-    case ENC_TYPE_AUTO:
-      return "Auto" ;
+    len = ringbfsiz - r ;             // Data up to the end of the buffer
   }
-  return "????" ;
+  *p = ringbuf + r ;                  // Oldest byte in the buffer
+  return len ;
+}
+
+
+//******************************************************************************************
+//                            R I N G R C O M M I T                                        *
+//******************************************************************************************
+// Release n bytes of the span returned by ringrspan().                                    *
+//******************************************************************************************
+void ringrcommit ( uint32_t n )
+{
+  uint32_t r = rbrindex.load ( std::memory_order_relaxed ) + n ;
+
+  if ( r == ringbfsiz )               // At the end?
+  {
+    r = 0 ;                           // Yes, wrap
+  }
+  rbrindex.store ( r, std::memory_order_release ) ; // Return the space to the producer
+}
+
+
+//******************************************************************************************
+//                               E M P T Y R I N G                                         *
+//******************************************************************************************
+// Discard all data in the ringbuffer.  Consumer side, so the producer may keep running.   *
+//******************************************************************************************
+void emptyring()
+{
+  rbrindex.store ( rbwindex.load ( std::memory_order_acquire ),
+                   std::memory_order_release ) ;
 }
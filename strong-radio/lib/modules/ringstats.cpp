@@ -0,0 +1,121 @@
+//******************************************************************************************
+// Ringbuffer statistics.                                                                  *
+//******************************************************************************************
+// Continuous instrumentation of the ringbuffer while playing:                             *
+//  - A histogram of the fill level in steps of 10%, sampled every 100 msec.               *
+//  - The minimal fill level (watermark) per minute.                                       *
+//  - The number of underruns: VS1053 requests data while the ringbuffer is empty.         *
+//  - The number of overflows: input is available but the ringbuffer is full.              *
+// Shown by the command "ringstat", also through the webinterface as "/?ringstat".         *
+// "ringstat=reset" clears the statistics.                                                 *
+//******************************************************************************************
+#define RINGHISTSIZ 10                         // Number of buckets in histogram
+
+uint32_t   ringhist[RINGHISTSIZ] ;             // Histogram of fill level
+uint32_t   ringminfill ;                       // Minimal fill level in current minute
+uint32_t   ringminlast ;                       // Minimal fill level in last complete minute
+uint32_t   ringunderruns = 0 ;                 // Number of underruns
+uint32_t   ringoverflows = 0 ;                 // Number of overflows (backpressure)
+bool       ringstarving = false ;              // Underrun in progress
+
+//******************************************************************************************
+//                            R I N G S T A T R E S E T                                    *
+//******************************************************************************************
+void ringstatreset()
+{
+  memset ( ringhist, 0, sizeof(ringhist) ) ;          // Clear histogram
+  ringminfill = ringbfsiz ;                           // No minimum yet
+  ringminlast = ringbfsiz ;
+  ringunderruns = 0 ;                                 // Clear counters
+  ringoverflows = 0 ;
+  ringstarving = false ;
+}
+
+
+//******************************************************************************************
+//                           R I N G S T A T S A M P L E                                   *
+//******************************************************************************************
+// Update the watermark.  Called from loop() after the VS1053 has been fed.                *
+//******************************************************************************************
+void ringstatsample()
+{
+  uint32_t fill = ringavail() ;                       // Current fill level
+
+  if ( fill )
+  {
+    ringstarving = false ;                            // Data again, underrun has ended
+  }
+  if ( ( datamode & ( DATA | METADATA ) ) &&          // Only while playing
+       ( fill < ringminfill ) )
+  {
+    ringminfill = fill ;                              // New minimum
+  }
+}
+
+
+//******************************************************************************************
+//                          R I N G S T A T U N D E R R U N                                *
+//******************************************************************************************
+// Called if the VS1053 needs data and the ringbuffer is empty.  Counted once per period   *
+// of starvation.                                                                          *
+//******************************************************************************************
+void ringstatunderrun()
+{
+  if ( ( datamode & ( DATA | METADATA ) ) && !ringstarving )
+  {
+    ringstarving = true ;                             // Do not count again until data seen
+    ringunderruns++ ;
+  }
+}
+
+
+//******************************************************************************************
+//                              R I N G S T A T T I C K                                    *
+//******************************************************************************************
+// Called every 100 msec from timer100().  Update the histogram and the minute watermark.  *
+//******************************************************************************************
+void ringstattick()
+{
+  static uint16_t count = 0 ;                         // Counts 100 msec ticks to one minute
+  uint32_t        inx ;                               // Index in histogram
+
+  if ( datamode & ( DATA | METADATA ) )               // Only while playing
+  {
+    inx = (uint64_t)ringavail() * RINGHISTSIZ / ringbfsiz ;
+    if ( inx >= RINGHISTSIZ )                         // Buffer (almost) full?
+    {
+      inx = RINGHISTSIZ - 1 ;                         // Yes, use the last bucket
+    }
+    ringhist[inx]++ ;
+  }
+  if ( ++count == 600 )                               // Minute over?
+  {
+    count = 0 ;
+    ringminlast = ringminfill ;                       // Save watermark of this minute
+    ringminfill = ringbfsiz ;                         // Start a new minute
+  }
+}
+
+
+//******************************************************************************************
+//                              R I N G S T A T I N F O                                    *
+//******************************************************************************************
+// Format the statistics for the "ringstat" command.                                       *
+//******************************************************************************************
+void ringstatinfo ( char* reply, size_t len )
+{
+  int    i ;                                          // Loop control
+  size_t n ;                                          // Length of reply so far
+
+  n = snprintf ( reply, len, "Fill histogram (10%% steps):" ) ;
+  for ( i = 0 ; ( i < RINGHISTSIZ ) && ( n < len ) ; i++ )
+  {
+    n += snprintf ( reply + n, len - n, " %u", ringhist[i] ) ;
+  }
+  if ( n < len )
+  {
+    snprintf ( reply + n, len - n, ", min fill last minute %u, this minute %u, "
+               "underruns %u, overflows %u",
+               ringminlast, ringminfill, ringunderruns, ringoverflows ) ;
+  }
+}
@@ -0,0 +1,296 @@
+//******************************************************************************************
+// Stream format detection.                                                                *
+//******************************************************************************************
+// The first bytes of the DATA stream are collected and inspected together with the        *
+// content-type from the header.  The stream is classified as MP3, AAC (ADTS), Ogg         *
+// Vorbis, Ogg Opus, FLAC, MPEG-TS (HLS segments) or unsupported.  Then the VS1053 path is *
+// set up for the format.                                                                  *
+// FLAC needs a plugin, it is loaded from SPIFFS file "/flac.plg" (the plugin from VLSI,   *
+// converted to binary: 16 bit words, little endian).                                      *
+// Unsupported content (like a HTML error page) is rejected at once, there is no need to   *
+// wait for the watchdog.                                                                  *
+//******************************************************************************************
+#define SNIFFSIZ       64                      // Max bytes to collect for detection
+#define FLACPLUGIN     "/flac.plg"             // Plugin for FLAC on SPIFFS
+
+enum streamfmt_t { FMT_UNKNOWN, FMT_MP3, FMT_AAC,          // Formats of the stream
+                   FMT_VORBIS, FMT_OPUS, FMT_FLAC, FMT_TS, FMT_BAD
+                 } ;
+
+const char*  fmtnames[] = { "unknown", "MP3", "AAC", "Ogg Vorbis",
+                            "Ogg Opus", "FLAC", "MPEG-TS", "unsupported"
+                          } ;
+
+streamfmt_t  streamfmt = FMT_UNKNOWN ;         // Format of current stream
+streamfmt_t  sniffprev = FMT_UNKNOWN ;         // Format of previous entry if gapless
+bool         sniffing = false ;                // True if collecting first bytes
+__attribute__((aligned(4))) uint8_t sniffbuf[SNIFFSIZ] ; // First bytes of the stream
+uint8_t      sniffcnt ;                        // Number of bytes in sniffbuf
+bool         flacloaded = false ;              // FLAC plugin is in the VS1053
+
+//******************************************************************************************
+//                                S N I F F S T A R T                                      *
+//******************************************************************************************
+// Start detection for a new stream.  Returns false if the header already shows that the   *
+// content cannot be played, like a HTML error page.                                       *
+//******************************************************************************************
+bool sniffstart()
+{
+  sniffing = true ;                            // Collect first bytes
+  sniffcnt = 0 ;
+  streamfmt = FMT_UNKNOWN ;
+  sniffprev = FMT_UNKNOWN ;                    // Decoder is idle, see gaplessswitch()
+  if ( ( streamhdr.status >= 400 ) ||          // Error from server?
+       ( strncmp ( streamhdr.contenttype, "text/", 5 ) == 0 ) )
+  {
+    dbgprint ( "Rejected, status %d, content-type %s",
+               streamhdr.status, streamhdr.contenttype ) ;
+    sniffing = false ;
+    streamfmt = FMT_BAD ;
+    return false ;
+  }
+  return true ;
+}
+
+
+//******************************************************************************************
+//                             S N I F F C O N T E N T                                     *
+//******************************************************************************************
+// Format according to the content-type in the header.                                     *
+//******************************************************************************************
+streamfmt_t sniffcontent()
+{
+  const char* ct = streamhdr.contenttype ;     // Content-type, lower case
+
+  if ( strstr ( ct, "mpeg" ) )
+  {
+    return FMT_MP3 ;                           // Like "audio/mpeg"
+  }
+  if ( strstr ( ct, "aac" ) )
+  {
+    return FMT_AAC ;                           // Like "audio/aac" or "audio/aacp"
+  }
+  if ( strstr ( ct, "flac" ) )
+  {
+    return FMT_FLAC ;
+  }
+  if ( strstr ( ct, "mp2t" ) )
+  {
+    return FMT_TS ;                            // Like "video/mp2t"
+  }
+  if ( strstr ( ct, "opus" ) )
+  {
+    return FMT_OPUS ;
+  }
+  if ( strstr ( ct, "ogg" ) )
+  {
+    return FMT_VORBIS ;                        // Most Ogg streams are Vorbis
+  }
+  return FMT_UNKNOWN ;
+}
+
+
+//******************************************************************************************
+//                            S N I F F C L A S S I F Y                                    *
+//******************************************************************************************
+// Classify the stream by the first n bytes.  Returns FMT_UNKNOWN if more bytes are        *
+// needed.  If final is set, no more bytes will come and the content-type is used.         *
+//******************************************************************************************
+streamfmt_t sniffclassify ( const uint8_t* p, uint8_t n, bool final )
+{
+  uint8_t    i = 0 ;                           // Index of first non-space
+  uint16_t   pkt ;                             // Start of first Ogg packet
+  mpegsync_t m ;                               // For check of MPEG header
+
+  while ( ( i < n ) && isspace ( p[i] ) )      // Skip leading white space
+  {
+    i++ ;
+  }
+  if ( ( i < n ) && ( p[i] == '<' ) )          // Start of HTML or XML?
+  {
+    return FMT_BAD ;
+  }
+  if ( n >= 4 )
+  {
+    if ( memcmp ( p, "ID3", 3 ) == 0 )         // ID3 tag, MP3 follows
+    {
+      if ( sniffcontent() == FMT_AAC )         // Unless it is a HLS AAC segment
+      {
+        return FMT_AAC ;
+      }
+      return FMT_MP3 ;
+    }
+    if ( memcmp ( p, "fLaC", 4 ) == 0 )        // FLAC stream marker
+    {
+      return FMT_FLAC ;
+    }
+    if ( ( p[0] == 0xFF ) &&                   // ADTS sync, layer 0?
+         ( ( p[1] & 0xF6 ) == 0xF0 ) )
+    {
+      return FMT_AAC ;
+    }
+    if ( ( p[0] == 0x47 ) &&                   // Transport stream sync?
+         ( hlsactive || ( sniffcontent() == FMT_TS ) ) )
+    {
+      return FMT_TS ;
+    }
+    mpeginit ( &m, true ) ;
+    if ( mpegframe ( &m, ( p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3] ) )
+    {
+      return FMT_MP3 ;                         // Valid MPEG audio frame header
+    }
+    if ( memcmp ( p, "OggS", 4 ) == 0 )        // Ogg page?
+    {
+      if ( n < 27 )
+      {
+        return final ? FMT_VORBIS : FMT_UNKNOWN ;
+      }
+      pkt = 27 + p[26] ;                       // Skip page header and segment table
+      if ( ( pkt + 8 ) > n )
+      {
+        return final ? FMT_VORBIS : FMT_UNKNOWN ;
+      }
+      if ( memcmp ( p + pkt, "OpusHead", 8 ) == 0 )
+      {
+        return FMT_OPUS ;
+      }
+      return FMT_VORBIS ;                      // Should be "\x01vorbis"
+    }
+  }
+  if ( final )                                 // No more data?
+  {
+    return sniffcontent() ;                    // Yes, trust the content-type
+  }
+  return FMT_UNKNOWN ;
+}
+
+
+//******************************************************************************************
+//                              L O A D P L U G I N                                        *
+//******************************************************************************************
+// Load a plugin for the VS1053 from SPIFFS.                                               *
+//******************************************************************************************
+bool loadplugin ( const char* path )
+{
+  File     f ;                                 // Plugin file
+  size_t   len ;                               // Length of file
+  uint8_t* p ;                                 // Plugin in memory
+
+  f = SPIFFS.open ( path, "r" ) ;
+  if ( !f )
+  {
+    dbgprint ( "Plugin %s not found", path ) ;
+    return false ;
+  }
+  len = f.size() ;
+  p = (uint8_t*)malloc ( len ) ;
+  if ( p == NULL )
+  {
+    dbgprint ( "No memory for plugin %s", path ) ;
+    f.close() ;
+    return false ;
+  }
+  f.read ( p, len ) ;
+  f.close() ;
+  vs1053player.loadPlugin ( (uint16_t*)p, len / 2 ) ;
+  free ( p ) ;
+  dbgprint ( "Plugin %s loaded, %d bytes", path, len ) ;
+  return true ;
+}
+
+
+//******************************************************************************************
+//                                S N I F F S E T U P                                      *
+//******************************************************************************************
+// Set up the VS1053 path for the detected format.  Returns false if it cannot be played.  *
+//******************************************************************************************
+bool sniffsetup ( streamfmt_t fmt )
+{
+  dbgprint ( "Stream format is %s", fmtnames[fmt] ) ;
+  switch ( fmt )
+  {
+    case FMT_UNKNOWN :                         // Unknown, try as MP3
+    case FMT_MP3 :
+      mpeginit ( &mpegsync, true ) ;           // Start on a frame boundary
+      return true ;
+    case FMT_AAC :                             // Decoded by the VS1053 itself
+    case FMT_VORBIS :
+      mpeginit ( &mpegsync, false ) ;          // No MPEG frames
+      return true ;
+    case FMT_TS :                              // Audio from the transport stream
+      mpeginit ( &mpegsync, false ) ;
+      tsinit ( &tsdemux ) ;
+      return true ;
+    case FMT_FLAC :
+      mpeginit ( &mpegsync, false ) ;
+      if ( !flacloaded )                       // Plugin needed
+      {
+        flacloaded = loadplugin ( FLACPLUGIN ) ;
+      }
+      return flacloaded ;
+    default :                                  // Opus and HTML are not supported
+      return false ;
+  }
+}
+
+
+//******************************************************************************************
+//                                 S N I F F D A T A                                       *
+//******************************************************************************************
+// Collect the first bytes of the stream.  Returns the number of bytes used.  If the       *
+// format is known, the VS1053 is set up and the collected bytes are played.  Otherwise    *
+// playing is stopped.  After a gapless switch the decoder is restarted if the format has  *
+// changed.                                                                                *
+//******************************************************************************************
+uint32_t sniffdata ( uint8_t* p, uint32_t len )
+{
+  uint32_t n = SNIFFSIZ - sniffcnt ;           // Room in buffer
+  uint32_t i ;                                 // Bytes played from buffer
+  uint32_t r ;                                 // Length of run
+
+  if ( n > len )
+  {
+    n = len ;
+  }
+  memcpy ( sniffbuf + sniffcnt, p, n ) ;       // Collect
+  sniffcnt += n ;
+  streamfmt = sniffclassify ( sniffbuf, sniffcnt, sniffcnt == SNIFFSIZ ) ;
+  if ( ( streamfmt == FMT_UNKNOWN ) && ( sniffcnt < SNIFFSIZ ) )
+  {
+    return n ;                                 // Need more data
+  }
+  sniffing = false ;                           // Format is known now
+  if ( !sniffsetup ( streamfmt ) )             // Can it be played?
+  {
+    dbgprint ( "Rejected, %s stream", fmtnames[streamfmt] ) ;
+    displayinfo ( "Unsupported stream", 60, 68, YELLOW ) ;
+    datamode = STOPREQD ;                      // No, stop player
+    return n ;
+  }
+  if ( ( sniffprev != FMT_UNKNOWN ) &&         // Gapless, but other format?
+       ( sniffprev != streamfmt ) )
+  {
+    dbgprint ( "Format changed, restart decoder" ) ;
+    vs1053player.stopSong() ;                  // Yes, finish previous entry
+    vs1053player.startSong() ;
+  }
+  if ( streamfmt == FMT_TS )                   // Play the collected bytes
+  {
+    tsfeed ( &tsdemux, sniffbuf, sniffcnt ) ;  // From the transport stream
+  }
+  else
+  {
+    for ( i = 0 ; i < sniffcnt ; )             // In runs of 32 bytes, like the feeder
+    {
+      r = sniffcnt - i ;
+      if ( r > 32 )                            // Not more than playdata() can take
+      {
+        r = 32 ;
+      }
+      i += playrun ( sniffbuf + i, r ) ;
+    }
+  }
+  streamfunc = pipeselect() ;                  // Specialized handling from now on
+  return n ;
+}
+
@@ -172,6 +172,56 @@ void getpresets()
   }
 }
 
+//******************************************************************************************
+//                               I N I S E T K E Y                                         *
+//******************************************************************************************
+// Set "key = value" in the .ini file.  An existing line with this key is replaced, other  *
+// lines are kept.  Used to save results that are found at runtime.                        *
+//******************************************************************************************
+bool inisetkey ( const char* key, const char* value )
+{
+  File        inifile ;                                // The .ini file
+  String      contents ;                               // New contents of the file
+  String      line ;                                   // Input line from .ini file
+  String      linelc ;                                 // Same, but lowercase
+  String      rest ;                                   // Part after the key
+
+  inifile = SPIFFS.open ( INIFILENAME, "r" ) ;         // Read the current contents
+  if ( inifile )
+  {
+    while ( inifile.available() )
+    {
+      line = inifile.readStringUntil ( '\n' ) ;        // Read next line
+      linelc = line ;                                  // Copy for lowercase
+      linelc.trim() ;
+      linelc.toLowerCase() ;
+      if ( linelc.startsWith ( key ) )                 // Line for this key?
+      {
+        rest = linelc.substring ( strlen ( key ) ) ;
+        rest.trim() ;
+        if ( rest.startsWith ( "=" ) )                 // Not just a longer key?
+        {
+          continue ;                                   // Yes, drop it
+        }
+      }
+      contents += line ;
+      contents += "\n" ;
+    }
+    inifile.close() ;
+  }
+  contents += String ( key ) + String ( " = " ) + String ( value ) + String ( "\n" ) ;
+  inifile = SPIFFS.open ( INIFILENAME, "w" ) ;         // Write it back
+  if ( !inifile )
+  {
+    dbgprint ( "Cannot write %s", INIFILENAME ) ;
+    return false ;
+  }
+  inifile.print ( contents ) ;
+  inifile.close() ;
+  dbgprint ( "%s = %s saved in %s", key, value, INIFILENAME ) ;
+  return true ;
+}
+
 //******************************************************************************************
 //                               T E S T F I L E                                           *
 //******************************************************************************************
@@ -16,6 +16,7 @@ void timer100()
   static uint8_t aoldval = 0 ;                    // Previous value of analog input switch
   uint8_t        anewval ;                        // New value of analog input switch (0..3)
 
+  ringstattick() ;                                // Ringbuffer statistics
   if ( ++count10sec == 100  )                     // 10 seconds passed?
   {
     timer10sec() ;                                // Yes, do 10 second procedure
@@ -90,22 +91,44 @@ void timer100()
 //******************************************************************************************
 // Extra watchdog.  Called every 10 seconds.                                               *
 // If totalcount has not been changed, there is a problem and playing will stop.           *
+// If the real bitrate of the stream is known, less than half of the expected data in 10   *
+// seconds is also a problem.  That is measured on the received bytes (rxtotal), because   *
+// totalcount stands still while playback is held for the prebuffer.                       *
 // Note that a "yield()" within this routine or in called functions will cause a crash!    *
 //******************************************************************************************
 void timer10sec()
 {
   static uint32_t oldtotalcount = 7321 ;          // Needed foor change detection
+  static uint32_t oldrxtotal = 0 ;                // Received bytes at previous call
+  uint32_t        received ;                      // Bytes received in 10 seconds
   static uint8_t  morethanonce = 0 ;              // Counter for succesive fails
   static uint8_t  t600 = 0 ;                      // Counter for 10 minutes
+  uint32_t        expected = 0 ;                  // Bytes expected in 10 seconds
 
+  received = rxtotal - oldrxtotal ;               // Input of the stream since last call
+  oldrxtotal = rxtotal ;
   if ( datamode & ( INIT | HEADER | DATA |        // Test op playing
                     METADATA | PLAYLISTINIT |
                     PLAYLISTHEADER |
                     PLAYLISTDATA ) )
   {
-    if ( totalcount == oldtotalcount )            // Still playing?
+    if ( ( datamode & ( DATA | METADATA ) ) &&    // Playing a stream
+         ( mpegsync.frames > MPEGUPDATE ) &&      // with real bitrate measured?
+         !localfile )
     {
-      dbgprint ( "No data input" ) ;              // No data detected!
+      expected = bitrate * 1250 ;                 // Yes, bytes in 10 seconds
+    }
+    if ( ( totalcount == oldtotalcount ) ||       // Still playing?
+         ( received < ( expected / 2 ) ) )
+    {
+      if ( totalcount == oldtotalcount )
+      {
+        dbgprint ( "No data input" ) ;            // No data detected!
+      }
+      else
+      {
+        dbgprint ( "Data input too slow" ) ;      // Not enough data for this bitrate
+      }
       if ( morethanonce > 10 )                    // Happened too many times?
       {
         dbgprint ( "Going to restart..." ) ;
@@ -125,6 +148,7 @@ void timer10sec()
         dbgprint ( "Trying other station/file..." ) ;
       }
       morethanonce++ ;                            // Count the fails
+      oldtotalcount = totalcount ;                // Measure again in next cycle
     }
     else
     {
@@ -135,6 +159,7 @@ void timer10sec()
       }
       oldtotalcount = totalcount ;                // Save for comparison in next cycle
     }
+    prebufadapt() ;                               // Lower prebuffer target if stable
     if ( t600++ == 60 )                           // 10 minutes over?
     {
       t600 = 0 ;                                  // Yes, reset counter
@@ -0,0 +1,175 @@
+//******************************************************************************************
+// Demultiplexer for MPEG transport streams.                                               *
+//******************************************************************************************
+// HLS segments are often MPEG-TS.  The stream is cut in 188 byte packets, the audio is    *
+// carried in PES packets on one PID.  The first PID that starts a PES packet with an      *
+// audio stream id (0xC0..0xDF) is taken, so PAT and PMT need not be parsed.  The PES      *
+// headers are removed, the payload (ADTS or MPEG audio) is played.                        *
+// 0x47 is a common byte in the payload, so a sync byte is only taken as the start of a    *
+// packet if the next two packets start with it as well.  While searching, three packets   *
+// are collected in pkt[].                                                                 *
+//******************************************************************************************
+#define TSPKTSIZ       188                     // Size of a transport stream packet
+#define TSHUNTSIZ      ( 2 * TSPKTSIZ + 1 )    // Bytes needed to confirm the sync
+#define TSSYNC         0x47                    // First byte of every packet
+#define TSNOPID        0x1FFF                  // No audio PID found yet
+
+struct tsdemux_t
+{
+  uint8_t     pkt[TSHUNTSIZ] ;                 // Packet being collected, more while searching
+  uint16_t    cnt ;                            // Bytes in pkt
+  bool        insync ;                         // Start of packets is known
+  uint16_t    pid ;                            // PID of the audio
+  uint32_t    lost ;                           // Bytes skipped for resync
+} ;
+
+__attribute__((aligned(4))) tsdemux_t tsdemux ; // Demultiplexer for the stream
+
+//******************************************************************************************
+//                                   T S I N I T                                           *
+//******************************************************************************************
+// Prepare the demultiplexer for a new stream.                                             *
+//******************************************************************************************
+void tsinit ( tsdemux_t* t )
+{
+  t->cnt = 0 ;
+  t->insync = false ;                          // Search for packet start
+  t->pid = TSNOPID ;                           // Search for audio
+  t->lost = 0 ;
+}
+
+
+//******************************************************************************************
+//                                 T S P A C K E T                                         *
+//******************************************************************************************
+// Handle a complete packet.  Audio payload is played in runs of at most 32 bytes.         *
+//******************************************************************************************
+void tspacket ( tsdemux_t* t, uint8_t* pkt )
+{
+  bool     pusi = pkt[1] & 0x40 ;              // Payload unit start indicator
+  uint16_t pid = ( ( pkt[1] & 0x1F ) << 8 ) | pkt[2] ;
+  uint8_t  afc = ( pkt[3] >> 4 ) & 3 ;         // Adaptation field control
+  uint32_t off = 4 ;                           // Start of payload
+  uint32_t n ;                                 // Length of run
+
+  if ( afc & 2 )                               // Adaptation field present?
+  {
+    off += 1 + pkt[4] ;                        // Yes, skip it
+  }
+  if ( !( afc & 1 ) || ( off >= TSPKTSIZ ) )   // Payload present?
+  {
+    return ;
+  }
+  if ( t->pid == TSNOPID )                     // Audio PID not known yet?
+  {
+    if ( !pusi || ( off + 9 > TSPKTSIZ ) ||    // Start of audio PES packet?
+         pkt[off] || pkt[off + 1] || ( pkt[off + 2] != 1 ) ||
+         ( ( pkt[off + 3] & 0xE0 ) != 0xC0 ) )
+    {
+      return ;
+    }
+    t->pid = pid ;                             // Yes, use this PID
+    dbgprint ( "Transport stream audio on PID %d", pid ) ;
+  }
+  if ( pid != t->pid )
+  {
+    return ;                                   // Not audio
+  }
+  if ( pusi )                                  // Start of PES packet?
+  {
+    if ( off + 9 > TSPKTSIZ )
+    {
+      return ;
+    }
+    off += 9 + pkt[off + 8] ;                  // Yes, skip PES header
+    if ( off >= TSPKTSIZ )
+    {
+      return ;
+    }
+  }
+  while ( off < TSPKTSIZ )
+  {
+    n = TSPKTSIZ - off ;
+    if ( n > 32 )                              // Not more than 32 bytes per run
+    {
+      n = 32 ;
+    }
+    off += playrun ( pkt + off, n ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                   T S H U N T                                           *
+//******************************************************************************************
+// Check the collected bytes for three packet starts in a row.  If found, the first two    *
+// packets are handled and the demultiplexer is in sync.  If not, the bytes up to the next *
+// sync byte are dropped.                                                                  *
+//******************************************************************************************
+void tshunt ( tsdemux_t* t )
+{
+  uint8_t* p ;                                 // Next sync byte
+
+  if ( ( t->pkt[TSPKTSIZ] == TSSYNC ) &&       // Next two packets start right?
+       ( t->pkt[2 * TSPKTSIZ] == TSSYNC ) )
+  {
+    t->insync = true ;                         // Yes, packet start found
+    tspacket ( t, t->pkt ) ;
+    tspacket ( t, t->pkt + TSPKTSIZ ) ;
+    t->pkt[0] = TSSYNC ;                       // Keep start of third packet
+    t->cnt = 1 ;
+    return ;
+  }
+  p = (uint8_t*)memchr ( t->pkt + 1, TSSYNC, t->cnt - 1 ) ;
+  if ( p == NULL )                             // Other candidate in the bytes?
+  {
+    p = t->pkt + t->cnt ;                      // No, drop all
+  }
+  t->lost += p - t->pkt ;
+  t->cnt -= p - t->pkt ;
+  memmove ( t->pkt, p, t->cnt ) ;              // Try the next candidate
+}
+
+
+//******************************************************************************************
+//                                   T S F E E D                                           *
+//******************************************************************************************
+// Handle a span of the transport stream.  Returns the number of bytes used.               *
+//******************************************************************************************
+uint32_t tsfeed ( tsdemux_t* t, const uint8_t* p, uint32_t len )
+{
+  uint32_t used = 0 ;                          // Bytes used
+  uint32_t n ;                                 // Bytes to copy
+
+  while ( used < len )
+  {
+    if ( ( t->cnt == 0 ) && ( p[used] != TSSYNC ) )
+    {
+      t->insync = false ;                      // Not at packet start, resync
+      t->lost++ ;
+      used++ ;
+      continue ;
+    }
+    n = ( t->insync ? TSPKTSIZ : TSHUNTSIZ ) - t->cnt ;
+    if ( n > ( len - used ) )
+    {
+      n = len - used ;
+    }
+    memcpy ( t->pkt + t->cnt, p + used, n ) ;
+    t->cnt += n ;
+    used += n ;
+    if ( !t->insync )                          // Searching?
+    {
+      if ( t->cnt == TSHUNTSIZ )               // Yes, enough to check?
+      {
+        tshunt ( t ) ;
+      }
+    }
+    else if ( t->cnt == TSPKTSIZ )             // Packet complete?
+    {
+      tspacket ( t, t->pkt ) ;                 // Yes, handle it
+      t->cnt = 0 ;
+    }
+  }
+  return used ;
+}
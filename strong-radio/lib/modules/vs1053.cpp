@@ -1,23 +1,509 @@
 //******************************************************************************************
 // VS1053 stuff.  Based on maniacbug library.                                              *
+//******************************************************************************************
+// Hardware abstraction.  The VS1053 class is a template on a HAL that gives access to the *
+// CS, DCS and DREQ pins and to the SPI bus:                                               *
+// vs1053pins takes the pin numbers at runtime and uses digitalWrite() and digitalRead().  *
+// vs1053fastpins has the pin numbers as template arguments and writes the GPIO set and    *
+// clear registers directly, so toggling a chip select is a single store.                  *
+// vs1053sim does not need a chip at all, see below.                                       *
+// vs1053fastpins is used, unless VS1053_RUNTIMEPINS or VS1053_SIM is defined.             *
+//******************************************************************************************
+struct vs1053spi                                  // Hardware SPI, base of the real HALs
+{
+  inline void beginTransaction ( SPISettings settings )
+  {
+    SPI.beginTransaction ( settings ) ;
+  }
+
+  inline void endTransaction()
+  {
+    SPI.endTransaction() ;
+  }
+
+  inline void write ( uint8_t b )
+  {
+    SPI.write ( b ) ;
+  }
+
+  inline void write16 ( uint16_t v )
+  {
+    SPI.write16 ( v ) ;
+  }
+
+  inline uint8_t transfer ( uint8_t b )
+  {
+    return SPI.transfer ( b ) ;
+  }
+
+  inline void writeBytes ( uint8_t* data, uint32_t len )
+  {
+    SPI.writeBytes ( data, len ) ;
+  }
+
+  void info ( char* reply, size_t len )
+  {
+    snprintf ( reply, len, "VS1053 on hardware SPI" ) ;
+  }
+
+  void reset()
+  {
+  }
+} ;
+
+struct vs1053pins : vs1053spi
+{
+  uint8_t cs_pin ;                                // Pin where CS line is connected
+  uint8_t dcs_pin ;                               // Pin where DCS line is connected
+  uint8_t dreq_pin ;                              // Pin where DREQ line is connected
+
+  vs1053pins ( uint8_t _cs_pin, uint8_t _dcs_pin, uint8_t _dreq_pin ) :
+    cs_pin(_cs_pin), dcs_pin(_dcs_pin), dreq_pin(_dreq_pin)
+  {
+  }
+
+  void init() const
+  {
+    pinMode ( dreq_pin, INPUT ) ;                 // DREQ is an input
+    pinMode ( cs_pin,   OUTPUT ) ;                // The SCI and SDI signals
+    pinMode ( dcs_pin,  OUTPUT ) ;
+  }
+
+  void dreqpullup() const
+  {
+    pinMode ( dreq_pin, INPUT_PULLUP ) ;          // DREQ is now input with pull-up
+  }
+
+  inline void cs ( bool high ) const
+  {
+    digitalWrite ( cs_pin, high ) ;
+  }
+
+  inline void dcs ( bool high ) const
+  {
+    digitalWrite ( dcs_pin, high ) ;
+  }
+
+  inline bool dreq() const
+  {
+    return ( digitalRead ( dreq_pin ) == HIGH ) ;
+  }
+} ;
+
+template <uint8_t CS, uint8_t DCS, uint8_t DREQ> struct vs1053fastpins : vs1053spi
+{
+  static_assert ( ( CS < 34 ) && ( DCS < 34 ), "CS and DCS must be output capable" ) ;
+  static_assert ( DREQ < 40, "DREQ must be a GPIO" ) ;
+
+  vs1053fastpins ( uint8_t, uint8_t, uint8_t )    // Pins are known at compile time
+  {
+  }
+
+  void init() const
+  {
+    pinMode ( DREQ, INPUT ) ;                     // DREQ is an input
+    pinMode ( CS,   OUTPUT ) ;                    // The SCI and SDI signals
+    pinMode ( DCS,  OUTPUT ) ;
+  }
+
+  void dreqpullup() const
+  {
+    pinMode ( DREQ, INPUT_PULLUP ) ;              // DREQ is now input with pull-up
+  }
+
+  static inline void pinset ( uint8_t pin, bool high )
+  {
+    uint32_t mask = 1u << ( pin & 31 ) ;          // Bit in the set or clear register
+
+    if ( pin < 32 )                               // Folded at compile time
+    {
+      if ( high )
+      {
+        GPIO.out_w1ts = mask ;                    // GPIO 0..31
+      }
+      else
+      {
+        GPIO.out_w1tc = mask ;
+      }
+    }
+    else
+    {
+      if ( high )
+      {
+        GPIO.out1_w1ts.val = mask ;               // GPIO 32..33
+      }
+      else
+      {
+        GPIO.out1_w1tc.val = mask ;
+      }
+    }
+  }
+
+  inline void cs ( bool high ) const
+  {
+    pinset ( CS, high ) ;
+  }
+
+  inline void dcs ( bool high ) const
+  {
+    pinset ( DCS, high ) ;
+  }
+
+  inline bool dreq() const
+  {
+    if ( DREQ < 32 )
+    {
+      return ( GPIO.in >> ( DREQ & 31 ) ) & 1 ;   // GPIO 0..31
+    }
+    return ( GPIO.in1.val >> ( DREQ & 31 ) ) & 1 ; // GPIO 32..39
+  }
+} ;
+
+//******************************************************************************************
+// Simulated VS1053.  Models the 2048 byte SDI FIFO, drained at the bitrate of the stream, *
+// DREQ (high if there is room for 32 bytes), the SCI registers and the time DREQ is low   *
+// after an SCI write.  SPI transfers take the time they would take at the SPI clock, as   *
+// busy waiting, so the CPU cost of the feed path is realistic.  Needs only micros(), so   *
+// the audio path can also run on a host.  Decoder starvation (FIFO empty while playing)   *
+// and FIFO overflows (data sent while DREQ was low) are counted, see "halstat".           *
+//******************************************************************************************
+#define SIMFIFO        2048                    // Size of SDI FIFO
+#define SIMSCIUS       5                       // DREQ low after SCI write in usec
+#define SIMRESETUS     2000                    // DREQ low after reset in usec
+#define SIMCANCEL      64                      // Fillers until SM_CANCEL clears
+
+struct vs1053sim
+{
+  uint16_t    regs[16] ;                       // SCI registers
+  uint32_t    level ;                          // Bytes in the FIFO
+  uint32_t    tdrain ;                         // Time of last drain
+  uint32_t    busyuntil ;                      // End of SCI processing
+  uint32_t    spiclock ;                       // SPI clock of current transaction
+  uint64_t    spins ;                          // Rest of SPI time in nsec
+  bool        csl ;                            // CS is low
+  bool        dcsl ;                           // DCS is low
+  bool        playing ;                        // Audio data received
+  uint8_t     scistate ;                       // Byte number in SCI transaction
+  uint8_t     sciop ;                          // SCI operation, 2 = write, 3 = read
+  uint8_t     scireg ;                         // SCI register
+  uint16_t    scidata ;                        // SCI data being written
+  uint32_t    seq ;                            // Last 4 SDI bytes
+  uint32_t    cancelcnt ;                      // Fillers since SM_CANCEL
+  uint32_t    played ;                         // Bytes decoded since reset
+  uint16_t    wramaddr ;                       // Address for SCI_WRAM
+  uint32_t    sdibytes ;                       // Statistics: SDI bytes
+  uint32_t    starves ;                        // FIFO ran empty while playing
+  uint32_t    overflows ;                      // Bytes sent to a full FIFO
+
+  vs1053sim ( uint8_t, uint8_t, uint8_t )      // No pins
+  {
+    init() ;
+  }
+
+  void init()
+  {
+    memset ( regs, 0, sizeof(regs) ) ;
+    regs[0] = 0x4800 ;                         // SCI_MODE after reset
+    level = 0 ;
+    tdrain = micros() ;
+    busyuntil = tdrain ;
+    spiclock = 200000 ;
+    spins = 0 ;
+    csl = false ;
+    dcsl = false ;
+    playing = false ;
+    scistate = 0 ;
+    seq = 0 ;
+    cancelcnt = 0 ;
+    played = 0 ;
+    wramaddr = 0 ;
+    reset() ;
+  }
+
+  void dreqpullup()
+  {
+  }
+
+  void drain()                                 // Let the decoder consume data
+  {
+    uint32_t now = micros() ;
+    uint32_t rate = ( bitrate ? bitrate : 128 ) * 125 ; // Bytes per second
+    uint32_t n = (uint64_t)( now - tdrain ) * rate / 1000000 ;
+
+    if ( level == 0 )
+    {
+      tdrain = now ;                           // Nothing to play, no credit
+      return ;
+    }
+    if ( n == 0 )
+    {
+      return ;
+    }
+    tdrain += (uint64_t)n * 1000000 / rate ;   // Keep the remainder
+    if ( n > level )
+    {
+      n = level ;
+    }
+    played += n ;
+    regs[4] = played / rate ;                  // SCI_DECODE_TIME in seconds
+    regs[9] = 0xFFFB ;                         // SCI_HDAT1, MPEG 1 layer III
+    if ( n == level )
+    {
+      level = 0 ;                              // FIFO empty
+      if ( playing )
+      {
+        starves++ ;                            // Audible gap
+        playing = false ;
+      }
+      return ;
+    }
+    level -= n ;
+  }
+
+  void spiwait ( uint32_t len )                // Time of an SPI transfer
+  {
+    uint32_t t0 = micros() ;
+
+    spins += (uint64_t)len * 8000000000ULL / spiclock ;
+    while ( ( micros() - t0 ) < ( spins / 1000 ) )
+    {
+      // Busy, like SPI polling
+    }
+    spins %= 1000 ;
+  }
+
+  uint16_t wram ( uint16_t addr )              // Extra parameters in WRAM
+  {
+    if ( addr == 0x1E05 )                      // byteRate?
+    {
+      return ( bitrate ? bitrate : 128 ) * 125 ;
+    }
+    return 0 ;
+  }
+
+  void hwreset()                               // Chip reset, both selects low
+  {
+    regs[0] = 0x4800 ;
+    regs[4] = 0 ;
+    regs[9] = 0 ;
+    played = 0 ;
+    level = 0 ;
+    playing = false ;
+    busyuntil = micros() + SIMRESETUS ;
+  }
+
+  inline void cs ( bool high )
+  {
+    csl = !high ;
+    scistate = 0 ;                             // New SCI transaction
+    if ( csl && dcsl )
+    {
+      hwreset() ;
+    }
+  }
+
+  inline void dcs ( bool high )
+  {
+    dcsl = !high ;
+    if ( csl && dcsl )
+    {
+      hwreset() ;
+    }
+  }
+
+  inline bool dreq()
+  {
+    drain() ;
+    if ( (int32_t)( micros() - busyuntil ) < 0 ) // Still busy with SCI?
+    {
+      return false ;
+    }
+    return ( SIMFIFO - level ) >= 32 ;
+  }
+
+  void sdibyte ( uint8_t b )                   // Byte on SDI
+  {
+    sdibytes++ ;
+    seq = ( seq << 8 ) | b ;
+    if ( ( regs[0] & ( 1 << 5 ) ) &&           // Memory test in SM_TESTS?
+         ( seq == 0x4DEA6D54 ) )
+    {
+      regs[8] = 0x83FF ;                       // All memory OK
+    }
+    if ( regs[0] & ( 1 << 3 ) )                // SM_CANCEL?
+    {
+      if ( ++cancelcnt >= SIMCANCEL )
+      {
+        regs[0] &= ~( 1 << 3 ) ;               // Decoder has stopped
+        regs[9] = 0 ;                          // No format
+        level = 0 ;
+        playing = false ;
+      }
+      return ;
+    }
+    if ( level >= SIMFIFO )
+    {
+      overflows++ ;                            // Data lost
+      return ;
+    }
+    if ( level == 0 )
+    {
+      tdrain = micros() ;                      // Start playing now
+    }
+    level++ ;
+    playing = true ;
+  }
+
+  uint8_t scibyte ( uint8_t b )                // Byte on SCI, returns read data
+  {
+    uint8_t res = 0 ;
+
+    switch ( scistate++ )
+    {
+      case 0 :
+        sciop = b ;
+        break ;
+      case 1 :
+        scireg = b & 0x0F ;
+        break ;
+      case 2 :
+        if ( ( scireg == 6 ) && ( sciop == 3 ) ) // Read of SCI_WRAM?
+        {
+          regs[6] = wram ( wramaddr++ ) ;
+        }
+        res = regs[scireg] >> 8 ;
+        scidata = b << 8 ;
+        break ;
+      case 3 :
+        res = regs[scireg] & 0xFF ;
+        if ( sciop == 2 )                      // Write complete?
+        {
+          regs[scireg] = scidata | b ;
+          busyuntil = micros() + SIMSCIUS ;
+          if ( scireg == 7 )                   // SCI_WRAMADDR?
+          {
+            wramaddr = regs[7] ;
+          }
+          if ( scireg == 4 )                   // SCI_DECODE_TIME cleared?
+          {
+            played = 0 ;
+          }
+          if ( ( scireg == 0 ) && ( regs[0] & ( 1 << 2 ) ) ) // SM_RESET?
+          {
+            regs[0] &= ~( 1 << 2 ) ;
+            regs[4] = 0 ;
+            regs[9] = 0 ;
+            played = 0 ;
+            level = 0 ;
+            playing = false ;
+            busyuntil = micros() + SIMRESETUS ;
+          }
+          if ( ( scireg == 0 ) && ( regs[0] & ( 1 << 3 ) ) ) // SM_CANCEL?
+          {
+            cancelcnt = 0 ;
+          }
+        }
+        break ;
+    }
+    return res ;
+  }
+
+  uint8_t xfer ( uint8_t b )                   // One byte over the bus
+  {
+    if ( csl )
+    {
+      return scibyte ( b ) ;
+    }
+    if ( dcsl )
+    {
+      sdibyte ( b ) ;
+    }
+    return 0xFF ;
+  }
+
+  inline void beginTransaction ( SPISettings settings )
+  {
+    spiclock = settings._clock ;
+  }
+
+  inline void endTransaction()
+  {
+  }
+
+  inline void write ( uint8_t b )
+  {
+    xfer ( b ) ;
+    spiwait ( 1 ) ;
+  }
+
+  inline void write16 ( uint16_t v )
+  {
+    xfer ( v >> 8 ) ;
+    xfer ( v ) ;
+    spiwait ( 2 ) ;
+  }
+
+  inline uint8_t transfer ( uint8_t b )
+  {
+    b = xfer ( b ) ;
+    spiwait ( 1 ) ;
+    return b ;
+  }
+
+  inline void writeBytes ( uint8_t* data, uint32_t len )
+  {
+    for ( uint32_t i = 0 ; i < len ; i++ )
+    {
+      xfer ( data[i] ) ;
+    }
+    spiwait ( len ) ;
+  }
+
+  void info ( char* reply, size_t len )
+  {
+    drain() ;
+    snprintf ( reply, len, "Simulated VS1053: %u SDI bytes, FIFO %u, %u starvations, "
+               "%u overflows, drain %d bytes/sec", sdibytes, level, starves, overflows,
+               ( bitrate ? bitrate : 128 ) * 125 ) ;
+  }
+
+  void reset()
+  {
+    sdibytes = 0 ;
+    starves = 0 ;
+    overflows = 0 ;
+  }
+} ;
+
 //******************************************************************************************
 // VS1053 class definition.                                                                *
 //******************************************************************************************
-class VS1053
+struct vs1053status_t                             // Status of the decoder, see decodeStatus()
+{
+  uint16_t      decodetime ;                      // SCI_DECODE_TIME, seconds decoded
+  uint16_t      hdat0 ;                           // SCI_HDAT0, format dependent
+  uint16_t      hdat1 ;                           // SCI_HDAT1, format, 0 if none
+  uint16_t      audata ;                          // SCI_AUDATA, sample rate and stereo
+  uint16_t      byterate ;                        // Average byte rate of the stream
+  uint32_t      sditotal ;                        // Bytes accepted over SDI, never reset
+} ;
+
+template <class HAL> class VS1053
 {
   private:
-    uint8_t       cs_pin ;                        // Pin where CS line is connected
-    uint8_t       dcs_pin ;                       // Pin where DCS line is connected
-    uint8_t       dreq_pin ;                      // Pin where DREQ line is connected
+    mutable HAL   hal ;                           // Pins and SPI, or simulation
     uint8_t       curvol ;                        // Current volume setting 0..100%
     const uint8_t vs1053_chunk_size = 32 ;
     // SCI Register
     const uint8_t SCI_MODE          = 0x0 ;
     const uint8_t SCI_BASS          = 0x2 ;
     const uint8_t SCI_CLOCKF        = 0x3 ;
+    const uint8_t SCI_DECODE_TIME   = 0x4 ;
     const uint8_t SCI_AUDATA        = 0x5 ;
     const uint8_t SCI_WRAM          = 0x6 ;
     const uint8_t SCI_WRAMADDR      = 0x7 ;
+    const uint8_t SCI_HDAT0         = 0x8 ;
+    const uint8_t SCI_HDAT1         = 0x9 ;
     const uint8_t SCI_AIADDR        = 0xA ;
     const uint8_t SCI_VOL           = 0xB ;
     const uint8_t SCI_AICTRL0       = 0xC ;
@@ -30,40 +516,80 @@ class VS1053
     const uint8_t SM_TESTS          = 5 ;         // Bitnumber in SCI_MODE for tests
     const uint8_t SM_LINE1          = 14 ;        // Bitnumber in SCI_MODE for Line input
     SPISettings   VS1053_SPI ;                    // SPI settings for this slave
+    SPISettings   VS1053_RDSPI ;                  // Same for SCI reads, max CLKI/7
     uint8_t       endFillByte ;                   // Byte to send when stopping song
+    mutable bool  sdiopen = false ;               // SPI transaction for SDI is open
+    mutable TaskHandle_t sdiowner = NULL ;        // Task that opened it
+    TaskHandle_t  sdiburster = NULL ;             // Task that keeps SDI open between chunks
+    mutable uint32_t sdiopens = 0 ;               // Number of SDI transactions
+    uint32_t      sdius = 0 ;                     // Time spent in SDI transfers
+    uint32_t      sdibytes = 0 ;                  // Bytes sent over SDI
+    uint32_t      sditotal = 0 ;                  // Same, never reset
+    uint16_t      scishadow[16] ;                 // Last value set in SCI_MODE/VOL/BASS
+    uint16_t      scivalid = 0 ;                  // Bitmask, registers with valid shadow
+    mutable std::atomic<uint16_t> scipending { 0 } ; // Bitmask, registers to write at flush
+    mutable uint32_t scicount = 0 ;               // Number of SCI transactions
+    uint32_t      scidropped = 0 ;                // Writes dropped, value unchanged
+    uint32_t      scistamp = 0 ;                  // millis() at reset of SCI statistics
   protected:
     inline void await_data_request() const
     {
-      while ( !digitalRead ( dreq_pin ) )
+      while ( !hal.dreq() )
       {
         yield() ;                                 // Very short delay
       }
     }
 
-    inline void control_mode_on() const
+    inline bool sdi_mine() const
+    {
+      return sdiopen &&                           // SDI open by this task?
+             ( sdiowner == xTaskGetCurrentTaskHandle() ) ;
+    }
+
+    inline void sdi_close() const
+    {
+      if ( sdi_mine() )                           // SDI transaction open?
+      {
+        hal.dcs ( HIGH ) ;                        // Yes, end data mode
+        hal.endTransaction() ;                    // Allow other SPI users
+        sdiopen = false ;
+      }
+    }
+
+    inline void control_mode_on ( const SPISettings& settings ) const
     {
-      SPI.beginTransaction ( VS1053_SPI ) ;       // Prevent other SPI users
-      digitalWrite ( dcs_pin, HIGH ) ;            // Bring slave in control mode
-      digitalWrite ( cs_pin, LOW ) ;
+      sdi_close() ;                               // SCI needs the bus
+      hal.beginTransaction ( settings ) ;         // Prevent other SPI users
+      hal.dcs ( HIGH ) ;                          // Bring slave in control mode
+      hal.cs ( LOW ) ;
     }
 
     inline void control_mode_off() const
     {
-      digitalWrite ( cs_pin, HIGH ) ;             // End control mode
-      SPI.endTransaction() ;                      // Allow other SPI users
+      hal.cs ( HIGH ) ;                           // End control mode
+      hal.endTransaction() ;                      // Allow other SPI users
     }
 
     inline void data_mode_on() const
     {
-      SPI.beginTransaction ( VS1053_SPI ) ;       // Prevent other SPI users
-      digitalWrite ( cs_pin, HIGH ) ;             // Bring slave in data mode
-      digitalWrite ( dcs_pin, LOW ) ;
+      if ( sdi_mine() )                           // Still open from last chunk?
+      {
+        return ;                                  // Yes, nothing to do
+      }
+      hal.beginTransaction ( VS1053_SPI ) ;       // Prevent other SPI users
+      hal.cs ( HIGH ) ;                           // Bring slave in data mode
+      hal.dcs ( LOW ) ;
+      sdiopen = true ;
+      sdiowner = xTaskGetCurrentTaskHandle() ;
+      sdiopens++ ;
     }
 
     inline void data_mode_off() const
     {
-      digitalWrite ( dcs_pin, HIGH ) ;            // End data mode
-      SPI.endTransaction() ;                      // Allow other SPI users
+      if ( sdiburster != xTaskGetCurrentTaskHandle() ) // Keep open for next chunk?
+      {
+        sdi_close() ;                             // No, end data mode
+      }
     }
 
     uint16_t read_register ( uint8_t _reg ) const ;
@@ -72,6 +598,13 @@ class VS1053
     void     sdi_send_fillers ( size_t length ) ;
     void     wram_write ( uint16_t address, uint16_t data ) ;
     uint16_t wram_read ( uint16_t address ) ;
+    void     setclock ( uint16_t cf, uint32_t spi ) ;
+    void     restart() ;
+    bool     sciverify() ;
+    uint16_t sdimemtest() ;
+    void     sci_set ( uint8_t _reg, uint16_t _value ) ;
+    void     sci_queue ( uint8_t _reg, uint16_t _value ) ;
+    uint16_t sci_get ( uint8_t _reg ) ;
 
   public:
     // Constructor.  Only sets pin values.  Doesn't touch the chip.  Be sure to call begin()!
@@ -84,6 +617,8 @@ class VS1053
     // the chip.  Blocks until complete.
     void     stopSong() ;                                // Finish playing a song. Call this after
     // the last playChunk call.
+    void     cancelSong() ;                              // Cancel decoding at once, for a
+    // station switch.
     void     setVolume ( uint8_t vol ) ;                 // Set the player volume.Level from 0-100,
     // higher is louder.
     void     setTone ( uint8_t* rtone ) ;                // Set the player baas/treble, 4 nibbles for
@@ -93,50 +628,93 @@ class VS1053
     void     printDetails ( const char *header ) ;       // Print configuration details to serial output.
     void     softReset() ;                               // Do a soft reset
     bool     testComm ( const char *header ) ;           // Test communication with module
+    void     loadPlugin ( const uint16_t* plugin,        // Load a plugin (compressed format
+                          size_t len ) ;                 // from VLSI), len in words
     inline bool data_request() const
     {
-      return ( digitalRead ( dreq_pin ) == HIGH ) ;
+      return hal.dreq() ;
+    }
+    bool     sdibatch = true ;                   // Batch chunks in one SPI transaction
+    void     sdiBegin() ;                        // Start a burst of chunks
+    void     sdiEnd() ;                          // End a burst of chunks
+    void     sdiRelease() ;                      // End a burst of the calling task
+    void     sdiReset() ;                        // Clear SDI statistics
+    void     sdiInfo ( char* reply, size_t len ) ; // Format SDI statistics
+    void     halInfo ( char* reply, size_t len ) // Format HAL statistics
+    {
+      hal.info ( reply, len ) ;
+    }
+    void     halReset()                          // Clear HAL statistics
+    {
+      hal.reset() ;
+    }
+    uint16_t clockf = 6 << 12 ;                  // SCI_CLOCKF, multiplier 3.0
+    uint32_t spiclock = 4000000 ;                // SPI clock after clock setting
+    bool     calibrate() ;                       // Find fastest stable clockf/spiclock
+    void     benchmark ( char* reply, size_t len ) ; // Measure SDI and SCI throughput
+    void     decodeStatus ( vs1053status_t* st ) ; // Read status of the decoder
+    uint32_t sdiTotal() const                    // Bytes sent over SDI, never reset
+    {
+      return sditotal ;
     }
+    bool     scicache = true ;                   // Cache and queue SCI register writes
+    void     sciFlush() ;                        // Write queued registers, between bursts
+    void     sciReset() ;                        // Clear SCI statistics
+    void     sciInfo ( char* reply, size_t len ) ; // Format SCI statistics
 } ;
 
 //******************************************************************************************
 // VS1053 class implementation.                                                            *
 //******************************************************************************************
 
-VS1053::VS1053 ( uint8_t _cs_pin, uint8_t _dcs_pin, uint8_t _dreq_pin ) :
-  cs_pin(_cs_pin), dcs_pin(_dcs_pin), dreq_pin(_dreq_pin)
+template <class HAL>
+VS1053<HAL>::VS1053 ( uint8_t _cs_pin, uint8_t _dcs_pin, uint8_t _dreq_pin ) :
+  hal ( _cs_pin, _dcs_pin, _dreq_pin )
 {
 }
 
-uint16_t VS1053::read_register ( uint8_t _reg ) const
+template <class HAL>
+uint16_t VS1053<HAL>::read_register ( uint8_t _reg ) const
 {
   uint16_t result ;
 
-  control_mode_on() ;
-  SPI.write ( 3 ) ;                                // Read operation
-  SPI.write ( _reg ) ;                             // Register to write (0..0xF)
+  control_mode_on ( VS1053_RDSPI ) ;
+  hal.write ( 3 ) ;                                // Read operation
+  hal.write ( _reg ) ;                             // Register to write (0..0xF)
   // Note: transfer16 does not seem to work
-  result = ( SPI.transfer ( 0xFF ) << 8 ) |        // Read 16 bits data
-           ( SPI.transfer ( 0xFF ) ) ;
+  result = ( hal.transfer ( 0xFF ) << 8 ) |        // Read 16 bits data
+           ( hal.transfer ( 0xFF ) ) ;
   await_data_request() ;                           // Wait for DREQ to be HIGH again
   control_mode_off() ;
+  scicount++ ;                                     // Count transactions
   return result ;
 }
 
-void VS1053::write_register ( uint8_t _reg, uint16_t _value ) const
+template <class HAL>
+void VS1053<HAL>::write_register ( uint8_t _reg, uint16_t _value ) const
 {
-  control_mode_on( );
-  SPI.write ( 2 ) ;                                // Write operation
-  SPI.write ( _reg ) ;                             // Register to write (0..0xF)
-  SPI.write16 ( _value ) ;                         // Send 16 bits data
+  control_mode_on ( VS1053_SPI ) ;
+  hal.write ( 2 ) ;                                // Write operation
+  hal.write ( _reg ) ;                             // Register to write (0..0xF)
+  hal.write16 ( _value ) ;                         // Send 16 bits data
   await_data_request() ;
   control_mode_off() ;
+  scicount++ ;                                     // Count transactions
+  if ( ( scivalid & _BV ( _reg ) ) &&              // Register with a shadow?
+       ( _value != scishadow[_reg] ) )             // And chip differs from it now?
+  {
+    scipending.fetch_or ( _BV ( _reg ) ) ;         // Yes, restore at next flush
+  }
 }
 
-void VS1053::sdi_send_buffer ( uint8_t* data, size_t len )
+template <class HAL>
+void VS1053<HAL>::sdi_send_buffer ( uint8_t* data, size_t len )
 {
-  size_t chunk_length ;                            // Length of chunk 32 byte or shorter
+  size_t   chunk_length ;                          // Length of chunk 32 byte or shorter
+  uint32_t t0 = micros() ;                         // For CPU time accounting
 
+  sdibytes += len ;
+  sditotal += len ;
   data_mode_on() ;
   while ( len )                                    // More to do?
   {
@@ -147,13 +725,15 @@ void VS1053::sdi_send_buffer ( uint8_t* data, size_t len )
       chunk_length = vs1053_chunk_size ;
     }
     len -= chunk_length ;
-    SPI.writeBytes ( data, chunk_length ) ;
+    hal.writeBytes ( data, chunk_length ) ;
     data += chunk_length ;
   }
   data_mode_off() ;
+  sdius += micros() - t0 ;
 }
 
-void VS1053::sdi_send_fillers ( size_t len )
+template <class HAL>
+void VS1053<HAL>::sdi_send_fillers ( size_t len )
 {
   size_t chunk_length ;                            // Length of chunk 32 byte or shorter
 
@@ -169,25 +749,28 @@ void VS1053::sdi_send_fillers ( size_t len )
     len -= chunk_length ;
     while ( chunk_length-- )
     {
-      SPI.write ( endFillByte ) ;
+      hal.write ( endFillByte ) ;
     }
   }
   data_mode_off();
 }
 
-void VS1053::wram_write ( uint16_t address, uint16_t data )
+template <class HAL>
+void VS1053<HAL>::wram_write ( uint16_t address, uint16_t data )
 {
   write_register ( SCI_WRAMADDR, address ) ;
   write_register ( SCI_WRAM, data ) ;
 }
 
-uint16_t VS1053::wram_read ( uint16_t address )
+template <class HAL>
+uint16_t VS1053<HAL>::wram_read ( uint16_t address )
 {
   write_register ( SCI_WRAMADDR, address ) ;            // Start reading from WRAM
   return read_register ( SCI_WRAM ) ;                   // Read back result
 }
 
-bool VS1053::testComm ( const char *header )
+template <class HAL>
+bool VS1053<HAL>::testComm ( const char *header )
 {
   // Test the communication with the VS1053 module.  The result wille be returned.
   // If DREQ is low, there is problably no VS1053 connected.  Pull the line HIGH
@@ -197,11 +780,11 @@ bool VS1053::testComm ( const char *header )
   uint16_t  r1, r2, cnt = 0 ;
   uint16_t  delta = 300 ;                               // 3 for fast SPI
 
-  if ( !digitalRead ( dreq_pin ) )
+  if ( !hal.dreq() )
   {
     dbgprint ( "VS1053 not properly installed!" ) ;
     // Allow testing without the VS1053 module
-    pinMode ( dreq_pin,  INPUT_PULLUP ) ;               // DREQ is now input with pull-up
+    hal.dreqpullup() ;                                 // DREQ is now input with pull-up
     return false ;                                      // Return bad result
   }
   // Further TESTING.  Check if SCI bus can write and read without errors.
@@ -229,24 +812,24 @@ bool VS1053::testComm ( const char *header )
   return ( cnt == 0 ) ;                                 // Return the result
 }
 
-void VS1053::begin()
+template <class HAL>
+void VS1053<HAL>::begin()
 {
-  pinMode      ( dreq_pin,  INPUT ) ;                   // DREQ is an input
-  pinMode      ( cs_pin,    OUTPUT ) ;                  // The SCI and SDI signals
-  pinMode      ( dcs_pin,   OUTPUT ) ;
-  digitalWrite ( dcs_pin,   HIGH ) ;                    // Start HIGH for SCI en SDI
-  digitalWrite ( cs_pin,    HIGH ) ;
+  hal.init() ;                                          // DREQ input, SCI and SDI outputs
+  hal.dcs ( HIGH ) ;                                    // Start HIGH for SCI en SDI
+  hal.cs ( HIGH ) ;
   delay ( 100 ) ;
   dbgprint ( "Reset VS1053..." ) ;
-  digitalWrite ( dcs_pin,   LOW ) ;                     // Low & Low will bring reset pin low
-  digitalWrite ( cs_pin,    LOW ) ;
+  hal.dcs ( LOW ) ;                                     // Low & Low will bring reset pin low
+  hal.cs ( LOW ) ;
   delay ( 2000 ) ;
   dbgprint ( "End reset VS1053..." ) ;
-  digitalWrite ( dcs_pin,   HIGH ) ;                    // Back to normal again
-  digitalWrite ( cs_pin,    HIGH ) ;
+  hal.dcs ( HIGH ) ;                                    // Back to normal again
+  hal.cs ( HIGH ) ;
   delay ( 500 ) ;
   // Init SPI in slow mode ( 0.2 MHz )
   VS1053_SPI = SPISettings ( 200000, MSBFIRST, SPI_MODE0 ) ;
+  VS1053_RDSPI = VS1053_SPI ;
   //printDetails ( "Right after reset/startup" ) ;
   delay ( 20 ) ;
   //printDetails ( "20 msec after reset" ) ;
@@ -260,12 +843,18 @@ void VS1053::begin()
   softReset() ;                                         // Do a soft reset
   // Switch on the analog parts
   write_register ( SCI_AUDATA, 44100 + 1 ) ;            // 44.1kHz + stereo
-  // The next clocksetting allows SPI clocking at 5 MHz, 4 MHz is safe then.
-  write_register ( SCI_CLOCKF, 6 << 12 ) ;              // Normal clock settings multiplyer 3.0 = 12.2 MHz
-  //SPI Clock to 4 MHz. Now you can set high speed SPI clock.
-  VS1053_SPI = SPISettings ( 4000000, MSBFIRST, SPI_MODE0 ) ;
-  write_register ( SCI_MODE, _BV ( SM_SDINEW ) | _BV ( SM_LINE1 ) ) ;
-  testComm ( "Fast SPI, Testing VS1053 read/write registers again..." ) ;
+  // The default clocksetting (multiplyer 3.0) allows SPI clocking at 5 MHz, 4 MHz is safe
+  // then.  Faster settings may be found by "vscalibrate" and are read from the .ini file.
+  setclock ( clockf, spiclock ) ;
+  sci_set ( SCI_MODE, _BV ( SM_SDINEW ) | _BV ( SM_LINE1 ) ) ;
+  if ( !testComm ( "Fast SPI, Testing VS1053 read/write registers again..." ) &&
+       ( ( clockf != ( 6 << 12 ) ) || ( spiclock != 4000000 ) ) )
+  {
+    dbgprint ( "Clock settings from ini file fail, back to default" ) ;
+    clockf = 6 << 12 ;                                  // Calibrated settings are bad
+    spiclock = 4000000 ;
+    restart() ;
+  }
   delay ( 10 ) ;
   await_data_request() ;
   endFillByte = wram_read ( 0x1E06 ) & 0xFF ;
@@ -274,23 +863,25 @@ void VS1053::begin()
   delay ( 100 ) ;
 }
 
-void VS1053::setVolume ( uint8_t vol )
+template <class HAL>
+void VS1053<HAL>::setVolume ( uint8_t vol )
 {
   // Set volume.  Both left and right.
   // Input value is 0..100.  100 is the loudest.
   // Clicking reduced by using 0xf8 to 0x00 as limits.
   uint16_t value ;                                      // Value to send to SCI_VOL
 
-  if ( vol != curvol )
+  if ( scicache || ( vol != curvol ) )                  // Shadow will drop equal values
   {
     curvol = vol ;                                      // Save for later use
     value = map ( vol, 0, 100, 0xF8, 0x00 ) ;           // 0..100% to one channel
     value = ( value << 8 ) | value ;
-    write_register ( SCI_VOL, value ) ;                 // Volume left and right
+    sci_queue ( SCI_VOL, value ) ;                      // Volume left and right
   }
 }
 
-void VS1053::setTone ( uint8_t *rtone )                 // Set bass/treble (4 nibbles)
+template <class HAL>
+void VS1053<HAL>::setTone ( uint8_t *rtone )           // Set bass/treble (4 nibbles)
 {
   // Set tone characteristics.  See documentation for the 4 nibbles.
   uint16_t value = 0 ;                                  // Value to send to SCI_BASS
@@ -300,32 +891,36 @@ void VS1053::setTone ( uint8_t *rtone )                 // Set bass/treble (4 ni
   {
     value = ( value << 4 ) | rtone[i] ;                 // Shift next nibble in
   }
-  write_register ( SCI_BASS, value ) ;                  // Volume left and right
+  sci_queue ( SCI_BASS, value ) ;                       // Bass and treble
 }
 
-uint8_t VS1053::getVolume()                             // Get the currenet volume setting.
+template <class HAL>
+uint8_t VS1053<HAL>::getVolume()                       // Get the currenet volume setting.
 {
   return curvol ;
 }
 
-void VS1053::startSong()
+template <class HAL>
+void VS1053<HAL>::startSong()
 {
   sdi_send_fillers ( 10 ) ;
 }
 
-void VS1053::playChunk ( uint8_t* data, size_t len )
+template <class HAL>
+void VS1053<HAL>::playChunk ( uint8_t* data, size_t len )
 {
   sdi_send_buffer ( data, len ) ;
 }
 
-void VS1053::stopSong()
+template <class HAL>
+void VS1053<HAL>::stopSong()
 {
   uint16_t modereg ;                     // Read from mode register
   int      i ;                           // Loop control
 
   sdi_send_fillers ( 2052 ) ;
   delay ( 10 ) ;
-  write_register ( SCI_MODE, _BV ( SM_SDINEW ) | _BV ( SM_CANCEL ) ) ;
+  write_register ( SCI_MODE, sci_get ( SCI_MODE ) | _BV ( SM_CANCEL ) ) ;
   for ( i = 0 ; i < 200 ; i++ )
   {
     sdi_send_fillers ( 32 ) ;
@@ -341,14 +936,397 @@ void VS1053::stopSong()
   printDetails ( "Song stopped incorrectly!" ) ;
 }
 
-void VS1053::softReset()
+template <class HAL>
+void VS1053<HAL>::cancelSong()
+{
+  // Minimal cancel sequence of the datasheet: set SM_CANCEL, send fillers in 32 byte
+  // chunks until the decoder clears SM_CANCEL, then 2052 end fill bytes.  If SM_CANCEL is
+  // still set after 2048 bytes, a soft reset is done.  No delays, DREQ paces the fillers.
+  int i ;                                // Loop control
+
+  write_register ( SCI_MODE, sci_get ( SCI_MODE ) | _BV ( SM_CANCEL ) ) ;
+  for ( i = 1 ; i <= 64 ; i++ )
+  {
+    sdi_send_fillers ( 32 ) ;
+    if ( ( read_register ( SCI_MODE ) & _BV ( SM_CANCEL ) ) == 0 )
+    {
+      sdi_send_fillers ( 2052 ) ;
+      dbgprint ( "Song cancelled after %d bytes", i * 32 ) ;
+      return ;
+    }
+  }
+  dbgprint ( "Song not cancelled, soft reset" ) ;
+  restart() ;
+}
+
+template <class HAL>
+void VS1053<HAL>::softReset()
 {
   write_register ( SCI_MODE, _BV ( SM_SDINEW ) | _BV ( SM_RESET ) ) ;
   delay ( 10 ) ;
   await_data_request() ;
+  scipending.fetch_or ( scivalid ) ;                    // Chip has defaults, restore later
+}
+
+template <class HAL>
+void VS1053<HAL>::loadPlugin ( const uint16_t* plugin, size_t len )
+{
+  size_t   i = 0 ;                                      // Index in plugin
+  uint16_t addr ;                                       // SCI register
+  uint16_t n ;                                          // Number of words
+  uint16_t val ;                                        // Value to write
+
+  while ( ( i + 2 ) < len )
+  {
+    addr = plugin[i++] ;
+    n = plugin[i++] ;
+    if ( n & 0x8000 )                                   // Run length replication?
+    {
+      n &= 0x7FFF ;
+      val = plugin[i++] ;                               // Yes, same value n times
+      while ( n-- )
+      {
+        write_register ( addr, val ) ;
+      }
+    }
+    else
+    {
+      while ( n-- && ( i < len ) )                      // Copy n values
+      {
+        val = plugin[i++] ;
+        write_register ( addr, val ) ;
+      }
+    }
+  }
+}
+
+// A burst keeps the SPI transaction and DCS open over many chunks, so the feeder can send
+// all chunks for which DREQ allows in one transaction.  SCI access ends the burst
+// automatically.  The state is per task: sdiRelease() only ends a burst of the calling
+// task, so another SPI user (the TFT) must first make sure that no burst is open, the
+// display takes feedlock for that.  Another task waits in hal.beginTransaction() until
+// the burst has ended.
+template <class HAL>
+void VS1053<HAL>::sdiBegin()
+{
+  sdiburster = sdibatch ? xTaskGetCurrentTaskHandle() : NULL ; // Batch if enabled
+}
+
+template <class HAL>
+void VS1053<HAL>::sdiEnd()
+{
+  sdiburster = NULL ;
+  sdi_close() ;                                         // Free the SPI bus
+}
+
+template <class HAL>
+void VS1053<HAL>::sdiRelease()
+{
+  sdi_close() ;                                         // Next chunk will open again
+}
+
+template <class HAL>
+void VS1053<HAL>::sdiReset()
+{
+  sdiopens = 0 ;
+  sdius = 0 ;
+  sdibytes = 0 ;
+}
+
+template <class HAL>
+void VS1053<HAL>::sdiInfo ( char* reply, size_t len )
+{
+  if ( sdibytes == 0 )
+  {
+    snprintf ( reply, len, "No SDI data sent" ) ;
+    return ;
+  }
+  // CPU time for one second of audio: 16000 bytes at 128 kb/s, 40000 bytes at 320 kb/s
+  snprintf ( reply, len, "SDI %s: %d bytes in %d transactions, %d usec, "
+             "CPU per second of audio %d usec at 128 kb/s, %d usec at 320 kb/s",
+             sdibatch ? "batched" : "per chunk", sdibytes, sdiopens, sdius,
+             (uint32_t)( (uint64_t)sdius * 16000 / sdibytes ),
+             (uint32_t)( (uint64_t)sdius * 40000 / sdibytes ) ) ;
+}
+
+// SCI register shadow.  SCI_MODE, SCI_VOL and SCI_BASS keep the last value set by the
+// driver.  Writes of an unchanged value are dropped, changed values are queued and written
+// by sciFlush(), which the feeder calls between SDI bursts.  A direct write_register() with
+// another value (tests, cancel) marks the register, so the shadow value is restored later.
+template <class HAL>
+void VS1053<HAL>::sci_set ( uint8_t _reg, uint16_t _value )
+{
+  scishadow[_reg] = _value ;                            // New value in shadow
+  scivalid |= _BV ( _reg ) ;
+  scipending.fetch_and ( ~_BV ( _reg ) ) ;              // Written now, not at flush
+  write_register ( _reg, _value ) ;                     // and in the chip
+}
+
+template <class HAL>
+void VS1053<HAL>::sci_queue ( uint8_t _reg, uint16_t _value )
+{
+  if ( !scicache )                                      // Cache switched off?
+  {
+    sci_set ( _reg, _value ) ;                          // Yes, write at once
+    return ;
+  }
+  if ( ( scivalid & _BV ( _reg ) ) && ( scishadow[_reg] == _value ) )
+  {
+    scidropped++ ;                                      // No change, drop it
+    return ;
+  }
+  scishadow[_reg] = _value ;                            // Remember new value
+  scivalid |= _BV ( _reg ) ;
+  scipending.fetch_or ( _BV ( _reg ) ) ;                // Write at next flush, after shadow
+}
+
+template <class HAL>
+uint16_t VS1053<HAL>::sci_get ( uint8_t _reg )
+{
+  if ( scivalid & _BV ( _reg ) )                        // Value in shadow?
+  {
+    return scishadow[_reg] ;                            // Yes, no SPI traffic
+  }
+  return read_register ( _reg ) ;
+}
+
+template <class HAL>
+void VS1053<HAL>::sciFlush()
+{
+  // Called by the feeder task, while loop() may queue new values.  The pending bit is
+  // cleared before the shadow is read, so a value queued meanwhile sets it again and is
+  // written at the next flush.
+  uint8_t reg ;                                         // Register to write
+
+  for ( reg = 0 ; scipending && ( reg < 16 ) ; reg++ ) // Until queue is empty
+  {
+    if ( scipending.fetch_and ( ~_BV ( reg ) ) & _BV ( reg ) )
+    {
+      write_register ( reg, scishadow[reg] ) ;
+    }
+  }
+}
+
+template <class HAL>
+void VS1053<HAL>::sciReset()
+{
+  scicount = 0 ;
+  scidropped = 0 ;
+  scistamp = millis() ;
+}
+
+template <class HAL>
+void VS1053<HAL>::sciInfo ( char* reply, size_t len )
+{
+  uint32_t secs = ( millis() - scistamp ) / 1000 ;      // Seconds since reset
+
+  if ( secs == 0 )
+  {
+    secs = 1 ;                                          // Prevent division by zero
+  }
+  snprintf ( reply, len, "SCI %s: %d transactions in %d sec, %d per second, "
+             "%d unchanged writes dropped",
+             scicache ? "cached" : "direct", scicount, secs, scicount / secs,
+             scidropped ) ;
+}
+
+// Clock calibration.  SCI_CLOCKF sets the internal clock CLKI as a multiple of XTALI
+// (12.288 MHz).  SDI and SCI writes allow SPI clocks up to CLKI/4, SCI reads up to CLKI/7.
+// The candidates below are for SDI and writes, setclock() limits the clock of reads.
+// A setting is accepted if SCI read-back and the SDI memory test give correct results.
+#define VS1053_XTALI   12288000                         // Crystal frequency
+#define VS1053_MULMIN  3                                // SC_MULT 3.0 (default)
+#define VS1053_MULMAX  6                                // SC_MULT 4.5, max CLKI 55.3 MHz
+#define VS1053_ROUNDS  3                                // Tests per setting
+
+template <class HAL>
+void VS1053<HAL>::setclock ( uint16_t cf, uint32_t spi )
+{
+  // Registers may be written at CLKI/4.  CLKI is XTALI until SCI_CLOCKF is set.  Reads
+  // use the same clock, but not above CLKI/7.
+  uint8_t  mul = cf >> 13 ;                             // SC_MULT
+  uint32_t rdspi = ( mul ? VS1053_XTALI / 2 * ( mul + 3 ) : VS1053_XTALI ) / 7 ;
+
+  VS1053_SPI = SPISettings ( 1000000, MSBFIRST, SPI_MODE0 ) ;
+  VS1053_RDSPI = VS1053_SPI ;
+  write_register ( SCI_CLOCKF, cf ) ;
+  delay ( 1 ) ;                                         // Let the clock settle
+  await_data_request() ;
+  VS1053_SPI = SPISettings ( spi, MSBFIRST, SPI_MODE0 ) ;
+  VS1053_RDSPI = SPISettings ( ( spi < rdspi ) ? spi : rdspi, MSBFIRST, SPI_MODE0 ) ;
+}
+
+template <class HAL>
+void VS1053<HAL>::restart()
+{
+  // Soft reset and set up the chip again with the current clock settings.
+  VS1053_SPI = SPISettings ( 1000000, MSBFIRST, SPI_MODE0 ) ;
+  VS1053_RDSPI = VS1053_SPI ;
+  softReset() ;
+  write_register ( SCI_AUDATA, 44100 + 1 ) ;            // 44.1kHz + stereo
+  setclock ( clockf, spiclock ) ;
+  sci_set ( SCI_MODE, _BV ( SM_SDINEW ) | _BV ( SM_LINE1 ) ) ;
+  sciFlush() ;                                          // Restore volume and tone
+  await_data_request() ;
+}
+
+template <class HAL>
+bool VS1053<HAL>::sciverify()
+{
+  // Write and read back SCI_VOL with alternating bit patterns.
+  uint16_t v ;                                          // Value to write
+  int      i ;                                          // Loop control
+
+  for ( i = 0 ; i < 64 ; i++ )
+  {
+    v = i * 0x0411 ;                                    // Walk through the bits
+    if ( i & 1 )
+    {
+      v = ~v ;                                          // Every other one inverted
+    }
+    write_register ( SCI_VOL, v ) ;
+    if ( ( read_register ( SCI_VOL ) != v ) ||
+         ( read_register ( SCI_VOL ) != v ) )
+    {
+      return false ;
+    }
+  }
+  return true ;
+}
+
+template <class HAL>
+uint16_t VS1053<HAL>::sdimemtest()
+{
+  // Memory test of the VS1053, started by a sequence over SDI.  The result is read from
+  // SCI_HDAT0, bit 15 is set when the test is finished.  If the SDI data is garbled, the
+  // test does not run.  The chip is restarted afterwards.
+  uint8_t  seq[8] = { 0x4D, 0xEA, 0x6D, 0x54, 0, 0, 0, 0 } ;
+  uint16_t res ;                                        // Result of the test
+
+  write_register ( SCI_MODE, _BV ( SM_SDINEW ) | _BV ( SM_TESTS ) ) ;
+  await_data_request() ;
+  sdi_send_buffer ( seq, sizeof(seq) ) ;
+  delay ( 100 ) ;                                       // Test needs 500000 clocks
+  res = read_register ( SCI_HDAT0 ) ;
+  restart() ;
+  return res ;
 }
 
-void VS1053::printDetails ( const char *header )
+template <class HAL>
+bool VS1053<HAL>::calibrate()
+{
+  // Raise SC_MULT and the SPI clock step by step.  The fastest SPI clock that passes all
+  // tests is kept, with the lowest multiplier that allows it.  The reference result of
+  // the memory test is taken at the default settings.
+  const uint32_t spis[] = { 4000000, 5000000, 8000000, 10000000,   // 80 MHz / n
+                            13333333, 16000000, 20000000 } ;
+  uint16_t bestcf = 6 << 12 ;                           // Best settings so far
+  uint32_t bestspi = 4000000 ;
+  uint16_t ref ;                                        // Memory test at default settings
+  uint32_t clki ;                                       // Internal clock
+  uint8_t  mul ;                                        // SC_MULT
+  size_t   i ;                                          // Index in spis
+  int      r ;                                          // Round
+  bool     ok ;                                         // Setting passed
+
+  clockf = bestcf ;
+  spiclock = bestspi ;
+  restart() ;
+  ref = sdimemtest() ;
+  if ( !( ref & 0x8000 ) || !sciverify() )
+  {
+    dbgprint ( "VS1053 fails at default clock, memtest %04X", ref ) ;
+    return false ;
+  }
+  for ( mul = VS1053_MULMIN ; mul <= VS1053_MULMAX ; mul++ )
+  {
+    clki = VS1053_XTALI / 2 * ( mul + 3 ) ;             // SC_MULT 3 is 3.0, 4 is 3.5, ..
+    for ( i = 0 ; i < sizeof(spis) / sizeof(spis[0]) ; i++ )
+    {
+      if ( ( spis[i] > clki / 4 ) ||                    // Beyond the spec?
+           ( spis[i] <= bestspi ) )                     // Or no gain?
+      {
+        continue ;
+      }
+      clockf = mul << 13 ;
+      spiclock = spis[i] ;
+      ok = true ;
+      for ( r = 0 ; ok && ( r < VS1053_ROUNDS ) ; r++ )
+      {
+        restart() ;
+        ok = sciverify() && ( sdimemtest() == ref ) ;
+      }
+      dbgprint ( "SCI_CLOCKF %04X, SPI %d Hz: %s", clockf, spiclock,
+                 ok ? "pass" : "fail" ) ;
+      if ( !ok )
+      {
+        break ;                                         // Faster will fail too
+      }
+      bestcf = clockf ;                                 // Best so far
+      bestspi = spiclock ;
+    }
+  }
+  clockf = bestcf ;                                     // Use the best settings
+  spiclock = bestspi ;
+  restart() ;
+  return true ;
+}
+
+template <class HAL>
+void VS1053<HAL>::benchmark ( char* reply, size_t len )
+{
+  // Sustained SDI throughput (paced by DREQ) and SCI transactions per second.  Zeroes are
+  // sent, the decoder skips them.  Each test takes about 500 msec.
+  uint8_t  zero[32] ;                                   // Data for SDI
+  uint32_t sdin = 0 ;                                   // Bytes sent
+  uint32_t rdn = 0 ;                                    // SCI reads done
+  uint32_t wrn = 0 ;                                    // SCI writes done
+  uint32_t t0, tsdi, trd, twr ;                         // Timing in usec
+  uint16_t vol ;                                        // Current SCI_VOL
+
+  memset ( zero, 0, sizeof(zero) ) ;
+  t0 = micros() ;
+  sdiBegin() ;                                          // Keep SDI open
+  while ( ( tsdi = micros() - t0 ) < 500000 )
+  {
+    sdi_send_buffer ( zero, sizeof(zero) ) ;
+    sdin += sizeof(zero) ;
+  }
+  sdiEnd() ;
+  t0 = micros() ;
+  while ( ( trd = micros() - t0 ) < 500000 )
+  {
+    read_register ( SCI_MODE ) ;
+    rdn++ ;
+  }
+  vol = read_register ( SCI_VOL ) ;                     // Write the same value back
+  t0 = micros() ;
+  while ( ( twr = micros() - t0 ) < 500000 )
+  {
+    write_register ( SCI_VOL, vol ) ;
+    wrn++ ;
+  }
+  snprintf ( reply, len, "SCI_CLOCKF %04X, SPI %d Hz: SDI %d bytes/sec, "
+             "SCI %d reads/sec, %d writes/sec", clockf, spiclock,
+             (uint32_t)( (uint64_t)sdin * 1000000 / tsdi ),
+             (uint32_t)( (uint64_t)rdn * 1000000 / trd ),
+             (uint32_t)( (uint64_t)wrn * 1000000 / twr ) ) ;
+}
+
+template <class HAL>
+void VS1053<HAL>::decodeStatus ( vs1053status_t* st )
+{
+  // Six SCI transactions, about 50 usec at 4 MHz.
+  st->decodetime = read_register ( SCI_DECODE_TIME ) ;
+  st->hdat0 = read_register ( SCI_HDAT0 ) ;
+  st->hdat1 = read_register ( SCI_HDAT1 ) ;
+  st->audata = read_register ( SCI_AUDATA ) ;
+  st->byterate = wram_read ( 0x1E05 ) ;                 // Extra parameter byteRate
+  st->sditotal = sditotal ;
+}
+
+template <class HAL>
+void VS1053<HAL>::printDetails ( const char *header )
 {
   uint16_t     regbuf[16] ;
   uint8_t      i ;
@@ -368,7 +1346,64 @@ void VS1053::printDetails ( const char *header )
 }
 
 // The object for the MP3 player
-VS1053 vs1053player (  VS1053_CS, VS1053_DCS, VS1053_DREQ ) ;
+#if defined ( VS1053_SIM )
+VS1053<vs1053sim>  vs1053player ( VS1053_CS, VS1053_DCS, VS1053_DREQ ) ;
+#elif defined ( VS1053_RUNTIMEPINS )
+VS1053<vs1053pins> vs1053player ( VS1053_CS, VS1053_DCS, VS1053_DREQ ) ;
+#else
+VS1053<vs1053fastpins<VS1053_CS, VS1053_DCS, VS1053_DREQ>>
+                   vs1053player ( VS1053_CS, VS1053_DCS, VS1053_DREQ ) ;
+#endif
+
+bool         vscalreq = false ;                // Request for clock calibration
+bool         vsbenchreq = false ;              // Request for throughput benchmark
+
+//******************************************************************************************
+//                              V S C A L I B R A T E                                      *
+//******************************************************************************************
+// Find the fastest stable clock settings and save them in the .ini file.  Only if the     *
+// player is stopped.                                                                      *
+//******************************************************************************************
+void vscalibrate()
+{
+  char val[12] ;                                       // Value for .ini file
+
+  if ( datamode != STOPPED )
+  {
+    dbgprint ( "Calibration needs a stopped player" ) ;
+    return ;
+  }
+  if ( !vs1053player.calibrate() )
+  {
+    return ;                                           // Nothing to save
+  }
+  dbgprint ( "Best SCI_CLOCKF %04X, SPI %d Hz",
+             vs1053player.clockf, vs1053player.spiclock ) ;
+  sprintf ( val, "0x%04X", vs1053player.clockf ) ;
+  inisetkey ( "clockf", val ) ;                        // Use these at next start
+  sprintf ( val, "%d", vs1053player.spiclock ) ;
+  inisetkey ( "spiclock", val ) ;
+  reqtone = true ;                                     // Chip was reset, restore tone
+}
+
+
+//******************************************************************************************
+//                                  V S B E N C H                                          *
+//******************************************************************************************
+// Measure SDI and SCI throughput.  Only if the player is stopped.                         *
+//******************************************************************************************
+void vsbench()
+{
+  char reply[150] ;                                    // Result
+
+  if ( datamode != STOPPED )
+  {
+    dbgprint ( "Benchmark needs a stopped player" ) ;
+    return ;
+  }
+  vs1053player.benchmark ( reply, sizeof(reply) ) ;
+  dbgprint ( reply ) ;
+}
 
 //******************************************************************************************
 // End VS1053 stuff.                                                                       *
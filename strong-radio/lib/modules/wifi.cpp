@@ -1,3 +1,27 @@
+//******************************************************************************************
+//                             G E T E N C R Y P T I O N T Y P E                           *
+//******************************************************************************************
+// Read the encryption type of the network and return as a 4 byte name                     *
+//******************************************************************************************
+const char* getEncryptionType ( int thisType )
+{
+  switch (thisType)
+  {
+    case ENC_TYPE_WEP:
+      return "WEP " ;
+    case ENC_TYPE_TKIP:
+      return "WPA " ;
+    case ENC_TYPE_CCMP:
+      return "WPA2" ;
+    case ENC_TYPE_NONE:
+      return "None" ;
+    case ENC_TYPE_AUTO:
+      return "Auto" ;
+  }
+  return "????" ;
+}
+
+
 //******************************************************************************************
 //                                L I S T N E T W O R K S                                  *
 //******************************************************************************************
@@ -1,3 +1,21 @@
+//******************************************************************************************
+// Lookup of iHeartRadio streams.                                                          *
+//******************************************************************************************
+// The stream URL of a station is read from the XML data of streamtheworld.com.  The       *
+// lookup is done step by step by xmlpoll(), so loop() is not blocked while waiting for    *
+// the host.  It is given up after XMLTIMEOUT msec.                                        *
+//******************************************************************************************
+#define XMLTIMEOUT     5000                    // Max time for the lookup in msec
+
+enum xmlstate_t { XML_IDLE, XML_CONNECT, XML_PROLOG,
+                  XML_BODY } ;                 // States of the lookup
+
+xmlstate_t   xmlstate = XML_IDLE ;             // State of the lookup
+hostconn_t   xmlconn ;                         // Connect in progress to the XML host
+WiFiClient*  xmlclient = NULL ;                // Connection to the XML host
+uint32_t     xmlstartms ;                      // Start of the lookup
+char         xmlprev ;                         // Previous character, to find "<?"
+
 
 //******************************************************************************************
 //                                  X M L  C A L L B A C K                                 *
@@ -37,20 +55,40 @@ void XML_callback ( uint8_t statusflags, char* tagName, uint16_t tagNameLen,
 
 
 //******************************************************************************************
-//                                  X M L  P A R S E                                       *
+//                                   X M L  S T O P                                        *
+//******************************************************************************************
+// Stop a lookup in progress.                                                              *
+//******************************************************************************************
+void xmlstop()
+{
+  if ( xmlclient )
+  {
+    xmlclient->stop() ;
+    delete ( xmlclient ) ;
+    xmlclient = NULL ;
+  }
+  connabort ( &xmlconn ) ;
+  if ( xmlstate != XML_IDLE )
+  {
+    xml.reset() ;                                   // Parser ready for next lookup
+    xmlstate = XML_IDLE ;
+  }
+}
+
+
+//******************************************************************************************
+//                                  X M L  S T A R T                                       *
 //******************************************************************************************
-// Parses streams from XML data.                                                           *
+// Start the lookup of the stream URL of an iHeartRadio station.  The lookup is done by    *
+// xmlpoll(), that connects to the stream when the URL is found.                           *
 //******************************************************************************************
-String xmlparse ( String mount )
+void xmlstart ( String mount )
 {
   // Example URL for XML Data Stream:
   // http://playerservices.streamtheworld.com/api/livestream?version=1.5&mount=IHR_TRANAAC&lang=en
-  // Clear all variables for use.
-  char   tmpstr[200] ;                              // Full GET command, later stream URL
-  char   c ;                                        // Next input character from reply
-  String urlout ;                                   // Result URL
-  bool   urlfound = false ;                         // Result found
+  char url[200] ;                                   // Host and path for the request
 
+  // Clear all variables for use.
   stationServer = "" ;
   stationPort = "" ;
   stationMount = "" ;
@@ -60,43 +98,104 @@ String xmlparse ( String mount )
   dbgprint ( "Connect to new iHeartRadio host: %s", mount.c_str() ) ;
   datamode = INIT ;                                 // Start default in metamode
   chunked = false ;                                 // Assume not chunked
-  // Create a GET commmand for the request.
-  sprintf ( tmpstr, xmlget, mount.c_str() ) ;
-  dbgprint ( "%s", tmpstr ) ;
-  // Connect to XML stream.
-  mp3client = new WiFiClient() ;
-  if ( mp3client->connect ( xmlhost, xmlport ) ) {
-    dbgprint ( "Connected!" ) ;
-    mp3client->print ( String ( tmpstr ) + " HTTP/1.1\r\n"
-                       "Host: " + xmlhost + "\r\n"
-                       "User-Agent: Mozilla/5.0\r\n"
-                       "Connection: close\r\n\r\n" ) ;
-    // Check for XML Data.
-    while ( true )
-    {
-      if ( mp3client->available() )
+  // Create the URL for the request.
+  snprintf ( url, sizeof(url), "%s:%d", xmlhost, xmlport ) ;
+  snprintf ( url + strlen ( url ), sizeof(url) - strlen ( url ), xmlget, mount.c_str() ) ;
+  dbgprint ( "%s", url ) ;
+  xmlstartms = millis() ;
+  xmlprev = 0 ;
+  xmlstate = XML_CONNECT ;
+  if ( !connstart ( &xmlconn, url, "User-Agent: Mozilla/5.0\r\n" ) )
+  {
+    dbgprint ( "Can't connect to XML host!" ) ;
+    xmlstop() ;
+  }
+}
+
+
+//******************************************************************************************
+//                                  X M L  F O U N D                                       *
+//******************************************************************************************
+// The stream URL is found.  Stop the lookup and connect to the stream.                    *
+//******************************************************************************************
+void xmlfound()
+{
+  char tmpstr[200] ;                                // Stream URL
+
+  snprintf ( tmpstr, sizeof(tmpstr), "%s:%s/%s_SC", // Build URL for ESP-Radio to stream.
+             stationServer.c_str(),
+             stationPort.c_str(),
+             stationMount.c_str() ) ;
+  dbgprint ( "Found: %s", tmpstr ) ;
+  dbgprint ( "Closing XML connection." ) ;
+  xmlstop() ;
+  host = String ( tmpstr ) ;
+  connecttohost() ;                                 // Connect to the stream
+}
+
+
+//******************************************************************************************
+//                                  X M L  P O L L                                         *
+//******************************************************************************************
+// Called from loop().  Parses the stream URL from the XML data, as far as it is received. *
+//******************************************************************************************
+void xmlpoll()
+{
+  char c ;                                          // Next input character from reply
+
+  if ( xmlstate == XML_IDLE )
+  {
+    return ;
+  }
+  if ( ( millis() - xmlstartms ) > XMLTIMEOUT )     // Taking too long?
+  {
+    dbgprint ( "XML lookup timeout" ) ;             // Yes, give up
+    xmlstop() ;
+    return ;
+  }
+  switch ( xmlstate )
+  {
+    case XML_CONNECT :
+      switch ( connpoll ( &xmlconn ) )
       {
-        char c = mp3client->read() ;
-        if ( c == '<' )
+        case CONN_DONE :
+          dbgprint ( "Connected!" ) ;
+          xmlclient = conntake ( &xmlconn ) ;
+          xmlstate = XML_PROLOG ;
+          break ;
+        case CONN_FAIL :
+          dbgprint ( "Can't connect to XML host!" ) ;
+          xmlstop() ;
+          return ;
+        default :
+          return ;                                  // Still connecting
+      }
+    // Fall through
+    case XML_PROLOG :
+      // Check for XML Data.
+      while ( xmlclient->available() )
+      {
+        c = xmlclient->read() ;
+        if ( ( xmlprev == '<' ) && ( c == '?' ) )
         {
-          c = mp3client->read() ;
-          if ( c == '?' )
-          {
-            xml.processChar ( '<' ) ;
-            xml.processChar ( '?' ) ;
-            break ;
-          }
+          xml.processChar ( '<' ) ;
+          xml.processChar ( '?' ) ;
+          dbgprint ( "XML parser processing..." ) ;
+          xmlstate = XML_BODY ;
+          break ;
         }
+        xmlprev = c ;
       }
-      yield() ;
-    }
-    dbgprint ( "XML parser processing..." ) ;
-    // Process XML Data.
-    while (true) 
-    {
-      if ( mp3client->available() )
+      if ( xmlstate != XML_BODY )
+      {
+        break ;
+      }
+    // Fall through
+    case XML_BODY :
+      // Process XML Data.
+      while ( xmlclient->available() )
       {
-        c = mp3client->read() ;
+        c = xmlclient->read() ;
         xml.processChar ( c ) ;
         if ( xmlTag != "" )
         {
@@ -106,7 +205,8 @@ String xmlparse ( String mount )
             {
               dbgprint ( "Bad xml status-code %s",    // No, show and stop interpreting
                           xmlData.c_str() ) ;
-              break ;
+              xmlstop() ;
+              return ;
             }
           }
           if ( xmlTag.endsWith ( "/ip" ) )
@@ -122,32 +222,15 @@ String xmlparse ( String mount )
             stationMount = xmlData ;
           }
         }
+        // Check if all the station values are stored.
+        if ( stationServer != "" && stationPort != "" && stationMount != "" )
+        {
+          xmlfound() ;
+          return ;
+        }
       }
-      // Check if all the station values are stored.
-      urlfound = ( stationServer != "" && stationPort != "" && stationMount != "" ) ;
-      if ( urlfound )
-      {
-        xml.reset() ;
-        break ;
-      }
-      yield() ;
-    }
-    tmpstr[0] = '\0' ;                            
-    if ( urlfound )
-    {
-      sprintf ( tmpstr, "%s:%s/%s_SC",                   // Build URL for ESP-Radio to stream.
-                        stationServer.c_str(),
-                        stationPort.c_str(),
-                        stationMount.c_str() ) ;
-      dbgprint ( "Found: %s", tmpstr ) ;
-    }
-    dbgprint ( "Closing XML connection." ) ;
-    stop_mp3client () ;
-  }
-  else
-  {
-    dbgprint ( "Can't connect to XML host!" ) ;
-    tmpstr[0] = '\0' ;                            
+      break ;
+    default :
+      break ;
   }
-  return String ( tmpstr ) ;                           // Return final streaming URL.
 }
@@ -0,0 +1,136 @@
+//******************************************************************************************
+// Fast station switch.                                                                    *
+//******************************************************************************************
+// A normal stop finishes the song with the full stop sequence of the VS1053 and waits     *
+// 500 msec twice.  In fast mode the decoder is cancelled with the minimal sequence, the   *
+// ringbuffer is emptied and there are no delays.  The old connection is not closed at     *
+// once: it is handed over here and closed after the connection to the new station has     *
+// been started.  The zap latency is the time from the stop request to the first audio of  *
+// the new station, see "zapstat".                                                         *
+//******************************************************************************************
+bool         fastzap = true ;                  // Fast station switch enabled
+WiFiClient*  zapclient = NULL ;                // Old connection, closed after new connect
+bool         zapping = false ;                 // Switch in progress
+uint32_t     zapstamp ;                        // Time of stop request
+uint32_t     zapstopms ;                       // Duration of stop phase of last switch
+uint32_t     zaplast ;                         // Last zap latency in msec
+uint32_t     zapmin ;                          // Best zap latency
+uint32_t     zapmax ;                          // Worst zap latency
+uint32_t     zapsum ;                          // Sum of latencies
+uint32_t     zapcnt ;                          // Number of switches measured
+
+//******************************************************************************************
+//                                  Z A P B E G I N                                        *
+//******************************************************************************************
+// A stop request is handled.  Start measuring, it may be a station switch.                *
+//******************************************************************************************
+void zapbegin()
+{
+  zapping = true ;
+  zapstamp = millis() ;
+}
+
+
+//******************************************************************************************
+//                                Z A P S T O P P E D                                      *
+//******************************************************************************************
+// The player has been stopped.  Remember how long that took.                              *
+//******************************************************************************************
+void zapstopped()
+{
+  zapstopms = millis() - zapstamp ;
+}
+
+
+//******************************************************************************************
+//                                 Z A P D E T A C H                                       *
+//******************************************************************************************
+// Take over the connection to the old station.  It is closed by zappoll().                *
+//******************************************************************************************
+void zapdetach ( WiFiClient* client )
+{
+  if ( zapclient )                             // Still one from a previous switch?
+  {
+    zapclient->stop() ;                        // Yes, close that one now
+    delete ( zapclient ) ;
+  }
+  zapclient = client ;
+}
+
+
+//******************************************************************************************
+//                                   Z A P P O L L                                         *
+//******************************************************************************************
+// Called from loop() after a new station has been started.  Close the old connection.     *
+// If no new station was started, it was just a stop and there is nothing to measure.      *
+//******************************************************************************************
+void zappoll()
+{
+  if ( zapclient )
+  {
+    zapclient->stop() ;                        // Close old connection
+    delete ( zapclient ) ;
+    zapclient = NULL ;
+  }
+  if ( zapping && ( localfile ||               // Local file is not measured
+                   ( ( datamode == STOPPED ) && !hlsactive ) ) )
+  {
+    zapping = false ;                          // Nothing started, not a switch
+  }
+}
+
+
+//******************************************************************************************
+//                              Z A P F I R S T A U D I O                                  *
+//******************************************************************************************
+// The first audio of a new connection is sent to the decoder.  End of a switch.           *
+//******************************************************************************************
+void zapfirstaudio()
+{
+  if ( !zapping )                              // Switch in progress?
+  {
+    return ;                                   // No, first station or next playlist entry
+  }
+  zapping = false ;
+  zaplast = millis() - zapstamp ;
+  if ( ( zapcnt == 0 ) || ( zaplast < zapmin ) )
+  {
+    zapmin = zaplast ;
+  }
+  if ( zaplast > zapmax )
+  {
+    zapmax = zaplast ;
+  }
+  zapsum += zaplast ;
+  zapcnt++ ;
+  dbgprint ( "Station switch took %d msec, stop phase %d msec", zaplast, zapstopms ) ;
+}
+
+
+//******************************************************************************************
+//                                  Z A P R E S E T                                        *
+//******************************************************************************************
+// Clear the statistics of station switches.                                               *
+//******************************************************************************************
+void zapreset()
+{
+  zaplast = 0 ;
+  zapmin = 0 ;
+  zapmax = 0 ;
+  zapsum = 0 ;
+  zapcnt = 0 ;
+}
+
+
+//******************************************************************************************
+//                                   Z A P I N F O                                         *
+//******************************************************************************************
+// Format the statistics of station switches for the "zapstat" command.                    *
+//******************************************************************************************
+void zapinfo ( char* reply, size_t len )
+{
+  snprintf ( reply, len, "Station switch (%s): %d switches, last %d msec (stop phase %d), "
+             "min %d, max %d, average %d msec",
+             fastzap ? "fast" : "normal", zapcnt, zaplast, zapstopms, zapmin, zapmax,
+             zapcnt ? zapsum / zapcnt : 0 ) ;
+}
@@ -26,6 +26,7 @@ const char index_html[] PROGMEM = R"=====(
    <button class="button" onclick="httpGet('resume')">RESUME</button>
    <button class="button" onclick="httpGet('status')">STATUS</button>
    <button class="button" onclick="httpGet('test')">TEST</button>
+   <button class="button" onclick="httpGet('ringstat')">BUFFER</button>
    <table style="width:500px">
     <tr>
      <td colspan="2"><center>
@@ -135,11 +135,19 @@
 #define VERSION "Fri, 05 Oct 2018 09:30:00 GMT"
 // TFT.  Define USETFT if required.
 //#define USETFT
+// VS1053 pins.  Define VS1053_RUNTIMEPINS to use digitalWrite() instead of direct GPIO access.
+//#define VS1053_RUNTIMEPINS
+// Define VS1053_SIM to run without a VS1053, a simulated chip is fed instead.
+//#define VS1053_SIM
 #include <WiFi.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <AsyncMqttClient.h>
 #include <SPI.h>
+#include <soc/gpio_struct.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include <lwip/sockets.h>
 #if defined ( USETFT )
 #include <Adafruit_GFX.h>
 #include <TFT_ILI9163C.h>
@@ -151,6 +159,7 @@
 #include <ArduinoOTA.h>
 #include <TinyXML.h>
 #include <SPIFFS.h>
+#include <atomic>
 
 extern "C"
 {
@@ -191,7 +200,12 @@ extern "C"
 #define BUTTON2 0
 #define BUTTON3 15
 // Ringbuffer for smooth playing. 20000 bytes is 160 Kbits, about 1.5 seconds at 128kb bitrate.
+// This is the default and minimal size, a larger size may be set by "buffersize" in the .ini file.
 #define RINGBFSIZ 20000
+// Default time in msec to fill the ringbuffer before playback starts.  See prebuffer.cpp.
+#define PREBUFMS 1000
+// Number of presets in the .ini file (preset_00 .. preset_99)
+#define MAXPRESETS 100
 // Debug buffer size
 #define DEBUG_BUFFER_SIZE 100
 // Name of the ini file
@@ -207,9 +221,10 @@ extern "C"
 // Forward declaration of various functions                                                *
 //******************************************************************************************
 //void   displayinfo ( const char* str, uint16_t pos, uint16_t height, uint16_t color ) ;
-void   showstreamtitle ( const char* ml, bool full = false ) ;
+void   showstreamtitle ( const char* ml ) ;
 void   handlebyte ( uint8_t b, bool force = false ) ;
-void   handlebyte_ch ( uint8_t b, bool force = false ) ;
+uint32_t handlebytes ( uint8_t* p, uint32_t len ) ;
+uint32_t handlebytes_ch ( uint8_t* p, uint32_t len ) ;
 void   handleFS ( AsyncWebServerRequest* request ) ;
 void   handleFSf ( AsyncWebServerRequest* request, const String& filename ) ;
 void   handleCmd ( AsyncWebServerRequest* request )  ;
@@ -220,7 +235,7 @@ char*  analyzeCmd ( const char* str ) ;
 char*  analyzeCmd ( const char* par, const char* val ) ;
 String chomp ( String str ) ;
 void   publishIP() ;
-String xmlparse ( String mount ) ;
+void   xmlstart ( String mount ) ;
 void   put_eeprom_station ( int index, const char *entry ) ;
 char*  get_eeprom_station ( int index ) ;
 int    find_eeprom_station ( const char *search_entry ) ;
@@ -250,6 +265,8 @@ struct ini_struct
   int8_t         newpreset ;                               // Requested preset
   String         ssid ;                                    // SSID of WiFi network to connect to
   String         passwd ;                                  // Password for WiFi network
+  uint32_t       buffersize ;                              // Requested size of ringbuffer in bytes
+  uint16_t       prebuffer ;                               // Initial prebuffer target in msec
 } ;
 
 enum datamode_t { INIT = 1, HEADER = 2, DATA = 4,
@@ -276,8 +293,7 @@ datamode_t       datamode ;                                // State of datastrea
 int              metacount ;                               // Number of bytes in metadata
 int              datacount ;                               // Counter databytes before metadata
 String           metaline ;                                // Readable line in metadata
-String           icystreamtitle ;                          // Streamtitle from metadata
-String           icyname ;                                 // Icecast station name
+char             icystreamtitle[150] ;                     // Streamtitle from metadata
 int              bitrate ;                                 // Bitrate in kb/sec
 int              metaint = 0 ;                             // Number of databytes between metadata
 int8_t           currentpreset = -1 ;                      // Preset station playing
@@ -288,9 +304,10 @@ bool             hostreq = false ;                         // Request for new ho
 bool             reqtone = false ;                         // New tone setting requested
 bool             muteflag = false ;                        // Mute output
 uint8_t*         ringbuf ;                                 // Ringbuffer for VS1053
-uint16_t         rbwindex = 0 ;                            // Fill pointer in ringbuffer
-uint16_t         rbrindex = RINGBFSIZ - 1 ;                // Emptypointer in ringbuffer
-uint16_t         rcount = 0 ;                              // Number of bytes in ringbuffer
+uint32_t         ringbfsiz ;                               // Actual size of ringbuffer
+bool             ringpsram = false ;                       // Ringbuffer is in PSRAM
+std::atomic<uint32_t> rbwindex ( 0 ) ;                     // Fill pointer in ringbuffer (producer)
+std::atomic<uint32_t> rbrindex ( 0 ) ;                     // Emptypointer in ringbuffer (consumer)
 uint16_t         analogsw[NUMANA] = { asw1, asw2, asw3 } ; // 3 levels of analog input
 uint16_t         analogrest ;                              // Rest value of analog input
 bool             resetreq = false ;                        // Request to reset the ESP8266
@@ -305,11 +322,10 @@ int8_t           playlist_num = 0 ;                        // Nonzero for select
 File             mp3file  ;                                // File containing mp3 on SPIFFS
 bool             localfile = false ;                       // Play from local mp3-file or not
 bool             chunked = false ;                         // Station provides chunked transfer
-int              chunkcount = 0 ;                          // Counter for chunked transfer
 
 // XML parse globals.
 const char* xmlhost = "playerservices.streamtheworld.com" ;// XML data source
-const char* xmlget =  "GET /api/livestream"                // XML get parameters
+const char* xmlget =  "/api/livestream"                    // XML get parameters
                       "?version=1.5"                       // API Version of IHeartRadio
                       "&mount=%sAAC"                       // MountPoint with Station Callsign
                       "&lang=en" ;                         // Language
@@ -361,11 +377,12 @@ void setup()
   Serial.begin ( 115200 ) ;                            // For debug
   Serial.println() ;
   system_update_cpu_freq ( 160 ) ;                     // Set to 80/160 MHz
-  ringbuf = (uint8_t *) malloc ( RINGBFSIZ ) ;         // Create ring buffer
   xml.init ( xmlbuffer, sizeof(xmlbuffer),             // Initilize XML stream.
              &XML_callback ) ;
   memset ( &ini_block, 0, sizeof(ini_block) ) ;        // Init ini_block
   ini_block.mqttport = 1883 ;                          // Default port for MQTT
+  ini_block.buffersize = RINGBFSIZ ;                   // Default size of ringbuffer
+  ini_block.prebuffer = PREBUFMS ;                     // Default prebuffer target
   SPIFFS.begin() ;                                     // Enable file system
   // Show some info about the SPIFFS
   SPIFFS.info ( fs_info ) ;
@@ -385,6 +402,8 @@ void setup()
   mk_lsan() ;                                          // Make a list of acceptable networks in ini file.
   listNetworks() ;                                     // Search for WiFi networks
   readinifile() ;                                      // Read .ini file
+  allocring ( ini_block.buffersize ) ;                 // Create ring buffer
+  ringstatreset() ;                                    // Clear ringbuffer statistics
   getpresets() ;                                       // Get the presets from .ini-file
   WiFi.setPhyMode ( WIFI_PHY_MODE_11N ) ;              // Force 802.11N connection
   WiFi.persistent ( false ) ;                          // Do not save SSID and password
@@ -401,6 +420,8 @@ void setup()
              ESP.getFreeSketchSpace() ) ;
   pinMode ( BUTTON2, INPUT_PULLUP ) ;                  // Input for control button 2
   vs1053player.begin() ;                               // Initialize VS1053 player
+  feedstart() ;                                        // Start feeder task for VS1053
+  rxstart() ;                                          // Start receive task for the stream
 #if defined ( USETFT )
   tft.begin() ;                                        // Init TFT interface
   tft.fillRect ( 0, 0, 160, 128, BLACK ) ;             // Clear screen does not work when rotated
@@ -468,19 +489,22 @@ void setup()
 //******************************************************************************************
 //                                   L O O P                                               *
 //******************************************************************************************
-// Main loop of the program.  Minimal time is 20 usec.  Will take about 4 msec if VS1053   *
-// needs data.                                                                             *
-// Sometimes the loop is called after an interval of more than 100 msec.                   *
-// In that case we will not be able to fill the internal VS1053-fifo in time (especially   *
-// at high bitrate).                                                                       *
-// A connection to an MP3 server is active and we are ready to receive data.               *
+// Main loop of the program.  Minimal time is 20 usec.                                     *
+// Sometimes the loop is called after an interval of more than 100 msec.  That is why the  *
+// VS1053 is fed by a separate task while playing, see feeder.cpp.                         *
+// The data of an MP3 server is received by a separate task as well, see netrx.cpp.        *
 // Normally there is about 2 to 4 kB available in the data stream.  This depends on the    *
-// sender.                                                                                 *
+// sender.  Local files are read here.                                                     *
 //******************************************************************************************
 void loop()
 {
   uint32_t    maxfilechunk  ;                           // Max number of bytes to read from
-                                                        // stream or file
+                                                        // file
+  uint8_t*    p ;                                       // Span in ringbuffer
+  uint32_t    n ;                                       // Length of span
+  int         res ;                                     // Result of read
+
+  prefetchpoll() ;                                      // Next playlist entry if needed
   // Try to keep the ringbuffer filled up by adding as much bytes as possible
   if ( datamode & ( INIT | HEADER | DATA |              // Test op playing
                     METADATA | PLAYLISTINIT |
@@ -494,35 +518,57 @@ void loop()
       {
         maxfilechunk = 1024 ;
       }
-      while ( ringspace() && maxfilechunk-- )
-      {
-        putring ( mp3file.read() ) ;                    // Yes, store one byte in ringbuffer
-        yield() ;
-      }
-    }
-    else
-    {
-      maxfilechunk = mp3client->available() ;          // Bytes available from mp3 server
-      if ( maxfilechunk > 1024 )                       // Reduce byte count for this loop()
+      while ( maxfilechunk && ( n = ringwspan ( &p ) ) ) // Room in the ringbuffer?
       {
-        maxfilechunk = 1024 ;
+        if ( n > maxfilechunk )                         // Yes, limit to what is available
+        {
+          n = maxfilechunk ;
+        }
+        res = mp3file.read ( p, n ) ;                   // Read a block from the file
+        if ( res <= 0 )                                 // Anything read?
+        {
+          break ;                                       // No, try again next loop()
+        }
+        ringwcommit ( res ) ;                           // Store the block in the ringbuffer
+        maxfilechunk -= res ;
       }
-      while ( ringspace() && maxfilechunk-- )
+      if ( maxfilechunk && !ringspace() )               // Input left, but buffer full?
       {
-        putring ( mp3client->read() ) ;                // Yes, store one byte in ringbuffer
-        yield() ;
+        ringoverflows++ ;                               // Yes, count backpressure
       }
     }
+    else if ( !netrx && mp3client )                     // Stream not read by the task?
+    {
+      rxpause() ;                                       // Yes, read it here
+      rxburst ( 1024 ) ;                                // Reduce byte count for this loop()
+      rxresume() ;
+    }
     yield() ;
   }
-  while ( vs1053player.data_request() && ringavail() ) // Try to keep VS1053 filled
+  // While playing, the VS1053 is fed by the feeder task.  Header and playlist data is
+  // handled here.
+  if ( !( datamode & ( DATA | METADATA ) ) )
+  {
+    feedvs1053() ;
+  }
+  if ( vs1053player.data_request() && ( ringavail() == 0 ) &&
+       !( localfile && ( mp3file.available() == 0 ) ) )
   {
-    handlebyte_ch ( getring() ) ;                      // Yes, handle it
+    ringstatunderrun() ;                                // Decoder starves, count it
+    prebufunderrun() ;                                  // and buffer more
   }
+  ringstatsample() ;                                    // Update ringbuffer watermark
+  playlistpoll() ;                                      // Start entry if playlist is read
+  hlspoll() ;                                           // Read HLS playlists
+  healthpoll() ;                                        // Check decoder progress
+  xmlpoll() ;                                           // iHeartRadio lookup in progress
+  streamconnpoll() ;                                    // Stream connect in progress
   yield() ;
   if ( datamode == STOPREQD )                          // STOP requested?
   {
+    xSemaphoreTake ( feedlock, portMAX_DELAY ) ;       // Feeder must not run now
     dbgprint ( "STOP requested" ) ;
+    zapbegin() ;                                       // May be a station switch
     if ( localfile )
     {
       mp3file.close() ;
@@ -531,15 +577,28 @@ void loop()
     {
       stop_mp3client() ;                               // Disconnect if still connected
     }
-    handlebyte_ch ( 0, true ) ;                        // Force flush of buffer
+    handlebyte ( 0, true ) ;                           // Force flush of buffer
     vs1053player.setVolume ( 0 ) ;                     // Mute
-    vs1053player.stopSong() ;                          // Stop playing
+    vs1053player.sciFlush() ;                          // at once, before cancel/stop
+    if ( fastzap && !localfile )                       // Fast switch?
+    {
+      vs1053player.cancelSong() ;                      // Yes, drop what is decoded
+    }
+    else
+    {
+      vs1053player.stopSong() ;                        // Stop playing
+    }
     emptyring() ;                                      // Empty the ringbuffer
     datamode = STOPPED ;                               // Yes, state becomes STOPPED
 #if defined ( USETFT )
     tft.fillRect ( 0, 0, 160, 128, BLACK ) ;           // Clear screen does not work when rotated
 #endif
-    delay ( 500 ) ;
+    xSemaphoreGive ( feedlock ) ;
+    zapstopped() ;                                     // End of stop phase
+    if ( !fastzap )
+    {
+      delay ( 500 ) ;
+    }
   }
   if ( localfile )
   {
@@ -603,17 +662,20 @@ void loop()
       if ( host.startsWith ( "ihr/" ) )                 // iHeartRadio station requested?
       {
         host = host.substring ( 4 ) ;                   // Yes, remove "ihr/"
-        host = xmlparse ( host ) ;                      // Parse the xml to get the host
+        xmlstart ( host ) ;                             // Lookup, then connect to the host
+      }
+      else
+      {
+        connecttohost() ;                               // Switch to new host
       }
-      connecttohost() ;                                 // Switch to new host
     }
   }
   if ( xmlreq )                                         // Directly xml requested?
   {
     xmlreq = false ;                                    // Yes, clear request flag
-    host = xmlparse ( host ) ;                          // Parse the xml to get the host
-    connecttohost() ;                                   // and connect to this host
+    xmlstart ( host ) ;                                 // Lookup, then connect to the host
   }
+  zappoll() ;                                           // Close old connection of a switch
   if ( reqtone )                                        // Request to change tone?
   {
     reqtone = false ;
@@ -633,6 +695,28 @@ void loop()
     vs1053player.setVolume ( ini_block.reqvol ) ;       // Unmute
   }
   displayvolume() ;                                     // Show volume on display
+  if ( pipebenchreq )                                   // Benchmark requested?
+  {
+    pipebenchreq = false ;                              // Yes, clear request
+    xSemaphoreTake ( feedlock, portMAX_DELAY ) ;        // Feeder must not run now
+    pipebench() ;                                       // and do the benchmark
+    xSemaphoreGive ( feedlock ) ;
+  }
+  if ( vscalreq || vsbenchreq )                         // VS1053 clock tests requested?
+  {
+    xSemaphoreTake ( feedlock, portMAX_DELAY ) ;        // Feeder must not run now
+    if ( vscalreq )
+    {
+      vscalibrate() ;                                   // Find best clock settings
+    }
+    if ( vsbenchreq )
+    {
+      vsbench() ;                                       // Measure throughput
+    }
+    vscalreq = false ;                                  // Clear requests
+    vsbenchreq = false ;
+    xSemaphoreGive ( feedlock ) ;
+  }
   if ( testfilename.length() )                          // File to test?
   {
     testfile ( testfilename ) ;                         // Yes, do the test
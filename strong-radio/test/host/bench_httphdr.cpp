@@ -0,0 +1,237 @@
+//******************************************************************************************
+// Host benchmark of the HTTP/ICY header parser.                                           *
+//******************************************************************************************
+// A canned ICY header is parsed three times: by the former String based parser of         *
+// handlebyte(), which is kept below as a reference, by hdrparse() byte by byte and by     *
+// hdrparse() in spans of random length.  The parsed fields must be right for all three.   *
+// The speed is shown in headers per second.  The String parser is the baseline, the speed *
+// of hdrparse() is also shown as a ratio to it.                                           *
+//******************************************************************************************
+#include "stream.h"
+
+#define PARSES         20000                   // Headers per pass
+
+const char* hdrtext =                          // Canned header of a stream
+  "ICY 200 OK\r\n"
+  "icy-notice1:<BR>This stream requires <a href=\"http://www.winamp.com\">Winamp</a><BR>\r\n"
+  "icy-notice2:SHOUTcast DNAS/posix(linux x64) v2.6.0.750<BR>\r\n"
+  "Accept-Ranges:none\r\n"
+  "Access-Control-Allow-Origin:*\r\n"
+  "Cache-Control:no-cache,no-store,must-revalidate,max-age=0\r\n"
+  "Connection:close\r\n"
+  "icy-name:  Radio Test FM - The Best Music  \r\n"
+  "icy-genre:Pop Rock\r\n"
+  "icy-br:128\r\n"
+  "icy-sr:44100\r\n"
+  "icy-url:http://www.example.com\r\n"
+  "icy-pub:1\r\n"
+  "Transfer-Encoding: chunked\r\n"
+  "content-type:audio/MPEG\r\n"
+  "icy-metaint:16000\r\n"
+  "X-Clacks-Overhead:GNU Terry Pratchett\r\n"
+  "\r\n"
+  "\xFF\xFB\x90\x64" ;                         // Start of the audio data
+
+uint32_t hdrlen ;                              // Length of header, without the audio
+
+struct result_t                                // Fields of a parsed header
+{
+  bool ok ;                                    // Header is complete
+  int  metaint ;
+  int  icybr ;
+  bool chunked ;
+  char icyname[64] ;
+  char contenttype[40] ;
+} ;
+
+//******************************************************************************************
+//                                 S T R I N G P A R S E                                   *
+//******************************************************************************************
+// The header parser as it was in handlebyte(), with metaline and a lower case copy of it  *
+// as String.  Returns the number of bytes used.                                           *
+//******************************************************************************************
+static uint32_t stringparse ( result_t* r )
+{
+  String   lcml ;                              // Lower case metaline
+  String   ct ;                                // Contents type
+  String   icyname ;                           // Station name
+  bool     ctseen = false ;                    // First line of header seen or not
+  int      LFcount = 0 ;                       // Detection of end of header
+  uint32_t i ;                                 // Index in header
+  uint8_t  b ;                                 // Next byte
+
+  metaline = "" ;
+  for ( i = 0 ; hdrtext[i] ; i++ )
+  {
+    b = hdrtext[i] ;
+    if ( ( b > 0x7F ) ||                       // Ignore unprintable characters
+         ( b == '\r' ) ||                      // Ignore CR
+         ( b == '\0' ) )                       // Ignore NULL
+    {
+      // Yes, ignore
+    }
+    else if ( b == '\n' )                      // Linefeed ?
+    {
+      LFcount++ ;                              // Count linefeeds
+      if ( chkhdrline ( metaline.c_str() ) )   // Reasonable input?
+      {
+        lcml = metaline ;                      // Use lower case for compare
+        lcml.toLowerCase() ;
+        dbgprint ( metaline.c_str() ) ;        // Yes, Show it
+        if ( lcml.indexOf ( "content-type" ) >= 0 )
+        {
+          ctseen = true ;                      // Yes, remember seeing this
+          ct = lcml.substring ( 13 ) ;         // Set contentstype
+          ct.trim() ;
+        }
+        if ( lcml.startsWith ( "icy-br:" ) )
+        {
+          r->icybr = metaline.substring(7).toInt() ;
+        }
+        else if ( lcml.startsWith ( "icy-metaint:" ) )
+        {
+          r->metaint = metaline.substring(12).toInt() ;
+        }
+        else if ( lcml.startsWith ( "icy-name:" ) )
+        {
+          icyname = metaline.substring(9) ;    // Get station name
+          icyname.trim() ;                     // Remove leading and trailing spaces
+        }
+        else if ( lcml.startsWith ( "transfer-encoding:" ) )
+        {
+          r->chunked = lcml.endsWith ( "chunked" ) ;
+        }
+      }
+      metaline = "" ;                          // Reset this line
+      if ( ( LFcount == 2 ) && ctseen )        // Some data seen and a double LF?
+      {
+        r->ok = true ;
+        i++ ;                                  // Byte is used
+        break ;
+      }
+    }
+    else
+    {
+      metaline += (char)b ;                    // Normal character, put in metaline
+      LFcount = 0 ;                            // Reset double CRLF detection
+    }
+  }
+  snprintf ( r->icyname, sizeof(r->icyname), "%s", icyname.c_str() ) ;
+  snprintf ( r->contenttype, sizeof(r->contenttype), "%s", ct.c_str() ) ;
+  return i ;
+}
+
+
+//******************************************************************************************
+//                                  H D R R E S U L T                                      *
+//******************************************************************************************
+// Copy the fields of a header parsed by hdrparse().                                       *
+//******************************************************************************************
+static void hdrresult ( const httphdr_t* h, result_t* r )
+{
+  r->ok = h->done ;
+  r->metaint = h->metaint ;
+  r->icybr = h->icybr ;
+  r->chunked = h->chunked ;
+  strcpy ( r->icyname, h->icyname ) ;
+  strcpy ( r->contenttype, h->contenttype ) ;
+}
+
+
+//******************************************************************************************
+//                                 P A R S E B Y T E S                                     *
+//******************************************************************************************
+// Parse with hdrparse(), one byte per call like hls.cpp and gapless.cpp.                  *
+//******************************************************************************************
+static uint32_t parsebytes ( result_t* r )
+{
+  uint32_t i ;                                 // Index in header
+
+  hdrinit ( &streamhdr ) ;
+  for ( i = 0 ; hdrtext[i] && !streamhdr.done ; i++ )
+  {
+    hdrparse ( &streamhdr, (const uint8_t*)hdrtext + i, 1 ) ;
+  }
+  hdrresult ( &streamhdr, r ) ;
+  return i ;
+}
+
+
+//******************************************************************************************
+//                                 P A R S E S P A N S                                     *
+//******************************************************************************************
+// Parse with hdrparse() in spans of 1 to 32 bytes, like handlebytes() gets them.          *
+//******************************************************************************************
+static uint32_t parsespans ( result_t* r )
+{
+  static uint32_t seed = 3 ;                   // For rand_r, other splits every time
+  uint32_t        len = strlen ( hdrtext ) ;   // Length of input
+  uint32_t        i = 0 ;                      // Index in header
+  uint32_t        n ;                          // Length of span
+
+  hdrinit ( &streamhdr ) ;
+  while ( ( i < len ) && !streamhdr.done )
+  {
+    n = rand_r ( &seed ) % 32 + 1 ;
+    if ( n > ( len - i ) )
+    {
+      n = len - i ;
+    }
+    i += hdrparse ( &streamhdr, (const uint8_t*)hdrtext + i, n ) ;
+  }
+  hdrresult ( &streamhdr, r ) ;
+  return i ;
+}
+
+
+//******************************************************************************************
+//                                     R U N                                               *
+//******************************************************************************************
+// Run a parser PARSES times, show the speed and check the result of every parse.  The     *
+// speed is compared with the baseline, if there is one yet.  Returns the speed in headers *
+// per second, 0 if a result was wrong.                                                    *
+//******************************************************************************************
+static uint64_t run ( const char* name, uint32_t ( *parse ) ( result_t* r ),
+                      uint64_t baseline )
+{
+  result_t r ;                                 // Result of a parse
+  uint32_t t0 ;                                // Start time
+  uint32_t us ;                                // Duration
+  uint32_t used ;                              // Bytes used by a parse
+  int      bad = 0 ;                           // Wrong results
+  int      n ;                                 // Parse number
+  uint64_t rate ;                              // Headers per second
+
+  t0 = micros() ;
+  for ( n = 0 ; n < PARSES ; n++ )
+  {
+    memset ( &r, 0, sizeof(r) ) ;
+    used = parse ( &r ) ;
+    bad += !r.ok || ( used != hdrlen ) ||
+           ( r.metaint != 16000 ) || ( r.icybr != 128 ) || !r.chunked ||
+           strcmp ( r.icyname, "Radio Test FM - The Best Music" ) ||
+           strcmp ( r.contenttype, "audio/mpeg" ) ;
+  }
+  us = micros() - t0 ;
+  rate = (uint64_t)PARSES * 1000000 / ( us ? us : 1 ) ;
+  printf ( "%-7s %8llu headers/sec, %d wrong", name, (unsigned long long)rate, bad ) ;
+  if ( baseline )
+  {
+    printf ( ", %.1f times the baseline", (double)rate / baseline ) ;
+  }
+  printf ( "\n" ) ;
+  return bad ? 0 : rate ;
+}
+
+
+int main()
+{
+  uint64_t baseline ;                          // Speed of the String parser
+  uint64_t bytes, spans ;                      // Speed of hdrparse()
+
+  hdrlen = strstr ( hdrtext, "\r\n\r\n" ) + 4 - hdrtext ;
+  baseline = run ( "String", stringparse, 0 ) ;
+  bytes = run ( "byte", parsebytes, baseline ) ;
+  spans = run ( "span", parsespans, baseline ) ;
+  return ( baseline && bytes && spans ) ? 0 : 1 ;
+}
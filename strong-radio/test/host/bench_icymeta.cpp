@@ -0,0 +1,217 @@
+//******************************************************************************************
+// Host benchmark of the ICY metadata parser.                                              *
+//******************************************************************************************
+// A series of metadata blocks, like a station sends them, is handled twice.  First as     *
+// before icymeta.cpp: collected byte by byte in the String metaline and given to the      *
+// former showstreamtitle(), which is kept below as a reference.  Then with icymetaadd()   *
+// in spans of 1 to 32 bytes and icymetaend().  The title changes every 16th block, some   *
+// titles contain a quote and some blocks have no title at all.  icymeta must show every   *
+// change of title exactly once and nothing else.  The speed is shown in blocks per        *
+// second, with the number of display updates of both.                                     *
+//******************************************************************************************
+#include "stream.h"
+
+#define BLOCKS         4096                    // Metadata blocks per pass
+#define RUNS           8                       // Passes for the timing
+#define REPEAT         16                      // Blocks with the same title
+
+uint8_t  blocks[BLOCKS][255 * 16] ;            // The metadata blocks
+uint16_t blocklen[BLOCKS] ;                    // Length of each block, multiple of 16
+char     titles[BLOCKS / REPEAT][80] ;         // The titles in the blocks
+uint32_t displays ;                            // Display updates of the reference
+String   icystreamtitle ;                      // Title for the web interface
+
+//******************************************************************************************
+//                                 M A K E B L O C K S                                     *
+//******************************************************************************************
+// Build the metadata blocks.  Every 7th block has no StreamTitle.                         *
+//******************************************************************************************
+static void makeblocks()
+{
+  int t ;                                      // Title number
+  int b ;                                      // Block number
+  int len ;                                    // Length of text in block
+
+  for ( t = 0 ; t < ( BLOCKS / REPEAT ) ; t++ )
+  {
+    snprintf ( titles[t], sizeof(titles[t]), ( t % 3 ) ? "Artist %d - Song number %d" :
+               "Guns N' Roses - Don't Cry (part %d%d)", t, t * 7 ) ;
+  }
+  for ( b = 0 ; b < BLOCKS ; b++ )
+  {
+    if ( ( b % 7 ) == 6 )
+    {
+      len = sprintf ( (char*)blocks[b], "StreamUrl='http://www.example.com/%d';", b ) ;
+    }
+    else
+    {
+      len = sprintf ( (char*)blocks[b], "StreamTitle='%s';StreamUrl='';",
+                      titles[b / REPEAT] ) ;
+    }
+    blocklen[b] = ( len + 15 ) & ~15 ;         // Padded with NUL to units of 16
+    memset ( blocks[b] + len, 0, blocklen[b] - len ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                              O L D S H O W T I T L E                                    *
+//******************************************************************************************
+// The former showstreamtitle() for metadata, without the display itself.                  *
+//******************************************************************************************
+static void oldshowtitle ( const char* ml )
+{
+  char* p1 ;
+  char* p2 ;
+  char  streamtitle[150] ;                     // Streamtitle from metadata
+
+  if ( strstr ( ml, "StreamTitle=" ) )
+  {
+    dbgprint ( "Streamtitle found, %d bytes", strlen ( ml ) ) ;
+    dbgprint ( ml ) ;
+    p1 = (char*)ml + 12 ;                      // Begin of artist and title
+    if ( ( p2 = strstr ( (char*)ml, ";" ) ) )  // Search for end of title
+    {
+      if ( *p1 == '\'' )                       // Surrounded by quotes?
+      {
+        p1++ ;
+        p2-- ;
+      }
+      *p2 = '\0' ;                             // Strip the rest of the line
+    }
+    strncpy ( streamtitle, p1, sizeof ( streamtitle ) ) ;
+    streamtitle[sizeof ( streamtitle ) - 1] = '\0' ;
+  }
+  else
+  {
+    icystreamtitle = "" ;                      // Unknown type
+    return ;                                   // Do not show
+  }
+  icystreamtitle = streamtitle ;
+  if ( ( p1 = strstr ( streamtitle, " - " ) ) )
+  {
+    *p1++ = '\n' ;                             // Found: replace 3 characters by newline
+    p2 = p1 + 2 ;
+    if ( *p2 == ' ' )                          // Leading space in title?
+    {
+      p2++ ;
+    }
+    memmove ( p1, p2, strlen ( p2 ) + 1 ) ;    // Shift 2nd part of title
+  }
+  displays++ ;                                 // Was displayinfo()
+}
+
+
+//******************************************************************************************
+//                                  P A S S S T R I N G                                    *
+//******************************************************************************************
+// Handle the blocks as handlebyte() did before icymeta.cpp.                               *
+//******************************************************************************************
+static void passstring()
+{
+  int      b ;                                 // Block number
+  uint16_t i ;                                 // Index in block
+
+  for ( b = 0 ; b < BLOCKS ; b++ )
+  {
+    metaline = "" ;
+    for ( i = 0 ; i < blocklen[b] ; i++ )
+    {
+      metaline += (char)blocks[b][i] ;         // Put new char in metaline
+    }
+    if ( metaline.length() )                   // Any info present?
+    {
+      oldshowtitle ( metaline.c_str() ) ;      // Works on the copy in metaline
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                 P A S S I C Y M E T A                                   *
+//******************************************************************************************
+// Handle the blocks with icymeta, in spans like handlebytes() gets them.                  *
+//******************************************************************************************
+static void passicymeta()
+{
+  uint32_t seed = 5 ;                          // For rand_r
+  int      b ;                                 // Block number
+  uint16_t i ;                                 // Index in block
+  uint16_t n ;                                 // Length of span
+
+  icymetainit ( &icymeta ) ;
+  for ( b = 0 ; b < BLOCKS ; b++ )
+  {
+    for ( i = 0 ; i < blocklen[b] ; i += n )
+    {
+      n = rand_r ( &seed ) % 32 + 1 ;
+      if ( n > ( blocklen[b] - i ) )
+      {
+        n = blocklen[b] - i ;
+      }
+      icymetaadd ( &icymeta, blocks[b] + i, n ) ;
+    }
+    icymetaend ( &icymeta ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                     R U N                                               *
+//******************************************************************************************
+// Run a pass RUNS times and show the speed and the display updates of the last run.       *
+//******************************************************************************************
+static void run ( const char* name, void ( *pass )(), const uint32_t* shown )
+{
+  uint32_t t0 ;                                // Start time
+  uint32_t us ;                                // Duration
+  int      r ;                                 // Run
+
+  t0 = micros() ;
+  for ( r = 0 ; r < RUNS ; r++ )
+  {
+    vs1053player.reset() ;
+    displays = 0 ;
+    pass() ;
+  }
+  us = micros() - t0 ;
+  printf ( "%-8s %9llu blocks/sec, %u display updates\n", name,
+           (unsigned long long)BLOCKS * RUNS * 1000000 / ( us ? us : 1 ), *shown ) ;
+}
+
+
+int main()
+{
+  uint32_t h = 2166136261 ;                    // Expected hash of the titles shown
+  uint32_t t ;                                 // Title number
+  uint32_t withtitle = 0 ;                     // Blocks with a StreamTitle
+  int      b ;                                 // Block number
+  const char* p ;                              // Scan pointer
+
+  makeblocks() ;
+  for ( b = 0 ; b < BLOCKS ; b++ )
+  {
+    withtitle += ( ( b % 7 ) != 6 ) ;
+  }
+  for ( t = 0 ; t < ( BLOCKS / REPEAT ) ; t++ )
+  {
+    for ( p = titles[t] ; *p ; p++ )
+    {
+      h = ( h ^ (uint8_t)*p ) * 16777619 ;
+    }
+  }
+  run ( "String", passstring, &displays ) ;
+  if ( displays != withtitle )
+  {
+    printf ( "Reference showed %u titles, expected %u\n", displays, withtitle ) ;
+    return 1 ;
+  }
+  run ( "icymeta", passicymeta, &vs1053player.titles ) ;
+  if ( ( vs1053player.titles != ( BLOCKS / REPEAT ) ) || ( vs1053player.titlehash != h ) )
+  {
+    printf ( "icymeta showed %u titles, expected %d\n", vs1053player.titles,
+             BLOCKS / REPEAT ) ;
+    return 1 ;
+  }
+  return 0 ;
+}
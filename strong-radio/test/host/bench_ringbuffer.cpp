@@ -0,0 +1,154 @@
+//******************************************************************************************
+// Host benchmark of the ringbuffer: byte-at-a-time versus spans.                          *
+//******************************************************************************************
+// The same data is moved through the ringbuffer twice.  First with putring()/getring()    *
+// per byte, then with ringwspan()/ringwcommit() in blocks of 1024 bytes (one read from    *
+// the socket) and ringrspan()/ringrcommit() in blocks of 32 bytes (one DREQ of the        *
+// VS1053).  The throughput is shown in bytes/sec.  Both passes read the same bytes, this  *
+// is checked with a sum over all bytes read.                                              *
+//******************************************************************************************
+#include "host.h"
+
+#define RINGBFSIZ      20000                   // Default size, as in main.cpp
+#define BENCHBYTES     50000000                // Bytes per pass
+#define WBLOCK         1024                    // Bytes per write, like loop() reads
+#define RBLOCK         32                      // Bytes per read, like the feeder
+
+uint8_t*              ringbuf ;                // Globals of main.cpp used by the ringbuffer
+uint32_t              ringbfsiz ;
+bool                  ringpsram = false ;
+std::atomic<uint32_t> rbwindex ( 0 ) ;
+std::atomic<uint32_t> rbrindex ( 0 ) ;
+
+#include "ringbuffer.cpp"
+
+uint8_t  src[WBLOCK + 256] ;                   // Data from "the socket", period 256
+uint8_t  dst[RBLOCK] ;                         // Data to "the decoder"
+uint32_t sum ;                                 // Checksum of data read
+
+//******************************************************************************************
+//                                 C H E C K S U M                                         *
+//******************************************************************************************
+// Add n bytes of dst to the checksum.                                                     *
+//******************************************************************************************
+static inline void checksum ( uint32_t n )
+{
+  uint32_t j ;                                 // Index in dst
+
+  for ( j = 0 ; j < n ; j++ )
+  {
+    sum = sum * 31 + dst[j] ;
+  }
+}
+
+
+//******************************************************************************************
+//                                P A S S B Y T E S                                        *
+//******************************************************************************************
+// Move BENCHBYTES through the ringbuffer with putring() and getring().                    *
+//******************************************************************************************
+static void passbytes()
+{
+  uint32_t i = 0 ;                             // Bytes written
+  uint32_t j ;                                 // Index in block
+
+  while ( i < BENCHBYTES )
+  {
+    for ( j = 0 ; ( j < WBLOCK ) && ( i < BENCHBYTES ) && ringspace() ; j++ )
+    {
+      putring ( src[i++ % 256] ) ;
+    }
+    while ( ringavail() >= RBLOCK )
+    {
+      for ( j = 0 ; j < RBLOCK ; j++ )
+      {
+        dst[j] = getring() ;
+      }
+      checksum ( RBLOCK ) ;
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                P A S S S P A N S                                        *
+//******************************************************************************************
+// Move BENCHBYTES through the ringbuffer with spans.                                      *
+//******************************************************************************************
+static void passspans()
+{
+  uint32_t i = 0 ;                             // Bytes written
+  uint32_t n ;                                 // Length of span
+  uint8_t* p ;                                 // Span in ringbuffer
+
+  while ( i < BENCHBYTES )
+  {
+    n = ringwspan ( &p ) ;
+    if ( n > WBLOCK )
+    {
+      n = WBLOCK ;
+    }
+    if ( n > ( BENCHBYTES - i ) )
+    {
+      n = BENCHBYTES - i ;
+    }
+    memcpy ( p, src + i % 256, n ) ;           // Like mp3client->read ( p, n )
+    ringwcommit ( n ) ;
+    i += n ;
+    while ( ringavail() >= RBLOCK )
+    {
+      n = ringrspan ( &p ) ;
+      if ( n > RBLOCK )
+      {
+        n = RBLOCK ;
+      }
+      memcpy ( dst, p, n ) ;                   // Like playChunk ( p, n )
+      checksum ( n ) ;
+      ringrcommit ( n ) ;
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                   R U N                                                 *
+//******************************************************************************************
+// Run a pass and show the throughput.  Returns the checksum of the data read.             *
+//******************************************************************************************
+static uint32_t run ( const char* name, void ( *pass )() )
+{
+  uint32_t t0 ;                                // Start time in usec
+  uint32_t us ;                                // Duration
+
+  allocring ( RINGBFSIZ ) ;
+  sum = 0 ;
+  t0 = micros() ;
+  pass() ;
+  us = micros() - t0 ;
+  printf ( "%-6s %9llu bytes/sec\n", name,
+           (unsigned long long)BENCHBYTES * 1000000 / ( us ? us : 1 ) ) ;
+  free ( ringbuf ) ;
+  rbwindex = 0 ;
+  rbrindex = 0 ;
+  return sum ;
+}
+
+
+int main()
+{
+  uint32_t sb, ss ;                            // Checksums of both passes
+  int      i ;                                 // Index in src
+
+  for ( i = 0 ; i < ( WBLOCK + 256 ) ; i++ )
+  {
+    src[i] = i * 13 ;                          // Same as src[i % 256]
+  }
+  sb = run ( "byte", passbytes ) ;
+  ss = run ( "span", passspans ) ;
+  if ( sb != ss )
+  {
+    printf ( "Checksums differ: %u %u\n", sb, ss ) ;
+    return 1 ;
+  }
+  return 0 ;
+}
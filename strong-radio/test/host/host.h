@@ -0,0 +1,146 @@
+//******************************************************************************************
+// Host shim for the modules.                                                              *
+//******************************************************************************************
+// The modules in lib/modules are compiled as part of main.cpp on the ESP32.  For a test   *
+// on the host, a test program defines the globals of main.cpp that a module needs and     *
+// includes the .cpp file of the module after this file.  This file provides the parts of  *
+// the Arduino core that the modules use, with the host clock and stdio.                   *
+// Set DBG in the environment to see the output of dbgprint().                             *
+//******************************************************************************************
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+//******************************************************************************************
+// Time.                                                                                   *
+//******************************************************************************************
+inline uint32_t micros()
+{
+  static auto t0 = std::chrono::steady_clock::now() ;
+
+  return std::chrono::duration_cast<std::chrono::microseconds> (
+           std::chrono::steady_clock::now() - t0 ).count() ;
+}
+
+inline uint32_t millis()
+{
+  return micros() / 1000 ;
+}
+
+inline void delay ( uint32_t ms )
+{
+  std::this_thread::sleep_for ( std::chrono::milliseconds ( ms ) ) ;
+}
+
+inline void yield()
+{
+  std::this_thread::yield() ;
+}
+
+//******************************************************************************************
+// Memory.                                                                                 *
+//******************************************************************************************
+inline bool psramFound()
+{
+  return false ;
+}
+
+inline void* ps_malloc ( size_t size )
+{
+  return malloc ( size ) ;
+}
+
+//******************************************************************************************
+// The part of the Arduino String class that the modules use.                              *
+//******************************************************************************************
+class String
+{
+  public:
+    String ( const char* c = "" ) : s ( c ? c : "" ) {}
+    String ( const std::string& x ) : s ( x ) {}
+    String& operator+= ( char c )                  { s += c ; return *this ; }
+    String& operator+= ( const char* c )           { s += c ; return *this ; }
+    String& operator+= ( const String& x )         { s += x.s ; return *this ; }
+    String  operator+ ( const String& x ) const    { return String ( s + x.s ) ; }
+    bool    operator== ( const char* c ) const     { return s == c ; }
+    bool    operator!= ( const char* c ) const     { return s != c ; }
+    bool    operator== ( const String& x ) const   { return s == x.s ; }
+    bool    operator!= ( const String& x ) const   { return s != x.s ; }
+    char    operator[] ( unsigned i ) const        { return s[i] ; }
+    unsigned    length() const                     { return s.size() ; }
+    const char* c_str() const                      { return s.c_str() ; }
+    void    reserve ( unsigned n )                 { s.reserve ( n ) ; }
+    int     indexOf ( const char* x ) const        { return find ( x, 0 ) ; }
+    int     indexOf ( const char* x, int from ) const { return find ( x, from ) ; }
+    int     indexOf ( char c ) const               { char x[2] = { c, 0 } ; return find ( x, 0 ) ; }
+    bool    startsWith ( const char* x ) const     { return s.compare ( 0, strlen ( x ), x ) == 0 ; }
+    bool    endsWith ( const char* x ) const
+    {
+      size_t n = strlen ( x ) ;
+      return ( s.size() >= n ) && ( s.compare ( s.size() - n, n, x ) == 0 ) ;
+    }
+    String  substring ( unsigned from ) const
+    {
+      return ( from < s.size() ) ? String ( s.substr ( from ) ) : String() ;
+    }
+    String  substring ( unsigned from, unsigned to ) const
+    {
+      return ( from < s.size() ) ? String ( s.substr ( from, to - from ) ) : String() ;
+    }
+    long    toInt() const                          { return atol ( s.c_str() ) ; }
+    void    toLowerCase()
+    {
+      for ( auto& c : s )
+      {
+        c = tolower ( c ) ;
+      }
+    }
+    void    trim()
+    {
+      size_t a = s.find_first_not_of ( " \t\r\n" ) ;
+      size_t b = s.find_last_not_of ( " \t\r\n" ) ;
+      s = ( a == std::string::npos ) ? "" : s.substr ( a, b - a + 1 ) ;
+    }
+  private:
+    int     find ( const char* x, int from ) const
+    {
+      size_t p = s.find ( x, from ) ;
+      return ( p == std::string::npos ) ? -1 : (int)p ;
+    }
+    std::string s ;
+} ;
+
+inline String operator+ ( const char* a, const String& b )
+{
+  return String ( a ) + b ;
+}
+
+//******************************************************************************************
+// Debug output.                                                                           *
+//******************************************************************************************
+inline char* dbgprint ( const char* format, ... )
+{
+  static char sbuf[200] ;                      // For debug lines
+  va_list     varArgs ;                        // For variable number of params
+
+  va_start ( varArgs, format ) ;
+  vsnprintf ( sbuf, sizeof(sbuf), format, varArgs ) ;
+  va_end ( varArgs ) ;
+  if ( getenv ( "DBG" ) )
+  {
+    printf ( "D: %s\n", sbuf ) ;
+  }
+  return sbuf ;
+}
+
+#endif
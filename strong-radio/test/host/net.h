@@ -0,0 +1,151 @@
+//******************************************************************************************
+// Network on the host.                                                                    *
+//******************************************************************************************
+// Provides the parts of lwIP and the Arduino WiFiClient that hostconn.cpp and the stream  *
+// modules use, on top of the sockets of the host.  The DNS lookup of lwIP is replaced by  *
+// one that resolves every host name to 127.0.0.1, so a test server on the loopback serves *
+// all hosts.  The result of a name is delivered by a callback from another thread, like   *
+// the lwIP task does, with tcpiplock held.  A numeric address is known at once.           *
+//******************************************************************************************
+#ifndef NET_H
+#define NET_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <mutex>
+
+//******************************************************************************************
+// DNS lookup of lwIP.                                                                     *
+//******************************************************************************************
+typedef int8_t err_t ;
+
+#define ERR_OK         0                       // Result known
+#define ERR_INPROGRESS -5                      // Result by callback
+#define ERR_ARG        -16                     // Bad name
+
+struct ip4_addr_t
+{
+  uint32_t addr ;                              // Address in network order
+} ;
+
+typedef ip4_addr_t ip_addr_t ;
+
+#define ip_2_ip4(ip)   (ip)
+
+typedef void ( *dns_found_callback ) ( const char* name, const ip_addr_t* ipaddr,
+                                       void* arg ) ;
+
+std::recursive_mutex   tcpiplock ;             // Core lock of the lwIP task
+
+#define LOCK_TCPIP_CORE()   tcpiplock.lock()
+#define UNLOCK_TCPIP_CORE() tcpiplock.unlock()
+
+inline err_t dns_gethostbyname ( const char* name, ip_addr_t* addr, dns_found_callback found,
+                                 void* arg )
+{
+  if ( ( name == NULL ) || ( *name == '\0' ) )
+  {
+    return ERR_ARG ;
+  }
+  if ( inet_pton ( AF_INET, name, &addr->addr ) == 1 ) // Numeric address?
+  {
+    return ERR_OK ;                            // Yes, known at once
+  }
+  std::thread ( [found, arg] ( std::string host )
+  {
+    ip_addr_t ip ;                             // Every host is on the loopback
+
+    delay ( 1 ) ;                              // Lookup takes some time
+    ip.addr = htonl ( INADDR_LOOPBACK ) ;
+    std::lock_guard<std::recursive_mutex> lock ( tcpiplock ) ;
+    found ( host.c_str(), &ip, arg ) ;
+  }, std::string ( name ) ).detach() ;
+  return ERR_INPROGRESS ;
+}
+
+//******************************************************************************************
+// WiFiClient on a connected socket.  Like on the ESP32, reads never wait and connected()  *
+// is true until all data of a closed connection has been read.                            *
+//******************************************************************************************
+class WiFiClient
+{
+  public:
+    WiFiClient ( int fd ) : sock ( fd )
+    {
+    }
+
+    ~WiFiClient()
+    {
+      stop() ;
+    }
+
+    int     fd()                               { return sock ; }
+
+    int     available()
+    {
+      int n = 0 ;                              // Bytes in the socket
+
+      if ( ( sock < 0 ) || ( ioctl ( sock, FIONREAD, &n ) < 0 ) )
+      {
+        return 0 ;
+      }
+      return n ;
+    }
+
+    bool    connected()
+    {
+      uint8_t b ;                              // Peeked byte
+      int     res ;                            // Result of recv
+
+      if ( sock < 0 )
+      {
+        return false ;
+      }
+      res = recv ( sock, &b, 1, MSG_PEEK | MSG_DONTWAIT ) ;
+      if ( res > 0 )
+      {
+        return true ;                          // Data to read
+      }
+      return ( res < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) ;
+    }
+
+    int     read()
+    {
+      uint8_t b ;                              // Byte read
+
+      if ( read ( &b, 1 ) != 1 )
+      {
+        return -1 ;
+      }
+      return b ;
+    }
+
+    int     read ( uint8_t* buf, size_t len )
+    {
+      if ( sock < 0 )
+      {
+        return -1 ;
+      }
+      return recv ( sock, buf, len, MSG_DONTWAIT ) ;
+    }
+
+    void    stop()
+    {
+      if ( sock >= 0 )
+      {
+        close ( sock ) ;
+        sock = -1 ;
+      }
+    }
+
+  private:
+    int sock ;                                 // Socket, -1 if closed
+} ;
+
+#endif
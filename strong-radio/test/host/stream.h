@@ -0,0 +1,145 @@
+//******************************************************************************************
+// Stream handling of main.cpp on the host.                                                *
+//******************************************************************************************
+// Defines the globals of main.cpp for the stream path and includes the modules from the   *
+// header parser up to the pipelines.  The VS1053 is replaced by a sink that counts the    *
+// bytes played and keeps a hash of them, titles are counted and hashed as well.  Parts    *
+// that are not used by the tests (playlists, display) are stubs.  A test that includes    *
+// hls.cpp defines HOST_HLS.                                                               *
+//******************************************************************************************
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "host.h"
+
+#define YELLOW         0                       // Colors of the display
+#define MAXPRESETS     100                     // As in main.cpp
+
+enum datamode_t { INIT = 1, HEADER = 2, DATA = 4,
+                  METADATA = 8, PLAYLISTINIT = 16,
+                  PLAYLISTHEADER = 32, PLAYLISTDATA = 64,
+                  STOPREQD = 128, STOPPED = 256
+                } ;        // State for datastream
+
+uint32_t         totalcount = 0 ;              // Globals of main.cpp for the stream
+datamode_t       datamode = STOPPED ;
+int              metacount ;
+int              datacount ;
+String           metaline ;
+int              bitrate ;
+int              metaint = 0 ;
+bool             chunked = false ;
+#if !defined ( HOST_HLS )                      // Else defined by hls.cpp
+bool             hlsactive = false ;
+#else
+extern bool      hlsactive ;
+#endif
+
+//******************************************************************************************
+// Sink for the VS1053.                                                                    *
+//******************************************************************************************
+struct sink_t
+{
+  uint64_t bytes ;                             // Bytes played
+  uint32_t hash ;                              // FNV-1a of the bytes played
+  uint32_t chunks ;                            // Calls of playChunk()
+  size_t   maxchunk ;                          // Longest chunk, VS1053 takes 32 per DREQ
+  uint32_t titles ;                            // Titles shown
+  uint32_t titlehash ;                         // FNV-1a of the titles
+
+  void reset()
+  {
+    bytes = 0 ;
+    hash = 2166136261 ;
+    chunks = 0 ;
+    maxchunk = 0 ;
+    titles = 0 ;
+    titlehash = 2166136261 ;
+  }
+
+  void playChunk ( const uint8_t* p, size_t len )
+  {
+    size_t i ;
+
+    for ( i = 0 ; i < len ; i++ )
+    {
+      hash = ( hash ^ p[i] ) * 16777619 ;
+    }
+    bytes += len ;
+    chunks++ ;
+    if ( len > maxchunk )
+    {
+      maxchunk = len ;
+    }
+  }
+
+  void startSong() {}
+  void stopSong() {}
+  void loadPlugin ( const uint16_t* plugin, size_t len ) {}
+} ;
+
+sink_t vs1053player ;                          // Receives the audio
+
+inline void showstreamtitle ( const char* ml )
+{
+  vs1053player.titles++ ;
+  while ( *ml )
+  {
+    vs1053player.titlehash = ( vs1053player.titlehash ^ (uint8_t)*ml++ ) * 16777619 ;
+  }
+}
+
+inline void displayinfo ( const char* str, uint16_t pos, uint16_t height, uint16_t color )
+{
+}
+
+//******************************************************************************************
+// No SPIFFS on the host, plugins are not found.                                           *
+//******************************************************************************************
+struct File
+{
+  operator bool() const                        { return false ; }
+  size_t size()                                { return 0 ; }
+  size_t read ( uint8_t* buf, size_t len )     { return 0 ; }
+  void   close()                               {}
+} ;
+
+struct
+{
+  File open ( const char* path, const char* mode ) { return File() ; }
+} SPIFFS ;
+
+//******************************************************************************************
+// Playlists are not handled.                                                              *
+//******************************************************************************************
+inline void playlistinit()
+{
+}
+
+inline void playlistline ( const char* line )
+{
+}
+
+//******************************************************************************************
+// Forward declarations, main.cpp has them or the modules are in another order there.      *
+//******************************************************************************************
+typedef uint32_t ( *streamfunc_t ) ( uint8_t* p, uint32_t len ) ;
+extern streamfunc_t streamfunc ;
+extern bool         pipemute ;
+streamfunc_t pipeselect() ;
+void     handlebyte ( uint8_t b, bool force = false ) ;
+uint32_t handlebytes ( uint8_t* p, uint32_t len ) ;
+uint32_t handlebytes_ch ( uint8_t* p, uint32_t len ) ;
+uint32_t playrun ( uint8_t* p, uint32_t len ) ;
+bool     chkhdrline ( const char* str ) ;
+
+#include "httphdr.cpp"
+#include "chunked.cpp"
+#include "mpegsync.cpp"
+#include "icymeta.cpp"
+#include "tsdemux.cpp"
+#include "sniff.cpp"
+#include "byteutils.cpp"
+#include "pipeline.cpp"
+
+#endif
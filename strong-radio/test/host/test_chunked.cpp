@@ -0,0 +1,180 @@
+//******************************************************************************************
+// Host test of the chunked transfer decoder with random split points.                     *
+//******************************************************************************************
+// A random body is encoded with chunks of random size.  Chunksize lines mix upper and     *
+// lower case hex, extensions and bare LF line ends, the body ends with trailers.  The     *
+// encoded stream is cut at random points and fed to chunkdecode() span by span, one of    *
+// the trials in spans of a single byte and one as a whole.  The payload must equal the    *
+// body and the decoder must end in CH_DONE.  Chunksize lines with too many digits or with *
+// white space between the digits must be rejected.                                        *
+//******************************************************************************************
+#include "host.h"
+#include "chunked.cpp"
+
+#define BODYSIZ        300000                  // Bytes of payload
+#define TRIALS         200                     // Number of random splits
+
+uint8_t  body[BODYSIZ] ;                       // Original payload
+uint8_t  enc[BODYSIZ * 2] ;                    // Chunked stream
+uint32_t enclen ;                              // Length of chunked stream
+uint8_t  out[BODYSIZ + 1] ;                    // Decoded payload
+uint32_t outlen ;                              // Length of decoded payload
+
+//******************************************************************************************
+//                                   E N C O D E                                           *
+//******************************************************************************************
+// Encode the body as a chunked stream.                                                    *
+//******************************************************************************************
+static void encode()
+{
+  uint32_t seed = 99 ;                         // For rand_r
+  uint32_t i = 0 ;                             // Index in body
+  uint32_t n ;                                 // Size of chunk
+  int      k = 0 ;                             // Chunk number
+  const char* eol ;                            // CRLF or LF
+
+  for ( i = 0 ; i < BODYSIZ ; i++ )
+  {
+    body[i] = rand_r ( &seed ) ;
+  }
+  enclen = 0 ;
+  for ( i = 0 ; i < BODYSIZ ; i += n )
+  {
+    n = rand_r ( &seed ) % 5000 + 1 ;
+    if ( n > ( BODYSIZ - i ) )
+    {
+      n = BODYSIZ - i ;
+    }
+    eol = ( k % 5 == 4 ) ? "\n" : "\r\n" ;
+    switch ( k++ % 4 )
+    {
+      case 0 :
+        enclen += sprintf ( (char*)enc + enclen, "%X%s", n, eol ) ;
+        break ;
+      case 1 :
+        enclen += sprintf ( (char*)enc + enclen, "%x%s", n, eol ) ;
+        break ;
+      case 2 :
+        enclen += sprintf ( (char*)enc + enclen, "%X;name=\"v;1\"%s", n, eol ) ;
+        break ;
+      default :
+        enclen += sprintf ( (char*)enc + enclen, "00%x \t%s", n, eol ) ;
+        break ;
+    }
+    memcpy ( enc + enclen, body + i, n ) ;
+    enclen += n ;
+    enclen += sprintf ( (char*)enc + enclen, "%s", eol ) ;
+  }
+  enclen += sprintf ( (char*)enc + enclen, "0\r\nX-Trailer: a\r\nX-Other: b\r\n\r\n" ) ;
+}
+
+
+//******************************************************************************************
+//                                   D E C O D E                                           *
+//******************************************************************************************
+// Decode the stream in spans of 1 to maxspan bytes, 0 is the whole stream in one span.    *
+// Returns true if the payload equals the body.                                            *
+//******************************************************************************************
+static bool decode ( uint32_t seed, uint32_t maxspan )
+{
+  chunkdec_t     cd ;                          // Decoder state
+  const uint8_t* pl ;                          // Payload in span
+  uint32_t       plen ;                        // Length of payload
+  uint32_t       i = 0 ;                       // Index in stream
+  uint32_t       n ;                           // Length of span
+  uint32_t       used ;                        // Bytes used by chunkdecode
+
+  chunkinit ( &cd ) ;
+  outlen = 0 ;
+  while ( i < enclen )
+  {
+    n = maxspan ? ( rand_r ( &seed ) % maxspan + 1 ) : enclen ;
+    if ( n > ( enclen - i ) )
+    {
+      n = enclen - i ;
+    }
+    while ( n )                                // Rest of span, like pipeline()
+    {
+      used = chunkdecode ( &cd, enc + i, n, &pl, &plen ) ;
+      if ( ( used == 0 ) || ( used > n ) ||    // Must make progress within span
+           ( plen > ( BODYSIZ - outlen ) ) )
+      {
+        return false ;
+      }
+      if ( plen )
+      {
+        memcpy ( out + outlen, pl, plen ) ;    // Collect the payload
+        outlen += plen ;
+      }
+      i += used ;
+      n -= used ;
+    }
+  }
+  return ( cd.state == CH_DONE ) && ( outlen == BODYSIZ ) &&
+         ( memcmp ( out, body, BODYSIZ ) == 0 ) ;
+}
+
+
+//******************************************************************************************
+//                                   S I Z E L I N E                                       *
+//******************************************************************************************
+// Decode a chunksize line and the start of its payload.  Returns the state of the         *
+// decoder, and prints it if it is not the expected one.                                   *
+//******************************************************************************************
+static int sizeline ( const char* line, chunkstate_t expect )
+{
+  static const char* names[] = { "CH_SIZE", "CH_EXT", "CH_DATA", "CH_DATAEND",
+                                 "CH_TRAILER", "CH_DONE", "CH_ERROR" } ;
+  chunkdec_t         cd ;                      // Decoder state
+  const uint8_t*     pl ;                      // Payload in span
+  uint32_t           plen ;                    // Length of payload
+  uint32_t           len = strlen ( line ) ;   // Length of line and payload
+  uint32_t           used ;                    // Bytes used by chunkdecode
+
+  chunkinit ( &cd ) ;
+  for ( const uint8_t* p = (const uint8_t*)line ; len ; p += used, len -= used )
+  {
+    used = chunkdecode ( &cd, p, len, &pl, &plen ) ;
+  }
+  if ( cd.state != expect )
+  {
+    printf ( "Chunksize line \"%.*s\": %s, expected %s\n", (int)strcspn ( line, "\r\n" ),
+             line, names[cd.state], names[expect] ) ;
+    return 1 ;
+  }
+  return 0 ;
+}
+
+
+int main()
+{
+  uint32_t seed = 1 ;                          // For the split points
+  uint32_t maxspan ;                           // Longest span of a trial
+  uint32_t t0 ;                                // Start of timing
+  int      trial ;                             // Trial number
+  int      failed = 0 ;                        // Failed trials
+
+  failed += sizeline ( "FFFFFFFF\r\nabc", CH_DATA ) ;       // 8 digits
+  failed += sizeline ( "0000000c  \t\r\nabc", CH_DATA ) ;   // Trailing white space
+  failed += sizeline ( "100000000\r\nabc", CH_ERROR ) ;     // 9 digits
+  failed += sizeline ( "000000001\r\nabc", CH_ERROR ) ;
+  failed += sizeline ( "1 2\r\nabc", CH_ERROR ) ;           // White space between digits
+  failed += sizeline ( "1\t2;x=1\r\nabc", CH_ERROR ) ;
+  encode() ;
+  failed += !decode ( 0, 1 ) ;                 // All bytes separately
+  failed += !decode ( 0, 0 ) ;                 // One span
+  for ( trial = 0 ; trial < TRIALS ; trial++ )
+  {
+    maxspan = ( trial & 1 ) ? 40 : 3000 ;      // Short and long spans
+    if ( !decode ( rand_r ( &seed ), maxspan ) )
+    {
+      printf ( "Trial %d failed at %u of %d bytes\n", trial, outlen, BODYSIZ ) ;
+      failed++ ;
+    }
+  }
+  t0 = micros() ;
+  decode ( 5, 1500 ) ;
+  printf ( "Chunked: %d trials, %d failed, decode %.1f MB/s\n", TRIALS + 2, failed,
+           (double)enclen / ( micros() - t0 + 1 ) ) ;
+  return failed ? 1 : 0 ;
+}
@@ -0,0 +1,661 @@
+//******************************************************************************************
+// Host test of the HLS client and the transport stream demultiplexer.                     *
+//******************************************************************************************
+// A canned HTTP server on the loopback serves every host of the test.  The master         *
+// playlist is reached by a redirect and comes chunked, it has two variants.  A live media *
+// playlist has two versions, the second one is chunked.  The segments are MPEG-TS, one of *
+// them chunked.  Every request goes through hostconn.cpp, the stream of segments through  *
+// the ringbuffer, the stream path and the gapless prefetch, like on the radio: hlspoll()  *
+// must choose the variant with the lowest bandwidth and start near the live edge, the     *
+// prefetch must play the next segments without gaps and a reload may only add the new     *
+// ones.  The audio played must be the elementary streams of the segments, in order.       *
+// A redirect to a URL that cannot be used must stop the client without another request.   *
+// No request may ask for ICY metadata.                                                    *
+// A segment is also fed to tsfeed() directly with random split points and garbage that    *
+// contains sync bytes in front of the audio.  Only the garbage may be dropped.            *
+//******************************************************************************************
+#define HOST_HLS                               // hls.cpp defines hlsactive
+#include "stream.h"
+#include "net.h"
+#include <string>
+#include <vector>
+
+#define WHITE          0                       // Color of the display
+#define RINGBFSIZ      20000                   // As in main.cpp
+#define ESSIZ          60000                   // Bytes of audio in a segment
+#define SEGSIZ         ( ESSIZ * 3 / 2 )       // Room for a segment
+#define SEGFIRST       100                     // Number of first segment on the server
+#define SEGS           9                       // Segments on the server
+#define SEGCHUNKED     104                     // Segment sent chunked
+#define AUDIOPID       0x101                   // PID of the audio PES
+#define VIDEOPID       0x100                   // PID of the video PES
+#define TRIALS         50                      // Number of random splits
+#define RUNMS          10000                   // Max duration of a run
+
+//******************************************************************************************
+// Canned server.  A URL may have several versions, each is served once and the last one   *
+// is served from then on.  The segments are "seg<n>.ts" in any directory.  "example.com/" *
+// in a response is served as "example.com:<port>/".                                       *
+//******************************************************************************************
+struct canned_t
+{
+  const char* url ;                            // URL without "http://" and port
+  const char* head ;                           // HTTP header
+  const char* body ;                           // Playlist
+  bool        served ;                         // Version has been served
+} ;
+
+struct segment_t
+{
+  uint8_t  data[SEGSIZ] ;                      // The segment, MPEG-TS
+  uint32_t len ;                               // Length of the segment
+  uint8_t  es[ESSIZ] ;                         // Audio in the segment
+} ;
+
+canned_t canned[] =
+{
+  { "radio.example.com/master.m3u8",
+    "HTTP/1.1 302 Found\r\nLocation: http://radio.example.com/live/master.m3u8\r\n"
+    "Content-Type: text/html\r\n\r\n",
+    "" },
+  { "radio.example.com/live/master.m3u8",
+    "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.apple.mpegurl\r\n"
+    "Transfer-Encoding: chunked\r\n\r\n",
+    "#EXTM3U\n"
+    "#EXT-X-VERSION:3\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=256000,CODECS=\"mp4a.40.2\"\n"
+    "hi/index.m3u8\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=64000,CODECS=\"mp4a.40.5\"\n"
+    "lo/index.m3u8\n" },
+  { "radio.example.com/live/lo/index.m3u8",
+    "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.apple.mpegurl\r\n\r\n",
+    "#EXTM3U\r\n"
+    "#EXT-X-TARGETDURATION:6\r\n"
+    "#EXT-X-MEDIA-SEQUENCE:100\r\n"
+    "#EXTINF:6.0,\r\nseg100.ts\r\n"
+    "#EXTINF:6.0,\r\nseg101.ts\r\n"
+    "#EXTINF:6.0,\r\nseg102.ts\r\n"
+    "#EXTINF:6.0,\r\nseg103.ts\r\n"
+    "#EXTINF:6.0,\r\nseg104.ts\r\n"
+    "#EXTINF:6.0,\r\nseg105.ts" },             // Last line without linefeed
+  { "radio.example.com/live/lo/index.m3u8",
+    "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.apple.mpegurl\r\n"
+    "Transfer-Encoding: chunked\r\n\r\n",
+    "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:6\n"
+    "#EXT-X-MEDIA-SEQUENCE:103\n"
+    "#EXT-X-KEY:METHOD=NONE\n"
+    "#EXTINF:6.0,\nseg103.ts\n"
+    "#EXTINF:6.0,\nseg104.ts\n"
+    "#EXTINF:6.0,\nseg105.ts\n"
+    "#EXTINF:6.0,\nseg106.ts\n"
+    "#EXTINF:6.0,\n/live/lo/seg107.ts\n"
+    "#EXTINF:6.0,\nhttp://cdn.example.com/lo/seg108.ts\n"
+    "#EXT-X-ENDLIST\n" },
+  { "radio.example.com/bad.m3u8",
+    "HTTP/1.1 301 Moved Permanently\r\n"
+    "Location: https://radio.example.com/live/master.m3u8\r\n"
+    "Content-Type: text/html\r\n\r\n",
+    "" }
+} ;
+
+segment_t        segs[SEGS] ;                  // Segments on the server
+int              listenfd ;                    // Socket of the server
+uint16_t         port ;                        // Port of the server
+std::mutex       serverlock ;                  // Protects the log of the server
+int              requests ;                    // Number of requests to the server
+int              icyrequests ;                 // Requests with Icy-MetaData
+std::vector<int> segserved ;                   // Segments in order of request
+
+//******************************************************************************************
+// The parts of main.cpp and of the tasks that the modules use.                            *
+//******************************************************************************************
+typedef std::mutex* SemaphoreHandle_t ;
+
+#define portMAX_DELAY  0xFFFFFFFF
+
+inline void xSemaphoreTake ( SemaphoreHandle_t s, uint32_t ticks )
+{
+  s->lock() ;
+}
+
+inline void xSemaphoreGive ( SemaphoreHandle_t s )
+{
+  s->unlock() ;
+}
+
+std::mutex            feedmutex ;              // The feeder is a part of pump() here
+SemaphoreHandle_t     feedlock = &feedmutex ;
+WiFiClient*           mp3client = NULL ;       // Connection for the stream
+uint8_t*              ringbuf ;                // The ringbuffer
+uint32_t              ringbfsiz ;
+bool                  ringpsram = false ;
+std::atomic<uint32_t> rbwindex ( 0 ) ;
+std::atomic<uint32_t> rbrindex ( 0 ) ;
+volatile bool         rxeof = false ;          // Set by the receive task
+bool                  localfile = false ;      // No local files
+bool                  plvalid = false ;        // No cached playlist
+int                   playlist_num = 0 ;
+String                host ;
+String                playlist ;
+
+void rxpause()
+{
+}
+
+void rxresume()
+{
+}
+
+bool rxended()
+{
+  return mp3client && !mp3client->connected() ;
+}
+
+void prebufstart()
+{
+}
+
+bool playlistentry ( int num, String* url, String* title )
+{
+  return false ;
+}
+
+#include "ringbuffer.cpp"
+#include "hostconn.cpp"
+#include "hls.cpp"
+#include "gapless.cpp"
+
+//******************************************************************************************
+//                                    A T P O R T                                          *
+//******************************************************************************************
+// Return s with the port of the server after every "example.com".                         *
+//******************************************************************************************
+static std::string atport ( const char* s )
+{
+  std::string res = s ;                        // Result
+  std::string p = ":" + std::to_string ( port ) ;
+  size_t      i = 0 ;                          // Position in res
+
+  while ( ( i = res.find ( "example.com/", i ) ) != std::string::npos )
+  {
+    i += 11 ;                                  // Behind the host name
+    res.insert ( i, p ) ;
+  }
+  return res ;
+}
+
+
+//******************************************************************************************
+//                                    C H U N K                                            *
+//******************************************************************************************
+// Return body with chunked transfer encoding, in chunks of random length.                 *
+//******************************************************************************************
+static std::string chunk ( const std::string& body )
+{
+  std::string res ;                            // Result
+  uint32_t    seed = body.size() ;             // For rand_r
+  size_t      i, n ;                           // Position in body, length of chunk
+  char        line[20] ;                       // Chunk size line
+
+  for ( i = 0 ; i < body.size() ; i += n )
+  {
+    n = std::min ( (size_t)( rand_r ( &seed ) % 3000 + 1 ), body.size() - i ) ;
+    snprintf ( line, sizeof(line), "%zx\r\n", n ) ;
+    res += line ;
+    res.append ( body, i, n ) ;
+    res += "\r\n" ;
+  }
+  return res + "0\r\n\r\n" ;
+}
+
+
+//******************************************************************************************
+//                                  R E S P O N S E                                        *
+//******************************************************************************************
+// Find the response for a URL (host and path).  Call with serverlock held.                *
+//******************************************************************************************
+static std::string response ( const std::string& url )
+{
+  canned_t*   last = NULL ;                    // Last version of the URL
+  const char* name = strrchr ( url.c_str(), '/' ) ; // Last part of the path
+  std::string head ;                           // Header of the response
+  std::string body ;                           // Body of the response
+  size_t      i ;                              // Index in canned
+  int         n ;                              // Segment number
+
+  if ( name && ( sscanf ( name, "/seg%d.ts", &n ) == 1 ) &&
+       ( n >= SEGFIRST ) && ( n < ( SEGFIRST + SEGS ) ) )
+  {
+    segserved.push_back ( n ) ;
+    body.assign ( (const char*)segs[n - SEGFIRST].data, segs[n - SEGFIRST].len ) ;
+    if ( n == SEGCHUNKED )
+    {
+      return "HTTP/1.1 200 OK\r\nContent-Type: video/MP2T\r\n"
+             "Transfer-Encoding: chunked\r\n\r\n" + chunk ( body ) ;
+    }
+    return "HTTP/1.1 200 OK\r\nContent-Type: video/MP2T\r\n\r\n" + body ;
+  }
+  for ( i = 0 ; i < ( sizeof(canned) / sizeof(canned[0]) ) ; i++ )
+  {
+    if ( url == canned[i].url )
+    {
+      last = &canned[i] ;
+      if ( !last->served )
+      {
+        break ;                                // First version not served yet
+      }
+    }
+  }
+  if ( last == NULL )
+  {
+    return "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\n\r\n" ;
+  }
+  last->served = true ;
+  head = atport ( last->head ) ;
+  body = atport ( last->body ) ;
+  if ( head.find ( "chunked" ) != std::string::npos )
+  {
+    body = chunk ( body ) ;
+  }
+  return head + body ;
+}
+
+
+//******************************************************************************************
+//                                    A N S W E R                                          *
+//******************************************************************************************
+// Read a request from a connection and send the response.                                 *
+//******************************************************************************************
+static void answer ( int fd )
+{
+  char        req[1024] ;                      // The request
+  size_t      len = 0 ;                        // Length of request
+  char        path[256] = "" ;                 // Path in request
+  char        name[128] = "" ;                 // Host in request
+  const char* p ;                              // Host line in request
+  std::string resp ;                           // The response
+  ssize_t     n ;                              // Bytes received or sent
+  size_t      i ;                              // Bytes of response sent
+
+  while ( ( len < ( sizeof(req) - 1 ) ) &&
+          ( ( n = recv ( fd, req + len, sizeof(req) - 1 - len, 0 ) ) > 0 ) )
+  {
+    len += n ;
+    req[len] = '\0' ;
+    if ( strstr ( req, "\r\n\r\n" ) )          // End of request?
+    {
+      break ;
+    }
+  }
+  req[len] = '\0' ;
+  sscanf ( req, "GET %255s", path ) ;
+  if ( ( p = strcasestr ( req, "\nHost:" ) ) )
+  {
+    sscanf ( p + 6, " %127[^:\r\n]", name ) ;  // Host without port
+  }
+  {
+    std::lock_guard<std::mutex> lock ( serverlock ) ;
+    requests++ ;
+    icyrequests += ( strcasestr ( req, "Icy-MetaData" ) != NULL ) ;
+    resp = response ( std::string ( name ) + path ) ;
+  }
+  for ( i = 0 ; i < resp.size() ; i += n )
+  {
+    n = send ( fd, resp.data() + i, std::min ( (size_t)1400, resp.size() - i ),
+               MSG_NOSIGNAL ) ;
+    if ( n <= 0 )
+    {
+      break ;                                  // Client has gone
+    }
+  }
+  close ( fd ) ;
+}
+
+
+//******************************************************************************************
+//                                    S E R V E                                            *
+//******************************************************************************************
+// Start the server on a free port of the loopback.  Every connection gets a thread.       *
+//******************************************************************************************
+static bool serve()
+{
+  sockaddr_in addr ;                           // Address of the server
+  socklen_t   len = sizeof(addr) ;
+
+  listenfd = socket ( AF_INET, SOCK_STREAM, IPPROTO_TCP ) ;
+  memset ( &addr, 0, sizeof(addr) ) ;
+  addr.sin_family = AF_INET ;
+  addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK ) ;
+  if ( ( listenfd < 0 ) ||
+       ( bind ( listenfd, (sockaddr*)&addr, sizeof(addr) ) < 0 ) ||
+       ( listen ( listenfd, 16 ) < 0 ) ||
+       ( getsockname ( listenfd, (sockaddr*)&addr, &len ) < 0 ) )
+  {
+    return false ;
+  }
+  port = ntohs ( addr.sin_port ) ;
+  std::thread ( []
+  {
+    int fd ;                                   // Connection of a client
+
+    while ( ( fd = accept ( listenfd, NULL, NULL ) ) >= 0 )
+    {
+      std::thread ( answer, fd ).detach() ;
+    }
+  } ).detach() ;
+  return true ;
+}
+
+
+//******************************************************************************************
+//                                    T S O U T                                            *
+//******************************************************************************************
+// Add one packet to a segment.  The payload is padded with an adaptation field if it is   *
+// short, or if a PCR is asked for.  Returns the number of payload bytes in the packet.    *
+//******************************************************************************************
+static uint32_t tsout ( segment_t* s, uint16_t pid, bool pusi, bool pcr, const uint8_t* p,
+                        uint32_t len )
+{
+  static uint8_t cc[0x2000] ;                  // Continuity counters
+  uint8_t*       pkt = s->data + s->len ;      // Packet to fill
+  uint32_t       n = len ;                     // Payload in this packet
+  uint32_t       off = 4 ;                     // Start of payload
+  uint8_t        aflen ;                       // Length of adaptation field
+
+  if ( n > ( pcr ? 176u : 184u ) )
+  {
+    n = pcr ? 176 : 184 ;
+  }
+  pkt[0] = TSSYNC ;
+  pkt[1] = ( pusi ? 0x40 : 0 ) | ( pid >> 8 ) ;
+  pkt[2] = pid & 0xFF ;
+  pkt[3] = 0x10 | ( cc[pid]++ & 0x0F ) ;       // Payload only
+  if ( n < 184 )
+  {
+    pkt[3] |= 0x20 ;                           // Adaptation field and payload
+    aflen = 183 - n ;
+    pkt[4] = aflen ;
+    if ( aflen )
+    {
+      pkt[5] = pcr ? 0x10 : 0 ;                // Flags
+      memset ( pkt + 6, 0xFF, aflen - 1 ) ;    // PCR and stuffing
+    }
+    off = 5 + aflen ;
+  }
+  memcpy ( pkt + off, p, n ) ;
+  s->len += TSPKTSIZ ;
+  return n ;
+}
+
+
+//******************************************************************************************
+//                                    P E S O U T                                          *
+//******************************************************************************************
+// Add a PES packet with len bytes of audio or video to a segment.                         *
+//******************************************************************************************
+static void pesout ( segment_t* s, uint16_t pid, uint8_t streamid, const uint8_t* p,
+                     uint32_t len, bool pcr )
+{
+  static uint8_t pes[14 + 4000] ;              // PES header and payload
+  uint32_t       plen = 14 + len ;             // Length of PES packet
+  uint32_t       i ;                           // Bytes of PES packet done
+
+  pes[0] = 0 ;                                 // Start code
+  pes[1] = 0 ;
+  pes[2] = 1 ;
+  pes[3] = streamid ;
+  pes[4] = ( plen - 6 ) >> 8 ;                 // PES packet length
+  pes[5] = ( plen - 6 ) & 0xFF ;
+  pes[6] = 0x80 ;                              // Marker bits
+  pes[7] = 0x80 ;                              // PTS only
+  pes[8] = 5 ;                                 // PES header data length
+  memset ( pes + 9, 0x21, 5 ) ;                // PTS
+  memcpy ( pes + 14, p, len ) ;
+  for ( i = 0 ; i < plen ; )
+  {
+    i += tsout ( s, pid, i == 0, pcr && ( i == 0 ), pes + i, plen - i ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                  M A K E S E G                                          *
+//******************************************************************************************
+// Build a segment.  The tables and the video come before the first audio, so the          *
+// demultiplexer must skip them.                                                           *
+//******************************************************************************************
+static void makeseg ( segment_t* s, uint32_t seed )
+{
+  static const uint8_t pat[] = { 0, 0x00, 0xB0, 0x0D, 0, 1, 0xC1, 0, 0, 0, 1, 0xF0, 0 } ;
+  static const uint8_t pmt[] = { 0, 0x02, 0xB0, 0x17, 0, 1, 0xC1, 0, 0, 0xE1, 0x01 } ;
+  uint8_t  video[1000] ;                       // Video payload
+  uint32_t i ;                                 // Index in es
+  uint32_t n ;                                 // Audio in a PES packet
+  int      k = 0 ;                             // PES packet number
+
+  for ( i = 0 ; i < ESSIZ ; i++ )
+  {
+    s->es[i] = rand_r ( &seed ) ;
+  }
+  memset ( video, 0x47, sizeof(video) ) ;      // Looks like sync bytes
+  s->len = 0 ;
+  for ( i = 0 ; i < ESSIZ ; i += n )
+  {
+    if ( ( k % 8 ) == 0 )
+    {
+      tsout ( s, 0, true, false, pat, sizeof(pat) ) ;
+      tsout ( s, 0x1000, true, false, pmt, sizeof(pmt) ) ;
+      pesout ( s, VIDEOPID, 0xE0, video, sizeof(video), true ) ;
+    }
+    if ( ( k % 5 ) == 2 )
+    {
+      tsout ( s, TSNOPID, false, false, video, 184 ) ;
+    }
+    n = rand_r ( &seed ) % 3000 + 1 ;
+    if ( n > ( ESSIZ - i ) )
+    {
+      n = ESSIZ - i ;
+    }
+    pesout ( s, AUDIOPID, 0xC0 + ( k % 2 ), s->es + i, n, ( k % 3 ) == 0 ) ;
+    k++ ;
+  }
+}
+
+
+//******************************************************************************************
+//                                   E S H A S H                                           *
+//******************************************************************************************
+// Add the audio of a segment to a FNV-1a hash, like the sink does.                        *
+//******************************************************************************************
+static uint32_t eshash ( uint32_t h, const segment_t* s )
+{
+  uint32_t i ;                                 // Index in es
+
+  for ( i = 0 ; i < ESSIZ ; i++ )
+  {
+    h = ( h ^ s->es[i] ) * 16777619 ;
+  }
+  return h ;
+}
+
+
+//******************************************************************************************
+//                                     P U M P                                             *
+//******************************************************************************************
+// One pass of loop(), the receive task and the feeder task.  The receive task reads all   *
+// there is into the ringbuffer, the feeder sends all of it in runs of at most 32 bytes.   *
+//******************************************************************************************
+static void pump()
+{
+  uint8_t* p ;                                 // Span in ringbuffer
+  uint32_t n ;                                 // Length of span
+  int      res ;                               // Result of read
+
+  streamconnpoll() ;                           // loop()
+  hlspoll() ;
+  prefetchpoll() ;
+  if ( mp3client )                             // Receive task
+  {
+    while ( ( n = ringwspan ( &p ) ) && ( ( res = mp3client->read ( p, n ) ) > 0 ) )
+    {
+      ringwcommit ( res ) ;
+    }
+  }
+  xSemaphoreTake ( feedlock, portMAX_DELAY ) ; // Feeder
+  while ( ( datamode != STOPREQD ) && ( n = ringrspan ( &p ) ) )
+  {
+    if ( n > 32 )
+    {
+      n = 32 ;
+    }
+    n = prefetchlimit ( n ) ;
+    n = streamfunc ( p, n ) ;
+    ringrcommit ( n ) ;
+    prefetchused ( n ) ;
+  }
+  xSemaphoreGive ( feedlock ) ;
+  delay ( 1 ) ;
+}
+
+
+//******************************************************************************************
+//                                      R U N                                              *
+//******************************************************************************************
+// Play the HLS stream until the audio of all segments from 102 on has been played.  A     *
+// reload is done as soon as it is due.                                                    *
+//******************************************************************************************
+static bool run()
+{
+  uint32_t t0 = millis() ;                     // Start time
+  uint64_t total = (uint64_t)( SEGS - 2 ) * ESSIZ ; // Audio to be played
+
+  hlsstart ( atport ( "radio.example.com/master.m3u8" ).c_str() ) ;
+  while ( ( vs1053player.bytes < total ) && ( datamode != STOPREQD ) &&
+          ( ( millis() - t0 ) < RUNMS ) )
+  {
+    if ( hlsloadms && !hlsfirst )              // Reload planned?
+    {
+      hlsloadms = millis() | 1 ;               // Yes, do not wait for it
+    }
+    pump() ;
+  }
+  printf ( "Stream: %llu of %llu bytes played in %u msec, %d requests\n",
+           (unsigned long long)vs1053player.bytes, (unsigned long long)total,
+           millis() - t0, requests ) ;
+  return vs1053player.bytes == total ;
+}
+
+
+//******************************************************************************************
+//                                 T S S P L I T                                           *
+//******************************************************************************************
+// Feed a segment to tsfeed() with random split points and with garbage in front of the    *
+// first audio packet.  The garbage has sync bytes, but not 188 bytes apart.  A sync byte  *
+// in it that is taken for a packet start swallows the start of the audio.                 *
+//******************************************************************************************
+static bool tssplit ( const segment_t* s, uint32_t seed )
+{
+  static uint8_t in[SEGSIZ + TSPKTSIZ] ;       // Segment with garbage
+  uint32_t       junk = rand_r ( &seed ) % TSPKTSIZ ; // Bytes of garbage
+  uint32_t       len = junk + s->len ;         // Length of input
+  uint32_t       at = 0 ;                      // Offset of first audio packet
+  uint32_t       i ;                           // Index in input
+  uint32_t       n ;                           // Length of span
+
+  while ( ( ( ( s->data[at + 1] & 0x1F ) << 8 ) | s->data[at + 2] ) != AUDIOPID )
+  {
+    at += TSPKTSIZ ;
+  }
+  memcpy ( in, s->data, at ) ;
+  for ( i = 0 ; i < junk ; i++ )
+  {
+    in[at + i] = ( ( i % 7 ) == 3 ) ? TSSYNC : ( i & 1 ) ? 0x11 : 0x22 ;
+  }
+  memcpy ( in + at + junk, s->data + at, s->len - at ) ;
+  vs1053player.reset() ;
+  mpeginit ( &mpegsync, false ) ;
+  tsinit ( &tsdemux ) ;
+  for ( i = 0 ; i < len ; i += n )
+  {
+    n = rand_r ( &seed ) % 1000 + 1 ;
+    if ( n > ( len - i ) )
+    {
+      n = len - i ;
+    }
+    if ( tsfeed ( &tsdemux, in + i, n ) != n )
+    {
+      return false ;
+    }
+  }
+  return ( tsdemux.lost == junk ) && ( tsdemux.pid == AUDIOPID ) &&
+         ( vs1053player.bytes == ESSIZ ) && ( vs1053player.hash == eshash ( 2166136261, s ) ) ;
+}
+
+
+int main()
+{
+  uint32_t seed = 1 ;                          // For the split points
+  uint32_t h = 2166136261 ;                    // Hash of the audio to be played
+  int      fail = 0 ;                          // Failed checks
+  int      before ;                            // Requests before the bad redirect
+  int      trial ;                             // Trial number
+  size_t   i ;                                 // Index in segs and segserved
+
+  for ( i = 0 ; i < SEGS ; i++ )
+  {
+    makeseg ( &segs[i], SEGFIRST + i ) ;
+  }
+  for ( i = 2 ; i < SEGS ; i++ )
+  {
+    h = eshash ( h, &segs[i] ) ;               // Playing starts at segment 102
+  }
+  if ( !serve() )
+  {
+    printf ( "No server\n" ) ;
+    return 1 ;
+  }
+  allocring ( RINGBFSIZ ) ;
+  vs1053player.reset() ;
+  fail += !run() ;
+  fail += ( vs1053player.hash != h ) || ( streamfmt != FMT_TS ) ;
+  printf ( "Playlists: %d variants, using %d bits/sec, target %d sec\n", hlsnvar,
+           hlsvarbw[hlsvar], hlstarget ) ;
+  fail += ( hlsnvar != 2 ) || ( hlsvarbw[hlsvar] != 64000 ) || ( hlstarget != 6 ) ;
+  fail += ( atport ( "radio.example.com/live/lo/index.m3u8" ) != hlsmedia ) ;
+  fail += !hlsendlist || ( hlsloadms != 0 ) || !hlsactive ;
+  printf ( "Segments:" ) ;
+  for ( i = 0 ; i < segserved.size() ; i++ )
+  {
+    printf ( " %d", segserved[i] ) ;
+    fail += ( segserved[i] != (int)( SEGFIRST + 2 + i ) ) ; // Near the live edge, in order
+  }
+  printf ( "\n" ) ;
+  fail += ( segserved.size() != ( SEGS - 2 ) ) ;
+  hlsbps = 400000 ;                            // Fast enough for the high bandwidth
+  fail += ( hlsvarbw[hlschoose()] != 256000 ) ;
+  hlsstop() ;
+  before = requests ;
+  hlsstart ( atport ( "radio.example.com/bad.m3u8" ).c_str() ) ;
+  for ( trial = 0 ; ( trial < 1000 ) && hlsactive ; trial++ )
+  {
+    pump() ;
+  }
+  delay ( 50 ) ;                               // A wrong request would arrive now
+  printf ( "Redirect to https: %s, %d requests\n", hlsactive ? "active" : "stopped",
+           requests - before ) ;
+  fail += hlsactive || ( requests != ( before + 1 ) ) ;
+  printf ( "Requests with Icy-MetaData: %d of %d\n", icyrequests, requests ) ;
+  fail += ( icyrequests != 0 ) ;
+  for ( trial = 0 ; trial < TRIALS ; trial++ )
+  {
+    if ( !tssplit ( &segs[trial % SEGS], rand_r ( &seed ) ) )
+    {
+      printf ( "Split trial %d failed, %llu of %d bytes played, %u lost\n", trial,
+               (unsigned long long)vs1053player.bytes, ESSIZ, tsdemux.lost ) ;
+      fail++ ;
+    }
+  }
+  printf ( "%d split trials, %d checks failed\n", TRIALS, fail ) ;
+  return fail ? 1 : 0 ;
+}
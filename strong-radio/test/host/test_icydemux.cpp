@@ -0,0 +1,160 @@
+//******************************************************************************************
+// Host test and benchmark of the block-oriented ICY demuxer.                              *
+//******************************************************************************************
+// An ICY stream (audio with a metadata block every METAINT bytes) is handled twice:       *
+// byte by byte with handlebyte() and in spans of random length with handlebytes().  The   *
+// audio sent to the decoder and the titles shown must be identical.  The throughput of    *
+// both is shown in MB/s of input.                                                         *
+//******************************************************************************************
+#include "stream.h"
+
+#define METAINT        8192                    // Audio bytes between metadata blocks
+#define BLOCKS         512                     // Metadata blocks in the stream
+#define RUNS           4                       // Passes for the timing
+
+uint8_t* stream ;                              // The test stream
+uint32_t streamlen ;                           // Length of the test stream
+
+//******************************************************************************************
+//                                  M A K E S T R E A M                                    *
+//******************************************************************************************
+// Build the test stream.  Most metadata blocks are empty, every 8th block has a title     *
+// and every 16th title is new.                                                            *
+//******************************************************************************************
+static void makestream()
+{
+  uint32_t seed = 1 ;                          // For rand_r
+  char     meta[255 * 16] ;                    // Metadata block
+  int      mlen ;                              // Length of metadata
+  int      b, i ;                              // Block, byte in block
+
+  stream = (uint8_t*)malloc ( BLOCKS * ( METAINT + 1 + sizeof(meta) ) ) ;
+  streamlen = 0 ;
+  for ( b = 0 ; b < BLOCKS ; b++ )
+  {
+    for ( i = 0 ; i < METAINT ; i++ )
+    {
+      stream[streamlen++] = rand_r ( &seed ) ;
+    }
+    mlen = 0 ;
+    if ( ( b % 8 ) == 0 )
+    {
+      mlen = snprintf ( meta, sizeof(meta), "StreamTitle='Artist %d - Song %d';"
+                        "StreamUrl='';", b / 128, b / 128 ) ;
+      mlen = ( mlen + 15 ) / 16 ;              // Length in units of 16 bytes
+      memset ( meta + strlen ( meta ), 0, mlen * 16 - strlen ( meta ) ) ;
+    }
+    stream[streamlen++] = mlen ;
+    memcpy ( stream + streamlen, meta, mlen * 16 ) ;
+    streamlen += mlen * 16 ;
+  }
+}
+
+
+//******************************************************************************************
+//                                  S T A R T                                              *
+//******************************************************************************************
+// Set the state as after the header of an MP3 stream with metadata.                       *
+//******************************************************************************************
+static void start()
+{
+  vs1053player.reset() ;
+  icymetainit ( &icymeta ) ;
+  datamode = DATA ;
+  metaint = METAINT ;
+  datacount = METAINT ;
+  bufcnt = 0 ;
+  sniffing = false ;
+  streamfmt = FMT_MP3 ;
+  mpeginit ( &mpegsync, false ) ;
+}
+
+
+//******************************************************************************************
+//                                 P A S S B Y T E S                                       *
+//******************************************************************************************
+static void passbytes()
+{
+  uint32_t i ;                                 // Index in stream
+
+  for ( i = 0 ; i < streamlen ; i++ )
+  {
+    handlebyte ( stream[i] ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                 P A S S S P A N S                                       *
+//******************************************************************************************
+// Spans of 1 to 32 bytes, like feedvs1053() takes them from the ringbuffer.               *
+//******************************************************************************************
+static void passspans()
+{
+  uint32_t seed = 7 ;                          // For rand_r
+  uint32_t i = 0 ;                             // Index in stream
+  uint32_t n ;                                 // Length of span
+
+  while ( i < streamlen )
+  {
+    n = rand_r ( &seed ) % 32 + 1 ;
+    if ( n > ( streamlen - i ) )
+    {
+      n = streamlen - i ;
+    }
+    while ( n )                                // Like the caller of handlebytes()
+    {
+      uint32_t used = handlebytes ( stream + i, n ) ;
+      i += used ;
+      n -= used ;
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                     R U N                                               *
+//******************************************************************************************
+// Run a pass RUNS times, show the throughput and return the result of the last run.       *
+//******************************************************************************************
+static sink_t run ( const char* name, void ( *pass )() )
+{
+  uint32_t t0 ;                                // Start time
+  uint32_t us ;                                // Duration
+  int      r ;                                 // Run
+
+  t0 = micros() ;
+  for ( r = 0 ; r < RUNS ; r++ )
+  {
+    start() ;
+    pass() ;
+  }
+  us = micros() - t0 ;
+  printf ( "%-6s %7.1f MB/s, %llu audio bytes, %u titles\n", name,
+           (double)streamlen * RUNS / ( us ? us : 1 ),
+           (unsigned long long)vs1053player.bytes, vs1053player.titles ) ;
+  return vs1053player ;
+}
+
+
+int main()
+{
+  sink_t rb, rs ;                              // Results per byte and per span
+
+  makestream() ;
+  rb = run ( "byte", passbytes ) ;
+  rs = run ( "span", passspans ) ;
+  free ( stream ) ;
+  if ( ( rb.bytes != (uint64_t)METAINT * BLOCKS ) || ( rb.titles != BLOCKS / 128 ) )
+  {
+    printf ( "Per byte result is wrong\n" ) ;
+    return 1 ;
+  }
+  if ( ( rb.bytes != rs.bytes ) || ( rb.hash != rs.hash ) ||
+       ( rb.titles != rs.titles ) || ( rb.titlehash != rs.titlehash ) )
+  {
+    printf ( "Output differs\n" ) ;
+    return 1 ;
+  }
+  return 0 ;
+}
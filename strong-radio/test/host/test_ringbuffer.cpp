@@ -0,0 +1,138 @@
+//******************************************************************************************
+// Host test of the ringbuffer as a single producer/single consumer queue.                 *
+//******************************************************************************************
+// A producer thread writes a numbered byte sequence with spans and single bytes of random *
+// length, a consumer thread reads it back the same way and checks every byte.  The        *
+// threads only share the ringbuffer, like the receive task and the feeder task.           *
+// Exit code 0 if all bytes arrived in order.                                              *
+//******************************************************************************************
+#include "host.h"
+
+#define RINGBFSIZ      20000                   // Default size, as in main.cpp
+#define TESTBYTES      20000000                // Bytes to move through the ringbuffer
+
+uint8_t*              ringbuf ;                // Globals of main.cpp used by the ringbuffer
+uint32_t              ringbfsiz ;
+bool                  ringpsram = false ;
+std::atomic<uint32_t> rbwindex ( 0 ) ;
+std::atomic<uint32_t> rbrindex ( 0 ) ;
+
+#include "ringbuffer.cpp"
+
+//******************************************************************************************
+//                                  P A T T E R N                                          *
+//******************************************************************************************
+// Byte number i of the test sequence.                                                     *
+//******************************************************************************************
+static inline uint8_t pattern ( uint32_t i )
+{
+  return ( i * 7 ) ^ ( i >> 11 ) ;
+}
+
+
+//******************************************************************************************
+//                                 P R O D U C E R                                         *
+//******************************************************************************************
+// Write TESTBYTES bytes.  Mostly spans, sometimes single bytes with putring().            *
+//******************************************************************************************
+static void producer()
+{
+  uint32_t seed = 12345 ;                      // For rand_r
+  uint32_t i = 0 ;                             // Next byte number
+  uint32_t n, k ;                              // Length of span, index in span
+  uint8_t* p ;                                 // Span in ringbuffer
+
+  while ( i < TESTBYTES )
+  {
+    if ( ( rand_r ( &seed ) & 15 ) == 0 )      // Sometimes a single byte
+    {
+      if ( ringspace() )
+      {
+        putring ( pattern ( i++ ) ) ;
+      }
+      continue ;
+    }
+    n = ringwspan ( &p ) ;
+    if ( n == 0 )                              // Buffer full?
+    {
+      yield() ;                                // Yes, let the consumer run
+      continue ;
+    }
+    k = rand_r ( &seed ) % 1500 + 1 ;          // Like one TCP segment or less
+    if ( n > k )
+    {
+      n = k ;
+    }
+    if ( n > ( TESTBYTES - i ) )
+    {
+      n = TESTBYTES - i ;
+    }
+    for ( k = 0 ; k < n ; k++ )
+    {
+      p[k] = pattern ( i + k ) ;
+    }
+    ringwcommit ( n ) ;
+    i += n ;
+  }
+}
+
+
+//******************************************************************************************
+//                                 C O N S U M E R                                         *
+//******************************************************************************************
+// Read TESTBYTES bytes and check them.  Returns the number of wrong bytes.                *
+//******************************************************************************************
+static uint32_t consumer()
+{
+  uint32_t seed = 54321 ;                      // For rand_r
+  uint32_t i = 0 ;                             // Next byte number
+  uint32_t errors = 0 ;                        // Wrong bytes
+  uint32_t n, k ;                              // Length of span, index in span
+  uint8_t* p ;                                 // Span in ringbuffer
+
+  while ( i < TESTBYTES )
+  {
+    if ( ( rand_r ( &seed ) & 15 ) == 0 )      // Sometimes a single byte
+    {
+      if ( ringavail() )
+      {
+        errors += ( getring() != pattern ( i++ ) ) ;
+      }
+      continue ;
+    }
+    n = ringrspan ( &p ) ;
+    if ( n == 0 )                              // Buffer empty?
+    {
+      yield() ;                                // Yes, let the producer run
+      continue ;
+    }
+    k = rand_r ( &seed ) % 32 + 1 ;            // Like one DREQ of the VS1053
+    if ( n > k )
+    {
+      n = k ;
+    }
+    for ( k = 0 ; k < n ; k++ )
+    {
+      errors += ( p[k] != pattern ( i + k ) ) ;
+    }
+    ringrcommit ( n ) ;
+    i += n ;
+  }
+  return errors ;
+}
+
+
+int main()
+{
+  uint32_t errors ;                            // Wrong bytes seen by the consumer
+  uint32_t t0 = millis() ;                     // Start of test
+
+  allocring ( RINGBFSIZ ) ;
+  std::thread prod ( producer ) ;
+  errors = consumer() ;
+  prod.join() ;
+  printf ( "SPSC: %d bytes in %d msec, %d errors, %d left in ringbuffer\n",
+           TESTBYTES, millis() - t0, errors, ringavail() ) ;
+  free ( ringbuf ) ;
+  return ( errors || ringavail() ) ? 1 : 0 ;
+}
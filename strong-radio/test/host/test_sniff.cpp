@@ -0,0 +1,145 @@
+//******************************************************************************************
+// Host test of format detection on streams that start mid-frame.                          *
+//******************************************************************************************
+// An ICY server starts sending at any point of the stream, so the first MPEG frame header *
+// is seldom at offset 0.  sniffclassify() does not find it then and falls back to the     *
+// content-type after SNIFFSIZ bytes, which are played from the sniff buffer by            *
+// sniffdata().  The response (header, a few bytes of the previous frame, whole frames) is *
+// fed to the stream path in spans like the feeder does, for several offsets of the first  *
+// header.  The decoder must get exactly the frames, in chunks of at most 32 bytes.  A     *
+// stream with junk between two frames must lose the sync once, but no data.               *
+//******************************************************************************************
+#include "stream.h"
+
+#define FRAMES         100                     // Frames in the stream
+#define FRAMESIZ       417                     // MPEG 1 layer III, 128 kb/s, 44.1 kHz
+#define JUNK           100                     // Junk bytes in the middle of the stream
+
+const char* head = "ICY 200 OK\r\nicy-br:128\r\ncontent-type:audio/mpeg\r\n\r\n" ;
+
+uint8_t  resp[1000 + JUNK + FRAMES * FRAMESIZ] ; // Response of the server
+uint32_t resplen ;                             // Length of response
+uint32_t audiolen ;                            // Length of the audio after the skip bytes
+uint32_t audiohash ;                           // FNV-1a of the audio after the skip bytes
+
+//******************************************************************************************
+//                                 M A K E R E S P                                         *
+//******************************************************************************************
+// Build the response with skip bytes before the first frame header and junk bytes after   *
+// half of the frames.                                                                     *
+//******************************************************************************************
+static void makeresp ( uint32_t skip, uint32_t junk )
+{
+  uint32_t seed = 17 ;                         // For rand_r
+  uint32_t f, i ;                              // Frame, byte in frame
+  uint8_t* p ;                                 // Start of frame
+
+  resplen = sprintf ( (char*)resp, "%s", head ) ;
+  memset ( resp + resplen, 0, skip ) ;         // Tail of previous frame
+  resplen += skip ;
+  audiolen = 0 ;
+  audiohash = 2166136261 ;
+  for ( f = 0 ; f < FRAMES ; f++ )
+  {
+    if ( f == ( FRAMES / 2 ) )                 // Half way?
+    {
+      memset ( resp + resplen, 0x55, junk ) ;  // Yes, insert the junk
+      for ( i = 0 ; i < junk ; i++ )
+      {
+        audiohash = ( audiohash ^ 0x55 ) * 16777619 ;
+      }
+      resplen += junk ;
+      audiolen += junk ;
+    }
+    p = resp + resplen ;
+    p[0] = 0xFF ;                              // Frame header
+    p[1] = 0xFB ;
+    p[2] = 0x90 ;
+    p[3] = 0x00 ;
+    for ( i = 4 ; i < FRAMESIZ ; i++ )
+    {
+      p[i] = rand_r ( &seed ) ;                // Audio data
+    }
+    for ( i = 0 ; i < FRAMESIZ ; i++ )
+    {
+      audiohash = ( audiohash ^ p[i] ) * 16777619 ;
+    }
+    resplen += FRAMESIZ ;
+    audiolen += FRAMESIZ ;
+  }
+}
+
+
+//******************************************************************************************
+//                                     P L A Y                                             *
+//******************************************************************************************
+// Feed the response to streamfunc in spans of 1 to 32 bytes, like the feeder does.        *
+//******************************************************************************************
+static void play ( uint32_t seed )
+{
+  uint8_t  span[32] ;                          // Span from the ringbuffer
+  uint32_t i = 0 ;                             // Index in response
+  uint32_t n ;                                 // Length of span
+  uint32_t used ;                              // Bytes used by streamfunc
+
+  vs1053player.reset() ;
+  datamode = INIT ;
+  chunked = false ;
+  streamfunc = handlebytes_ch ;
+  while ( ( i < resplen ) && ( datamode != STOPREQD ) )
+  {
+    n = rand_r ( &seed ) % 32 + 1 ;
+    if ( n > ( resplen - i ) )
+    {
+      n = resplen - i ;
+    }
+    memcpy ( span, resp + i, n ) ;
+    i += n ;
+    for ( uint8_t* q = span ; n ; q += used, n -= used )
+    {
+      used = streamfunc ( q, n ) ;
+    }
+  }
+}
+
+
+//******************************************************************************************
+//                                    C H E C K                                            *
+//******************************************************************************************
+// Check what the decoder got.  Returns 1 if wrong.                                        *
+//******************************************************************************************
+static int check ( const char* name, uint32_t skip, uint16_t resyncs )
+{
+  if ( ( streamfmt == FMT_MP3 ) && ( vs1053player.maxchunk <= 32 ) &&
+       ( vs1053player.bytes == audiolen ) && ( vs1053player.hash == audiohash ) &&
+       ( mpegsync.resyncs == resyncs ) )
+  {
+    return 0 ;
+  }
+  printf ( "%s %3u: %s, %llu of %u bytes, chunks up to %u bytes, %u resyncs\n", name, skip,
+           fmtnames[streamfmt], (unsigned long long)vs1053player.bytes, audiolen,
+           (unsigned)vs1053player.maxchunk, mpegsync.resyncs ) ;
+  return 1 ;
+}
+
+
+int main()
+{
+  static const uint32_t skips[] = { 0, 1, 2, 3, 17, 40, 63, 64, 200 } ;
+  int                   fail = 0 ;             // Failed offsets
+  size_t                k ;                    // Index in skips
+
+  for ( k = 0 ; k < ( sizeof(skips) / sizeof(skips[0]) ) ; k++ )
+  {
+    makeresp ( skips[k], 0 ) ;
+    play ( k + 1 ) ;
+    fail += check ( "Skip", skips[k], 0 ) ;
+  }
+  printf ( "Sniff: %d of %d offsets failed\n", fail, (int)k ) ;
+  makeresp ( 40, JUNK ) ;
+  play ( 99 ) ;
+  k = check ( "Junk", 40, 1 ) ;
+  printf ( "Resync: %s\n", k ? "audio lost" : "no audio lost" ) ;
+  fail += k ;
+  return fail ? 1 : 0 ;
+}
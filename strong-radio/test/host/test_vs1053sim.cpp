@@ -0,0 +1,194 @@
+//******************************************************************************************
+// Host test of the VS1053 driver with the simulated chip.                                 *
+//******************************************************************************************
+// The driver is started and fed like the feeder task does: bursts of 32 byte chunks while *
+// DREQ is high, a flush of the SCI queue after every burst and a short sleep.  The        *
+// simulated FIFO must never overflow or run empty.  A stall of the feeder longer than     *
+// the FIFO must be seen as starvation.  The SCI cache must drop unchanged writes, and a   *
+// volume change queued by loop() while the feeder flushes must always reach the chip.     *
+//******************************************************************************************
+#include "vs1053host.h"
+
+#define FEEDMS         1500                    // Duration of the feed test
+#define ROUNDS         100                     // Rounds of the SCI race test
+
+//******************************************************************************************
+// Test access to the registers in the chip and in the shadow.                             *
+//******************************************************************************************
+struct vs1053test : VS1053<vs1053sim>
+{
+  vs1053test() : VS1053<vs1053sim> ( VS1053_CS, VS1053_DCS, VS1053_DREQ )
+  {
+  }
+
+  uint16_t chipreg ( uint8_t reg )
+  {
+    return read_register ( reg ) ;
+  }
+
+  uint16_t shadowreg ( uint8_t reg )
+  {
+    return sci_get ( reg ) ;
+  }
+} ;
+
+vs1053test vs ;                                // The player under test
+
+//******************************************************************************************
+//                                    F E E D                                              *
+//******************************************************************************************
+// Feed the player for ms milliseconds.  The feeder sleeps sleepms after every burst.      *
+//******************************************************************************************
+static void feed ( uint32_t ms, uint32_t sleepms )
+{
+  static uint8_t chunk[32] ;                   // Audio data
+  uint32_t       t0 = millis() ;               // Start time
+
+  while ( ( millis() - t0 ) < ms )
+  {
+    vs.sdiBegin() ;
+    while ( vs.data_request() )
+    {
+      vs.playChunk ( chunk, sizeof(chunk) ) ;
+    }
+    vs.sdiEnd() ;
+    vs.sciFlush() ;
+    delay ( sleepms ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                  H A L S T A T                                          *
+//******************************************************************************************
+// Get the starvations and overflows from the statistics of the simulated chip.            *
+//******************************************************************************************
+static void halstat ( int* starves, int* overflows )
+{
+  char        reply[200] ;                     // Statistics
+  const char* p ;                              // Position in reply
+
+  vs.halInfo ( reply, sizeof(reply) ) ;
+  dbgprint ( reply ) ;
+  *starves = -1 ;
+  *overflows = -1 ;
+  if ( ( p = strstr ( reply, "FIFO" ) ) )
+  {
+    sscanf ( p, "FIFO %*d, %d starvations, %d overflows", starves, overflows ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                  S C I C O U N T                                        *
+//******************************************************************************************
+// Get the number of SCI transactions and dropped writes from the statistics.              *
+//******************************************************************************************
+static void scicount ( int* transactions, int* dropped )
+{
+  char        reply[200] ;                     // Statistics
+  const char* p ;                              // Position in reply
+
+  vs.sciInfo ( reply, sizeof(reply) ) ;
+  dbgprint ( reply ) ;
+  *transactions = -1 ;
+  *dropped = -1 ;
+  if ( ( p = strchr ( reply, ':' ) ) )
+  {
+    sscanf ( p, ": %d transactions in %*d sec, %*d per second, %d", transactions,
+             dropped ) ;
+  }
+}
+
+
+//******************************************************************************************
+//                                  S C I T O N E                                          *
+//******************************************************************************************
+// Set the same tone n times, like a repeated "tone" command, with a flush after each like *
+// the feeder does.                                                                        *
+//******************************************************************************************
+static void scitone ( bool cache, int n, int* transactions, int* dropped )
+{
+  uint8_t other[4] = { 0, 0, 0, 0 } ;          // Flat
+  uint8_t tone[4]  = { 3, 5, 8, 6 } ;          // Some treble and bass
+  int     i ;                                  // Loop control
+
+  vs.scicache = cache ;
+  vs.setTone ( other ) ;                       // Other value first
+  vs.sciFlush() ;
+  vs.sciReset() ;
+  for ( i = 0 ; i < n ; i++ )
+  {
+    vs.setTone ( tone ) ;
+    vs.sciFlush() ;
+  }
+  scicount ( transactions, dropped ) ;
+}
+
+
+//******************************************************************************************
+//                                  S C I R A C E                                          *
+//******************************************************************************************
+// A second thread flushes the SCI queue all the time while this one changes the volume.   *
+// Returns the number of rounds in which the chip ended with another volume than the       *
+// shadow.                                                                                 *
+//******************************************************************************************
+static int scirace()
+{
+  std::atomic<bool> stop ;                     // End of round
+  int               lost = 0 ;                 // Rounds with a lost update
+  int               round ;                    // Round number
+  int               i ;                        // Loop control
+
+  vs.scicache = true ;
+  for ( round = 0 ; round < ROUNDS ; round++ )
+  {
+    stop = false ;
+    std::thread feeder ( [&stop]
+    {
+      while ( !stop )
+      {
+        vs.sciFlush() ;
+      }
+      vs.sciFlush() ;                          // Last values
+    } ) ;
+    for ( i = 0 ; i < 200 ; i++ )
+    {
+      vs.setVolume ( ( i * 7 + round ) % 100 ) ;
+    }
+    stop = true ;
+    feeder.join() ;
+    lost += ( vs.chipreg ( 0xB ) != vs.shadowreg ( 0xB ) ) ; // SCI_VOL
+  }
+  return lost ;
+}
+
+
+int main()
+{
+  int starves, overflows ;                     // Statistics of the simulated chip
+  int tc, dc ;                                 // SCI transactions and drops, cached
+  int td, dd ;                                 // Same, direct
+  int lost ;                                   // Rounds with a lost volume update
+  int fail = 0 ;                               // Number of failed checks
+
+  vs.begin() ;
+  vs.halReset() ;
+  feed ( FEEDMS, 2 ) ;
+  halstat ( &starves, &overflows ) ;
+  printf ( "Feed:   %d starvations, %d overflows\n", starves, overflows ) ;
+  fail += ( starves != 0 ) || ( overflows != 0 ) ;
+  feed ( 100, 300 ) ;                          // Stall longer than the FIFO lasts
+  halstat ( &starves, &overflows ) ;
+  printf ( "Stall:  %d starvations, %d overflows\n", starves, overflows ) ;
+  fail += ( starves <= 0 ) || ( overflows != 0 ) ;
+  scitone ( true, 100, &tc, &dc ) ;
+  scitone ( false, 100, &td, &dd ) ;
+  printf ( "Tone:   cached %d transactions, %d dropped, direct %d transactions\n",
+           tc, dc, td ) ;
+  fail += ( tc != 1 ) || ( dc != 99 ) || ( td != 100 ) || ( dd != 0 ) ;
+  lost = scirace() ;
+  printf ( "Race:   %d of %d rounds with a lost update\n", lost, ROUNDS ) ;
+  fail += ( lost != 0 ) ;
+  return fail ? 1 : 0 ;
+}
@@ -0,0 +1,103 @@
+//******************************************************************************************
+// The VS1053 driver on the host, with the simulated chip.                                 *
+//******************************************************************************************
+// Provides the parts of the Arduino core and FreeRTOS that vs1053.cpp uses besides the    *
+// ones in host.h, and the globals of main.cpp it needs, then includes vs1053.cpp with     *
+// VS1053_SIM.  The SPI bus and the pins are never used by the simulated HAL, they are     *
+// here for the other HALs to compile.  Every thread is a task of its own.                 *
+//******************************************************************************************
+#ifndef VS1053HOST_H
+#define VS1053HOST_H
+
+#include "host.h"
+
+#define HIGH           1                       // Pin levels and modes
+#define LOW            0
+#define INPUT          1
+#define OUTPUT         2
+#define INPUT_PULLUP   5
+#define MSBFIRST       1                       // SPI settings
+#define SPI_MODE0      0
+#define _BV(b)         ( 1 << (b) )
+
+#define VS1053_CS      5                       // Pins as in main.cpp
+#define VS1053_DCS     16
+#define VS1053_DREQ    4
+#define VS1053_SIM                             // Use the simulated chip
+
+//******************************************************************************************
+// Tasks.                                                                                  *
+//******************************************************************************************
+typedef void* TaskHandle_t ;
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  static thread_local char task ;              // One per thread
+
+  return &task ;
+}
+
+//******************************************************************************************
+// Pins and SPI.                                                                           *
+//******************************************************************************************
+struct
+{
+  uint32_t out_w1ts, out_w1tc ;
+  union { uint32_t val ; } out1_w1ts, out1_w1tc ;
+  uint32_t in ;
+  union { uint32_t val ; } in1 ;
+} GPIO ;
+
+inline void pinMode ( uint8_t pin, uint8_t mode )
+{
+}
+
+inline void digitalWrite ( uint8_t pin, uint8_t val )
+{
+}
+
+inline int digitalRead ( uint8_t pin )
+{
+  return HIGH ;
+}
+
+inline long map ( long x, long in_min, long in_max, long out_min, long out_max )
+{
+  return ( x - in_min ) * ( out_max - out_min ) / ( in_max - in_min ) + out_min ;
+}
+
+struct SPISettings
+{
+  uint32_t _clock ;                            // The simulated chip uses the clock only
+
+  SPISettings() : _clock ( 1000000 ) {}
+  SPISettings ( uint32_t clock, uint8_t bitorder, uint8_t mode ) : _clock ( clock ) {}
+} ;
+
+struct
+{
+  void    beginTransaction ( SPISettings settings ) {}
+  void    endTransaction()                     {}
+  void    write ( uint8_t b )                  {}
+  void    write16 ( uint16_t v )               {}
+  uint8_t transfer ( uint8_t b )               { return 0 ; }
+  void    writeBytes ( uint8_t* data, uint32_t len ) {}
+} SPI ;
+
+//******************************************************************************************
+// Globals of main.cpp.                                                                    *
+//******************************************************************************************
+enum datamode_t { STOPPED = 256 } ;            // Only the state of a stopped player
+
+int        bitrate = 128 ;                     // Drain rate of the simulated FIFO
+datamode_t datamode = STOPPED ;
+bool       reqtone = false ;
+
+inline bool inisetkey ( const char* key, const char* val )
+{
+  return true ;
+}
+
+#include "vs1053.cpp"
+
+#endif